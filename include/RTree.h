@@ -349,10 +349,11 @@ protected:
   void PickSeeds(PartitionVars* a_parVars);
   void Classify(int a_index, int a_group, PartitionVars* a_parVars);
   bool RemoveRect(Rect* a_rect, const DATATYPE& a_id, Node** a_root);
-  bool RemoveRectRec(Rect* a_rect, const DATATYPE& a_id, Node* a_node, ListNode** a_listNode);
+  bool RemoveRectRec(Rect* a_rect, const DATATYPE& a_id, Node* a_node, ListNode** a_listNode, bool a_exact);
   ListNode* AllocListNode();
   void FreeListNode(ListNode* a_listNode);
   bool Overlap(Rect* a_rectA, Rect* a_rectB);
+  bool SameRect(Rect* a_rectA, Rect* a_rectB);
   void ReInsert(Node* a_node, ListNode** a_listNode);
   bool Search(Node* a_node, Rect* a_rect, int& a_foundCount, bool a_resultCallback(DATATYPE a_data, void* a_context), void* a_context);
   void RemoveAllRec(Node* a_node);
@@ -1425,7 +1426,10 @@ bool RTREE_QUAL::RemoveRect(Rect* a_rect, const DATATYPE& a_id, Node** a_root)
   Node* tempNode;
   ListNode* reInsertList = NULL;
 
-  if(!RemoveRectRec(a_rect, a_id, *a_root, &reInsertList))
+  // The same id may be stored under several rects: remove the entry with
+  // exactly this rect if there is one, else any entry with the id.
+  if(!RemoveRectRec(a_rect, a_id, *a_root, &reInsertList, true) ||
+     !RemoveRectRec(a_rect, a_id, *a_root, &reInsertList, false))
   {
     // Found and deleted a data item
     // Reinsert any branches from eliminated nodes
@@ -1471,7 +1475,7 @@ bool RTREE_QUAL::RemoveRect(Rect* a_rect, const DATATYPE& a_id, Node** a_root)
 // merges branches on the way back up.
 // Returns 1 if record not found, 0 if success.
 RTREE_TEMPLATE
-bool RTREE_QUAL::RemoveRectRec(Rect* a_rect, const DATATYPE& a_id, Node* a_node, ListNode** a_listNode)
+bool RTREE_QUAL::RemoveRectRec(Rect* a_rect, const DATATYPE& a_id, Node* a_node, ListNode** a_listNode, bool a_exact)
 {
   ASSERT(a_rect && a_node && a_listNode);
   ASSERT(a_node->m_level >= 0);
@@ -1482,7 +1486,7 @@ bool RTREE_QUAL::RemoveRectRec(Rect* a_rect, const DATATYPE& a_id, Node* a_node,
     {
       if(Overlap(a_rect, &(a_node->m_branch[index].m_rect)))
       {
-        if(!RemoveRectRec(a_rect, a_id, a_node->m_branch[index].m_child, a_listNode))
+        if(!RemoveRectRec(a_rect, a_id, a_node->m_branch[index].m_child, a_listNode, a_exact))
         {
           if(a_node->m_branch[index].m_child->m_count >= MINNODES)
           {
@@ -1505,7 +1509,8 @@ bool RTREE_QUAL::RemoveRectRec(Rect* a_rect, const DATATYPE& a_id, Node* a_node,
   {
     for(int index = 0; index < a_node->m_count; ++index)
     {
-      if(a_node->m_branch[index].m_child == (Node*)a_id)
+      if(a_node->m_branch[index].m_child == (Node*)a_id &&
+         (!a_exact || SameRect(a_rect, &(a_node->m_branch[index].m_rect))))
       {
         DisconnectBranch(a_node, index); // Must return after this call as count has changed
         return false;
@@ -1534,6 +1539,24 @@ bool RTREE_QUAL::Overlap(Rect* a_rectA, Rect* a_rectB)
 }
 
 
+// Decide whether two rectangles are identical.
+RTREE_TEMPLATE
+bool RTREE_QUAL::SameRect(Rect* a_rectA, Rect* a_rectB)
+{
+  ASSERT(a_rectA && a_rectB);
+
+  for(int index=0; index < NUMDIMS; ++index)
+  {
+    if (a_rectA->m_min[index] != a_rectB->m_min[index] ||
+        a_rectA->m_max[index] != a_rectB->m_max[index])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
 // Add a node to the reinsertion list.  All its branches will later
 // be reinserted into the index structure.
 RTREE_TEMPLATE
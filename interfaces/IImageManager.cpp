@@ -39,6 +39,14 @@ QNetworkAccessManager* IImageManager::getNetworkManager() const
     return m_networkManager;
 }
 
+void IImageManager::beginTileRequests()
+{
+}
+
+void IImageManager::endTileRequests()
+{
+}
+
 bool IImageManager::useDiskCache(QString filename)
 {
     // qDebug() << cacheDir.absolutePath() << filename;
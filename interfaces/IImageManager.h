@@ -62,7 +62,7 @@ class IImageManager
          * @param path the path to the image
          * @return the pixmap of the asked image
          */
-        virtual QImage getImage(IMapAdapter* anAdapter, const QString &url) = 0;
+        virtual QImage getImage(IMapAdapter* anAdapter, const QString &url, qreal priority = 0.) = 0;
         virtual QByteArray getData(IMapAdapter* anAdapter, const QString &url) = 0;
 
         //QPixmap prefetchImage(const QString& host, const QString& path);
@@ -84,6 +84,14 @@ class IImageManager
          */
         virtual void abortLoading() = 0;
 
+        /*!
+         * Brackets the requests made to draw one view. Pending requests from
+         * an earlier view that were not made again are dropped; the others
+         * keep loading with their new priority.
+         */
+        virtual void beginTileRequests();
+        virtual void endTileRequests();
+
         virtual void setCacheDir(const QDir& path) = 0;
         virtual QDir getCacheDir() = 0;
         virtual void setCacheMaxSize(int max) = 0;
@@ -15,8 +15,10 @@
 
 #include "IMapAdapterFactory.h"
 #include "IMapAdapter.h"
+#include "GdalRasterReader.h"
 
 #include <QLocale>
+#include <QSharedPointer>
 
 class GDALDataset;
 class GDALColorTable;
@@ -25,7 +27,7 @@ class GdalImage
 {
 public:
     QString theFilename;
-    QPixmap theImg;
+    QSharedPointer<GdalRasterReader> theReader;
     double adfGeoTransform[6];
 };
 
@@ -35,20 +37,6 @@ class GdalAdapter : public IMapAdapter
     Q_INTERFACES(IMapAdapter)
 
 public:
-    enum ImgType
-    {
-        Unknown,
-        GrayScale,
-        Rgb,
-        Hsl,
-        Cmyk,
-        YUV,
-        Palette_Gray,
-        Palette_RGBA,
-        Palette_CMYK,
-        Palette_HLS
-    };
-
     GdalAdapter();
     virtual ~GdalAdapter();
 
@@ -14,10 +14,12 @@ DEFINES += NO_PREFS
 
 HEADERS += \
     ProjectionChooser.h \
+    GdalRasterReader.h \
     GdalAdapter.h
 
 SOURCES += \
     ProjectionChooser.cpp \
+    GdalRasterReader.cpp \
     GdalAdapter.cpp
 
 FORMS += \
@@ -215,11 +215,12 @@ bool GeoTiffAdapter::loadImage(const QString& fn)
             poDataset->GetRasterCount() );
 
     img.theFilename = fn;
-    img.theImg.load(fn);
+    img.theReader = QSharedPointer<GdalRasterReader>(new GdalRasterReader(poDataset));
+    connect(img.theReader.data(), SIGNAL(blocksRead()), this, SIGNAL(forceRefresh()));
     theImages.push_back(img);
     theBbox = theBbox.united(bbox);
 
-    GDALClose((GDALDatasetH)poDataset);
+    poDataset = NULL;
     return true;
 }
 
@@ -307,7 +308,7 @@ QPixmap GeoTiffAdapter::getPixmap(const QRectF& /*wgs84Bbox*/, const QRectF& the
 
 
     for (int i=0; i<theImages.size(); ++i) {
-        QPixmap theImg = theImages[i].theImg;
+        GdalRasterReader* theReader = theImages[i].theReader.data();
 
         QSizeF sz(projBbox.width() / theImages[i].adfGeoTransform[1], projBbox.height() / theImages[i].adfGeoTransform[5]);
         if (sz.isNull())
@@ -323,7 +324,7 @@ QPixmap GeoTiffAdapter::getPixmap(const QRectF& /*wgs84Bbox*/, const QRectF& the
         double rty = src.height() / (double)sz.height();
 
         QRect mRect = QRect(s.toPoint(), sz.toSize());
-        QRect iRect = theImg.rect().intersected(mRect);
+        QRect iRect = QRect(QPoint(0, 0), theReader->size()).intersected(mRect);
         QRect sRect = QRect(iRect.topLeft() - mRect.topLeft(), iRect.size());
         QRect fRect = QRect(sRect.x() * rtx, sRect.y() * rty, sRect.width() * rtx, sRect.height() * rty);
 
@@ -331,10 +332,7 @@ QPixmap GeoTiffAdapter::getPixmap(const QRectF& /*wgs84Bbox*/, const QRectF& the
         qDebug() << "iRect: " << iRect;
         qDebug() << "sRect: " << sRect;
 
-    //	QImage img2 = theImg.copy(iRect).scaled(fRect.size());
-    //	p.drawImage(fRect.topLeft(), img2);
-        QPixmap img2 = theImg.copy(iRect).scaled(fRect.size());
-        p.drawPixmap(fRect.topLeft(), img2);
+        theReader->draw(p, iRect, fRect);
     }
 
     p.end();
@@ -13,10 +13,12 @@ DEFINES += NO_PREFS
 
 HEADERS += \
     ProjectionChooser.h \
+    GdalRasterReader.h \
     GeoTiffAdapter.h
 
 SOURCES += \
     ProjectionChooser.cpp \
+    GdalRasterReader.cpp \
     GeoTiffAdapter.cpp
 
 FORMS += \
@@ -1,13 +1,24 @@
 #include "MemoryBackend.h"
 #include "RTree.h"
+#include "RenderProfiler.h"
 
 #include <QReadWriteLock>
+#include <QVector>
 
 RenderPriority NodePri(RenderPriority::IsSingular,0., 0);
 RenderPriority SegmentPri(RenderPriority::IsLinear,0.,99);
 
 typedef RTree<Feature*, qreal, 2, qreal, 32> CoordTree;
 
+/* Track segments are indexed by chunk; these are the boxes in the tree */
+struct IndexedSegment
+{
+    IndexedSegment() : Layer(0) {}
+
+    ILayer* Layer;
+    QVector<CoordBox> Chunks;
+};
+
 class MemoryBackendPrivate
 {
 public:
@@ -20,13 +31,35 @@ public:
     QList<Feature*> toBeDeleted;
 
     QHash<Feature*, CoordBox> AllocFeatures;
+    QHash<Feature*, IndexedSegment> SegmentChunks;
     QHash<ILayer*, CoordTree*> theRTree;
     QList<Feature*> findResult;
+
+    /* Change transactions */
+    int ChangesDepth;
+    QSet<Feature*> ChangedParents;
+
+    /* Tag index: key id -> value id -> features */
+    mutable QMutex tagIndexLock;
+    QHash<quint32, QHash<quint32, QSet<Feature*> > > TagIndex;
+};
+
+/* A segment is in the tree once per chunk, but must be listed only once */
+struct IndexFindListContext
+{
+    QList<Feature*>* theFeatures;
+    QSet<Feature*> theSegments;
 };
 
 bool indexFindCallbackList(Feature* F, void* ctxt)
 {
-    ((QList<Feature*>*)(ctxt))->append(F);
+    IndexFindListContext* pCtxt = (IndexFindListContext*)ctxt;
+    if (CHECK_SEGMENT(F)) {
+        if (pCtxt->theSegments.contains(F))
+            return true;
+        pCtxt->theSegments.insert(F);
+    }
+    pCtxt->theFeatures->append(F);
     return true;
 }
 
@@ -34,6 +67,9 @@ bool indexFindCallback(Feature* F, void* ctxt)
 {
     IndexFindContext* pCtxt = (IndexFindContext*)ctxt;
 
+    if (pCtxt->cancelled && pCtxt->cancelled->load())
+        return false;
+
     if (!F->isVisible())
         return true;
 
@@ -41,7 +77,10 @@ bool indexFindCallback(Feature* F, void* ctxt)
         Way * R = STATIC_CAST_WAY(F);
         if (pCtxt->theFeatures->value(R->renderPriority()).contains(F))
             return true;
-        R->buildPath(*(pCtxt->theProjection));
+        {
+            RenderTimer T(RenderProfiler::BuildPath);
+            R->buildPath(*(pCtxt->theProjection));
+        }
         if (M_PREFS->getTrackPointsVisible()) {
             for (int i=0; i<R->size(); ++i) {
                 if (pCtxt->bbox.contains(R->getNode(i)->boundingBox()))
@@ -55,7 +94,10 @@ bool indexFindCallback(Feature* F, void* ctxt)
         Relation * RR = STATIC_CAST_RELATION(F);
         if (pCtxt->theFeatures->value(RR->renderPriority()).contains(F))
             return true;
-        RR->buildPath(*(pCtxt->theProjection));
+        {
+            RenderTimer T(RenderProfiler::BuildPath);
+            RR->buildPath(*(pCtxt->theProjection));
+        }
         (*(pCtxt->theFeatures))[RR->renderPriority()].insert(F);
     } else
     if (CHECK_NODE(F)) {
@@ -63,7 +105,10 @@ bool indexFindCallback(Feature* F, void* ctxt)
             return true;
         if (!(F->isVirtual() && !M_PREFS->getVirtualNodesVisible())) {
             Node * N = STATIC_CAST_NODE(F);
-            N->buildPath(*(pCtxt->theProjection));
+            {
+                RenderTimer T(RenderProfiler::BuildPath);
+                N->buildPath(*(pCtxt->theProjection));
+            }
             (*(pCtxt->theFeatures))[NodePri].insert(F);
         }
     } else {
@@ -88,6 +133,52 @@ void MemoryBackend::indexAdd(ILayer* l, const QRectF& bb, Feature* aFeat)
     p->theRTree[l]->Insert(min, max, aFeat);
 }
 
+static inline bool sameBox(const CoordBox& A, const CoordBox& B)
+{
+    return A.left() == B.left() && A.right() == B.right() && A.top() == B.top() && A.bottom() == B.bottom();
+}
+
+/* Re-index only the chunks that changed since the last sync, so that
+ * appending to a long segment doesn't reinsert all of it. */
+void MemoryBackend::syncSegment(TrackSegment* S)
+{
+    ILayer* l = S->layer();
+    IndexedSegment& Seg = p->SegmentChunks[S];
+    QVector<CoordBox>& Indexed = Seg.Chunks;
+    bool Live = !S->isDeleted() && l;
+    int Count = Live ? S->chunkCount() : 0;
+
+    if (Seg.Layer != l) {
+        for (int k=0; k<Indexed.size(); ++k)
+            if (!Indexed[k].isNull())
+                indexRemove(Seg.Layer, Indexed[k], S);
+        Indexed.clear();
+        Seg.Layer = l;
+    }
+    if (l && !p->theRTree.contains(l))
+        p->theRTree[l] = new CoordTree();
+
+    int From = Live ? qMin(S->dirtyChunk(), Indexed.size()) : 0;
+    for (int k=From; k<qMax(Count, Indexed.size()); ++k) {
+        CoordBox New = k < Count ? S->chunkBox(k) : CoordBox();
+        if (k < Indexed.size()) {
+            if (sameBox(Indexed[k], New))
+                continue;
+            if (!Indexed[k].isNull())
+                indexRemove(l, Indexed[k], S);
+        }
+        if (!New.isNull()) {
+            qreal min[] = {New.bottomLeft().x(), New.bottomLeft().y()};
+            qreal max[] = {New.topRight().x(), New.topRight().y()};
+            p->theRTree[l]->Insert(min, max, S);
+        }
+    }
+    Indexed.resize(Count);
+    for (int k=From; k<Count; ++k)
+        Indexed[k] = S->chunkBox(k);
+    S->setChunksIndexed();
+}
+
 void MemoryBackend::indexRemove(ILayer* l, const QRectF& bb, Feature* aFeat)
 {
     if (!l)
@@ -106,7 +197,9 @@ const QList<Feature*>& MemoryBackend::indexFind(ILayer* l, const QRectF& bb)
     if (p->theRTree.contains(l)) {
         qreal min[] = {bb.bottomLeft().x(), bb.bottomLeft().y()};
         qreal max[] = {bb.topRight().x(), bb.topRight().y()};
-        p->theRTree[l]->Search(min, max, &indexFindCallbackList, (void*)&p->findResult);
+        IndexFindListContext ctxt;
+        ctxt.theFeatures = &p->findResult;
+        p->theRTree[l]->Search(min, max, &indexFindCallbackList, (void*)&ctxt);
     }
 
     return p->findResult;
@@ -132,13 +225,15 @@ void MemoryBackend::get(ILayer* l, const QRectF& bb, QList<Feature*>& theFeature
 }
 
 void MemoryBackend::getFeatureSet(ILayer* l, QMap<RenderPriority, QSet <Feature*> >& theFeatures,
-                                  const QList<CoordBox>& invalidRects, Projection& theProjection)
+                                  const QList<CoordBox>& invalidRects, Projection& theProjection,
+                                  const QAtomicInt* cancelled)
 {
     IndexFindContext ctxt;
     ctxt.theFeatures = &theFeatures;
     ctxt.theProjection = &theProjection;
+    ctxt.cancelled = cancelled;
 
-    for (int i=0; i < invalidRects.size(); ++i) {
+    for (int i=0; i < invalidRects.size() && !(cancelled && cancelled->load()); ++i) {
         ctxt.bbox = invalidRects[i];
         indexFind(l, invalidRects[i], ctxt);
     }
@@ -150,6 +245,7 @@ void MemoryBackend::getFeatureSet(ILayer* l, QMap<RenderPriority, QSet <Feature*
     IndexFindContext ctxt;
     ctxt.theFeatures = &theFeatures;
     ctxt.theProjection = &theProjection;
+    ctxt.cancelled = 0;
 
     ctxt.bbox = invalidRect;
     indexFind(l, invalidRect, ctxt);
@@ -161,6 +257,7 @@ void MemoryBackend::getFeatureSet(ILayer* l, QMap<RenderPriority, QSet <Feature*
 MemoryBackend::MemoryBackend()
 {
     p = new MemoryBackendPrivate;
+    p->ChangesDepth = 0;
 }
 
 MemoryBackend::~MemoryBackend()
@@ -172,6 +269,8 @@ MemoryBackend::~MemoryBackend()
 //        p->theRTree.GetNext(it);
 //    }
 
+    // Not worth maintaining while everything goes
+    p->TagIndex.clear();
     QHash<Feature *, CoordBox>::const_iterator i = p->AllocFeatures.constBegin();
     while (i != p->AllocFeatures.constEnd()) {
         delete i.key();
@@ -329,8 +428,19 @@ void MemoryBackend::deallocFeature(ILayer* l, Feature *f)
 {
     p->delayedDeletesLock.lockForRead();
     p->toBeDeletedLock.lock();
+    p->ChangedParents.remove(f);
+    for (int i=0; i<f->tagSize(); ++i)
+        tagIndexRemove(f, f->tagKeyId(i), f->tagValueId(i));
+    if (p->SegmentChunks.contains(f)) {
+        const IndexedSegment& Seg = p->SegmentChunks[f];
+        for (int k=0; k<Seg.Chunks.size(); ++k)
+            if (!Seg.Chunks[k].isNull())
+                indexRemove(Seg.Layer, Seg.Chunks[k], f);
+        p->SegmentChunks.remove(f);
+    }
     if (p->AllocFeatures.contains(f)) {
-        indexRemove(l, p->AllocFeatures[f], f);
+        if (!p->AllocFeatures[f].isNull())
+            indexRemove(l, p->AllocFeatures[f], f);
         if (!p->AllocFeatures.remove(f)) {
             qWarning() << "Feature, that is not in a list is being removed.";
         } else {
@@ -364,6 +474,81 @@ void MemoryBackend::resumeDeletes() {
     purge();
 }
 
+void MemoryBackend::beginChanges()
+{
+    ++p->ChangesDepth;
+}
+
+void MemoryBackend::endChanges()
+{
+    if (p->ChangesDepth > 1) {
+        --p->ChangesDepth;
+        return;
+    }
+
+    // The transaction stays open while flushing, so that parents of parents
+    // are queued too. Relations are held back until no way or segment is
+    // left, so one over many changed ways is still only updated once.
+    // Each feature is flushed once per pass, which also ends cycles of
+    // relations that are members of each other.
+    QSet<Feature*> Flushed;
+    while (!p->ChangedParents.isEmpty()) {
+        QList<Feature*> Round;
+        foreach (Feature* F, p->ChangedParents)
+            if (!CHECK_RELATION(F))
+                Round.append(F);
+        if (Round.isEmpty())
+            Round = p->ChangedParents.toList();
+        foreach (Feature* F, Round)
+            p->ChangedParents.remove(F);
+
+        foreach (Feature* F, Round) {
+            if (Flushed.contains(F))
+                continue;
+            Flushed.insert(F);
+            F->partChanged(NULL, Feature::newChangeId());
+        }
+    }
+    p->ChangesDepth = 0;
+}
+
+bool MemoryBackend::deferPartChanged(Feature* Parent)
+{
+    if (!p->ChangesDepth)
+        return false;
+    p->ChangedParents.insert(Parent);
+    return true;
+}
+
+void MemoryBackend::tagIndexAdd(Feature* F, quint32 k, quint32 v)
+{
+    QMutexLocker Lock(&p->tagIndexLock);
+    p->TagIndex[k][v].insert(F);
+}
+
+void MemoryBackend::tagIndexRemove(Feature* F, quint32 k, quint32 v)
+{
+    QMutexLocker Lock(&p->tagIndexLock);
+    QHash<quint32, QHash<quint32, QSet<Feature*> > >::iterator ik = p->TagIndex.find(k);
+    if (ik == p->TagIndex.end())
+        return;
+    QHash<quint32, QSet<Feature*> >::iterator iv = ik->find(v);
+    if (iv == ik->end())
+        return;
+    iv->remove(F);
+    if (iv->isEmpty()) {
+        ik->erase(iv);
+        if (ik->isEmpty())
+            p->TagIndex.erase(ik);
+    }
+}
+
+QHash<quint32, QSet<Feature*> > MemoryBackend::taggedFeatures(quint32 k) const
+{
+    QMutexLocker Lock(&p->tagIndexLock);
+    return p->TagIndex.value(k);
+}
+
 void MemoryBackend::deallocVirtualNode(Feature *f)
 {
     p->delayedDeletesLock.tryLockForRead();
@@ -375,6 +560,10 @@ void MemoryBackend::deallocVirtualNode(Feature *f)
 
 void MemoryBackend::sync(Feature *f)
 {
+    if (CHECK_SEGMENT(f)) {
+        syncSegment(STATIC_CAST_SEGMENT(f));
+        return;
+    }
     if (p->AllocFeatures.contains(f) && !p->AllocFeatures[f].isNull())
         indexRemove(f->layer(), p->AllocFeatures[f], f);
     if (CHECK_NODE(f)) {
@@ -3,12 +3,16 @@
 
 #include "Features.h"
 
+#include <QAtomicInt>
+
 struct IndexFindContext {
     QMap<RenderPriority, QSet <Feature*> >* theFeatures;
     QRectF* clipRect;
     Projection* theProjection;
     QTransform* theTransform;
     CoordBox bbox;
+    /// When set and non-zero, the search stops early
+    const QAtomicInt* cancelled;
 };
 
 class MemoryBackendPrivate;
@@ -21,6 +25,8 @@ public:
 private:
     MemoryBackendPrivate* p;
 
+    void syncSegment(TrackSegment* S);
+
 public:
     virtual Node* allocNode(ILayer* l, const Node& other);
     virtual Node* allocNode(ILayer* l, const QPointF& aCoord);
@@ -46,11 +52,28 @@ public:
     virtual void delayDeletes();
     virtual void resumeDeletes();
 
+    /* Between beginChanges() and endChanges(), the parents of changed
+     * features are not updated for every change of a child: each of them gets
+     * a single partChanged() (and so a single re-index) when the outermost
+     * endChanges() is reached. Parents are stale until then. */
+    virtual void beginChanges();
+    virtual void endChanges();
+    bool deferPartChanged(Feature* Parent);
+
+    /* Inverted tag index: the features having each key/value pair, by the
+     * interned key and value ids. Kept up to date by the Feature tag setters;
+     * deleted or hidden features are not filtered out. */
+    void tagIndexAdd(Feature* F, quint32 k, quint32 v);
+    void tagIndexRemove(Feature* F, quint32 k, quint32 v);
+    /// Features having key \a k, by value id
+    QHash<quint32, QSet<Feature*> > taggedFeatures(quint32 k) const;
+
     virtual const QList<Feature*>& indexFind(ILayer* l, const QRectF& vp);
     virtual void indexFind(ILayer* l, const QRectF& bb, const IndexFindContext& findResult);
     virtual void get(ILayer* l, const QRectF& bb, QList<Feature*>& theFeatures);
     virtual void getFeatureSet(ILayer* l, QMap<RenderPriority, QSet <Feature*> >& theFeatures,
-                               const QList<CoordBox>& invalidRects, Projection& theProjection);
+                               const QList<CoordBox>& invalidRects, Projection& theProjection,
+                               const QAtomicInt* cancelled = 0);
     virtual void getFeatureSet(ILayer* l, QMap<RenderPriority, QSet <Feature*> >& theFeatures,
                                const CoordBox& invalidRect, Projection& theProjection);
     virtual void indexAdd(ILayer* l, const QRectF& bb, Feature* aFeat);
@@ -152,6 +152,7 @@ void FeaturesDock::on_FeaturesList_delete()
     Main->view()->blockSignals(true);
 
     Highlighted.clear();
+    Main->properties()->beginSelectionChange();
     Main->properties()->setSelection(0);
     for (int i=0; i < ui.FeaturesList->selectedItems().count(); ++i) {
         F = ui.FeaturesList->selectedItems()[i]->data(Qt::UserRole).value<Feature*>();
@@ -159,6 +160,7 @@ void FeaturesDock::on_FeaturesList_delete()
             Main->properties()->addSelection(F);
         }
     }
+    Main->properties()->endSelectionChange();
 
     Main->view()->blockSignals(false);
 #ifndef _MOBILE
@@ -255,12 +257,14 @@ void FeaturesDock::on_addSelectAction_triggered()
     Feature* F;
     Main->view()->blockSignals(true);
 
+    Main->properties()->beginSelectionChange();
     for (int i=0; i < ui.FeaturesList->selectedItems().count(); ++i) {
         F = ui.FeaturesList->selectedItems()[i]->data(Qt::UserRole).value<Feature*>();
         if (F) {
             Main->properties()->addSelection(F);
         }
     }
+    Main->properties()->endSelectionChange();
 
     Main->view()->blockSignals(false);
 }
@@ -275,13 +279,7 @@ void FeaturesDock::on_btFind_clicked(bool)
     if (!tsel)
         return;
 
-    Found.clear();
-    int added = 0;
-    for (VisibleFeatureIterator i(Main->document()); !i.isEnd() && (!dlg->sbMaxResult->value() || added < dlg->sbMaxResult->value()); ++i) {
-        if (tsel->matches(i.get(), Main->view()->pixelPerM())) {
-            Found << i.get();
-        }
-    }
+    Found = Main->document()->findFeatures(tsel, Main->view()->pixelPerM(), dlg->sbMaxResult->value());
 
     findMode = true;
     ui.tabBar->blockSignals(true);
@@ -1,6 +1,7 @@
 #include "GeoImageDock.h"
 
 #include "Node.h"
+#include "TrackSegment.h"
 #include "Layer.h"
 #include "DocumentCommands.h"
 #include "LayerWidget.h"
@@ -443,7 +444,7 @@ void GeoImageDock::loadImage(QString file, Coord pos)
 
     //Pt->setTag("_waypoint_", "true");
     phNode->setTag("_picture_", "GeoTagged");
-    phNode->setPhoto(QPixmap(file));
+    phNode->setPhoto(QImage(file));
     addUsedTrackpoint(NodeData(phNode, file, time, i == theLayer->size()));
 }
 
@@ -535,6 +536,10 @@ void GeoImageDock::loadImages(QStringList fileNames)
     progress.show();
 
     int photoDlgRes = -1;
+    // What images are matched against by time; collected on first use
+    QList<TrackSegment*> Segments;
+    QList<TrackNode*> LooseTrackNodes;
+    bool TrackNodesCollected = false;
     foreach(file, fileNames) {
         progress.setValue(fileNames.indexOf(file));
         double lat = 0.0, lon = 0.0;
@@ -699,6 +704,8 @@ void GeoImageDock::loadImages(QStringList fileNames)
                 else
                     phNode = g_backend.allocPhotoNode(theLayer, *Pt);
                 theLayer->add(phNode);
+                if (Pt->sizeParents())
+                    LooseTrackNodes.removeOne(CAST_TRACKNODE(Pt)); // it is deallocated below
                 for (int i=0; i<Pt->sizeParents(); ++i) {
                     Feature *P = CAST_FEATURE(Pt->getParent(i));
                     int idx = P->find(Pt);
@@ -717,7 +724,7 @@ void GeoImageDock::loadImages(QStringList fileNames)
             }
                         //Pt->setTag("_waypoint_", "true");
             phNode->setTag("_picture_", "GeoTagged");
-            phNode->setPhoto(QPixmap(file));
+            phNode->setPhoto(QImage(file));
             addUsedTrackpoint(NodeData(phNode, file, time, i == theLayer->size()));
         } else if (!time.isNull() && res == 2) {
 
@@ -772,20 +779,44 @@ void GeoImageDock::loadImages(QStringList fileNames)
 
             time = time.addSecs(offset);
 
-            Feature *feature = NULL;
-            TrackNode *Pt, *bestPt = NULL;
-            int a, secondsTo = INT_MAX;
-            int u;
-
-            for (u=0; u<theLayer->size(); u++) {
-                feature = theLayer->get(u);
-                if ((Pt = dynamic_cast<TrackNode*>(feature))) {
-                    a = time.secsTo(Pt->time().toLocalTime());
-                    if (abs(a) < abs(secondsTo)) {
-                        secondsTo = a;
-                        bestPt = Pt;
+            if (!TrackNodesCollected) {
+                for (int u=0; u<theLayer->size(); u++) {
+                    Feature* feature = theLayer->get(u);
+                    if (TrackSegment* S = CAST_SEGMENT(feature)) {
+                        Segments << S;
+                    } else if (TrackNode* Pt = dynamic_cast<TrackNode*>(feature)) {
+                        bool InSegment = false;
+                        for (int i=0; i<Pt->sizeParents() && !InSegment; ++i)
+                            InSegment = CAST_SEGMENT(Pt->getParent(i));
+                        if (!InSegment)
+                            LooseTrackNodes << Pt;
                     }
                 }
+                TrackNodesCollected = true;
+            }
+
+            TrackNode *bestPt = NULL;
+            int a, secondsTo = INT_MAX;
+
+            // Segments are searched through their time index; only the
+            // trackpoints outside of any segment are checked one by one.
+            foreach (TrackSegment* S, Segments) {
+                int i = S->nearestInTime(time);
+                if (i == -1)
+                    continue;
+                TrackNode* Pt = S->getNode(i);
+                a = time.secsTo(Pt->time().toLocalTime());
+                if (abs(a) < abs(secondsTo)) {
+                    secondsTo = a;
+                    bestPt = Pt;
+                }
+            }
+            foreach (TrackNode* Pt, LooseTrackNodes) {
+                a = time.secsTo(Pt->time().toLocalTime());
+                if (abs(a) < abs(secondsTo)) {
+                    secondsTo = a;
+                    bestPt = Pt;
+                }
             }
 
             if (!bestPt)
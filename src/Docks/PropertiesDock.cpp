@@ -36,6 +36,8 @@
 
 PropertiesDock::PropertiesDock(MainWindow* aParent)
 : MDockAncestor(aParent), Main(aParent), CurrentUi(0),
+    SelectionHoles(0), FullSelectionStale(false),
+    SelectionBatch(0), SelectionChangePending(false),
     theTemplates(0), CurrentTagView(0), CurrentMembersView(0), NowShowing(NoUiShowing)
 {
     setMinimumSize(220,100);
@@ -124,6 +126,7 @@ static bool isChildOfRelation(Feature *mapFeature)
 
 void PropertiesDock::checkMenuStatus()
 {
+    syncSelection();
     bool IsPoint = false;
     bool IsRoad = false;
     bool IsRelation = false;
@@ -217,11 +220,12 @@ void PropertiesDock::checkMenuStatus()
 
 int PropertiesDock::selectionSize() const
 {
-    return Selection.size();
+    return Selection.size() - SelectionHoles;
 }
 
 Feature* PropertiesDock::selection(int idx)
 {
+    syncSelection();
     if (idx < Selection.size())
         return Selection[idx];
     return 0;
@@ -229,27 +233,101 @@ Feature* PropertiesDock::selection(int idx)
 
 QList<Feature*> PropertiesDock::selection()
 {
+    syncSelection();
     return Selection;
 }
 
-void PropertiesDock::setSelection(Feature*aFeature)
+void PropertiesDock::clearSelection()
 {
-    cleanUpUi();
     Selection.clear();
-    if (aFeature)
-        Selection.push_back(aFeature);
-    FullSelection = Selection;
+    SelectionSet.clear();
+    SelectionHoles = 0;
+    FullSelectionStale = false;
+}
+
+/// Squeezes out the holes left by toggleSelection(), keeping the order, and
+/// catches FullSelection up with the toggled and added features
+void PropertiesDock::syncSelection()
+{
+    if (SelectionHoles) {
+        int j = 0;
+        for (int i=0; i<Selection.size(); ++i) {
+            Feature* F = Selection[i];
+            if (!F)
+                continue;
+            if (i != j) {
+                Selection[j] = F;
+                SelectionSet[F] = j;
+            }
+            ++j;
+        }
+        Selection.erase(Selection.begin() + j, Selection.end());
+        SelectionHoles = 0;
+    }
+    if (FullSelectionStale) {
+        FullSelection = Selection;
+        FullSelectionStale = false;
+    }
+}
+
+/// Must be called before changing the selection: tears down the current Ui
+/// once per batch of changes
+void PropertiesDock::aboutToChangeSelection()
+{
+    if (!SelectionChangePending) {
+        cleanUpUi();
+        SelectionChangePending = true;
+    }
+}
+
+/// Rebuilds the Ui after the selection changed, unless inside a batch
+void PropertiesDock::selectionUpdated()
+{
+    if (SelectionBatch)
+        return;
+
+    syncSelection();
+    SelectionChangePending = false;
     switchUi();
     fillMultiUiSelectionBox();
     emit selectionChanged();
 }
 
+/// Group selection changes until the matching endSelectionChange(), so that
+/// the Ui is rebuilt and selectionChanged() emitted only once
+void PropertiesDock::beginSelectionChange()
+{
+    ++SelectionBatch;
+}
+
+void PropertiesDock::endSelectionChange()
+{
+    if (SelectionBatch && !--SelectionBatch && SelectionChangePending)
+        selectionUpdated();
+}
+
+void PropertiesDock::setSelection(Feature*aFeature)
+{
+    aboutToChangeSelection();
+    clearSelection();
+    if (aFeature) {
+        SelectionSet.insert(aFeature, Selection.size());
+        Selection.push_back(aFeature);
+    }
+    FullSelection = Selection;
+    selectionUpdated();
+}
+
 void PropertiesDock::setMultiSelection(const QList<Feature*>& aFeatureList)
 {
-    cleanUpUi();
-    Selection.clear();
+    aboutToChangeSelection();
+    SelectionChangePending = false;
+    clearSelection();
     for (int i=0; i<aFeatureList.size(); ++i)
-        Selection.push_back(aFeatureList[i]);
+        if (!SelectionSet.contains(aFeatureList[i])) {
+            SelectionSet.insert(aFeatureList[i], Selection.size());
+            Selection.push_back(aFeatureList[i]);
+        }
     FullSelection = Selection;
     switchToMultiUi();
     // to prevent slots to change the values also
@@ -270,32 +348,34 @@ void PropertiesDock::setMultiSelection(const QList<Feature*>& aFeatureList)
 
 void PropertiesDock::toggleSelection(Feature* S)
 {
-    cleanUpUi();
-    QList<Feature*>::iterator i = std::find(Selection.begin(),Selection.end(),S);
-    if (i == Selection.end())
+    aboutToChangeSelection();
+    if (!SelectionSet.contains(S)) {
+        SelectionSet.insert(S, Selection.size());
         Selection.push_back(S);
-    else
-        Selection.erase(i);
-    FullSelection = Selection;
-    switchUi();
-    fillMultiUiSelectionBox();
-    emit selectionChanged();
+    } else {
+        Selection[SelectionSet.take(S)] = NULL;
+        ++SelectionHoles;
+    }
+    // Not shared with FullSelection until synced, so that a batch of toggles
+    // does not copy the list each time
+    FullSelectionStale = true;
+    selectionUpdated();
 }
 
 void PropertiesDock::addSelection(Feature* S)
 {
-    cleanUpUi();
-    QList<Feature*>::iterator i = std::find(Selection.begin(),Selection.end(),S);
-    if (i == Selection.end())
+    aboutToChangeSelection();
+    if (!SelectionSet.contains(S)) {
+        SelectionSet.insert(S, Selection.size());
         Selection.push_back(S);
-    FullSelection = Selection;
-    switchUi();
-    fillMultiUiSelectionBox();
-    emit selectionChanged();
+    }
+    FullSelectionStale = true;
+    selectionUpdated();
 }
 
 void PropertiesDock::adjustSelection()
 {
+    syncSelection();
     QList<Feature*> aSelection;
     int cnt = Selection.size();
 
@@ -303,11 +383,18 @@ void PropertiesDock::adjustSelection()
         if (Main->document()->exists(FullSelection[i]) && FullSelection[i] && !FullSelection[i]->isDeleted()) {
             aSelection.push_back(FullSelection[i]);
         } else {
-            QList<Feature*>::iterator it = std::find(Selection.begin(),Selection.end(),FullSelection[i]);
-            if (it != Selection.end())
-                Selection.erase(it);
+            SelectionSet.remove(FullSelection[i]);
         }
     }
+    if (SelectionSet.size() != Selection.size()) {
+        QList<Feature*> Current;
+        foreach (Feature* F, Selection)
+            if (SelectionSet.contains(F)) {
+                SelectionSet[F] = Current.size();
+                Current.push_back(F);
+            }
+        Selection = Current;
+    }
 
     FullSelection = aSelection;
     if (Selection.size() != cnt)
@@ -317,41 +404,64 @@ void PropertiesDock::adjustSelection()
 
 bool PropertiesDock::isSelected(Feature *aFeature)
 {
-    QList<Feature*>::iterator i = std::find(Selection.begin(),Selection.end(),aFeature);
-    if (i == Selection.end())
-        return false;
-    else
-        return true;
+    return SelectionSet.contains(aFeature);
 }
 
+// Items added to the multi selection list per event loop iteration
+#define SELECTION_LIST_CHUNK 500
+
 void PropertiesDock::fillMultiUiSelectionBox()
 {
     if (NowShowing == MultiShowing)
     {
         // to prevent on_SelectionList_itemSelectionChanged to kick in
         NowShowing = NoUiShowing;
-        Main->setUpdatesEnabled(false);
         MultiUi.SelectionList->clear();
-        for (int i=0; i<FullSelection.size(); ++i)
-        {
-            QListWidgetItem* it = new QListWidgetItem(FullSelection[i]->description(),MultiUi.SelectionList);
-            it->setData(Qt::UserRole,QVariant(i));
-            it->setSelected(true);
-        }
         MultiUi.lbStatus->setText(tr("%1/%1 selected item(s)").arg(FullSelection.size()));
-        Main->setUpdatesEnabled(true);
         NowShowing = MultiShowing;
+        fillMultiUiSelectionChunk();
     }
 }
 
+/// Large selections are listed a chunk at a time so that the Ui stays
+/// responsive; items not listed yet count as selected
+void PropertiesDock::fillMultiUiSelectionChunk()
+{
+    if (NowShowing != MultiShowing)
+        return;
+
+    int From = MultiUi.SelectionList->count();
+    int To = qMin(FullSelection.size(), From+SELECTION_LIST_CHUNK);
+
+    // to prevent on_SelectionList_itemSelectionChanged to kick in
+    NowShowing = NoUiShowing;
+    Main->setUpdatesEnabled(false);
+    for (int i=From; i<To; ++i)
+    {
+        QListWidgetItem* it = new QListWidgetItem(FullSelection[i]->description(),MultiUi.SelectionList);
+        it->setData(Qt::UserRole,QVariant(i));
+        it->setSelected(true);
+    }
+    Main->setUpdatesEnabled(true);
+    NowShowing = MultiShowing;
+
+    if (To < FullSelection.size())
+        QTimer::singleShot(0,this,SLOT(fillMultiUiSelectionChunk()));
+}
+
 void PropertiesDock::on_SelectionList_itemSelectionChanged()
 {
     if (NowShowing == MultiShowing)
     {
-        Selection.clear();
-        for (int i=0; i<FullSelection.size(); ++i)
-            if (MultiUi.SelectionList->item(i)->isSelected())
+        syncSelection();
+        clearSelection();
+        for (int i=0; i<FullSelection.size(); ++i) {
+            QListWidgetItem* it = MultiUi.SelectionList->item(i);
+            if (!it || it->isSelected()) {
+                SelectionSet.insert(FullSelection[i], Selection.size());
                 Selection.push_back(FullSelection[i]);
+            }
+        }
         if (Selection.size() == 1) {
             Main->info()->setHtml(Selection[0]->toHtml());
 
@@ -7,6 +7,7 @@
 #include <ui_MultiProperties.h>
 
 #include <QList>
+#include <QHash>
 
 #include "MDockAncestor.h"
 #include "ShortcutOverrideFilter.h"
@@ -35,6 +36,8 @@ class PropertiesDock : public MDockAncestor
         void setMultiSelection(const QList<Feature*>& aFeatureList);
         void toggleSelection(Feature* aFeature);
         void addSelection(Feature* aFeature);
+        void beginSelectionChange();
+        void endSelectionChange();
         Feature* selection(int idx);
         QList<Feature*> selection();
         bool isSelected(Feature *aFeature);
@@ -72,6 +75,9 @@ class PropertiesDock : public MDockAncestor
         void on_template_changed(TagTemplate* aNewTemplate);
         void adjustSelection();
 
+    private slots:
+        void fillMultiUiSelectionChunk();
+
     signals:
         void selectionChanged();
 
@@ -84,13 +90,25 @@ class PropertiesDock : public MDockAncestor
         void switchToMultiUi();
         void switchToRelationUi();
         void fillMultiUiSelectionBox();
+        void aboutToChangeSelection();
+        void selectionUpdated();
+        void clearSelection();
+        void syncSelection();
         void changeEvent(QEvent*);
         void retranslateUi();
 
         MainWindow* Main;
         QWidget* CurrentUi;
+        // Selection keeps the order, SelectionSet answers isSelected() and
+        // holds the index of each feature in Selection. toggleSelection()
+        // leaves NULL holes, squeezed out by syncSelection().
         QList<Feature*> Selection;
+        QHash<Feature*, int> SelectionSet;
+        int SelectionHoles;
         QList<Feature*> FullSelection;
+        bool FullSelectionStale;
+        int SelectionBatch;
+        bool SelectionChangePending;
         Ui::TrackPointProperties TrackPointUi;
         Ui::RoadProperties RoadUi;
         Ui::MultiProperties MultiUi;
@@ -115,13 +133,15 @@ class PropertiesDock : public MDockAncestor
 template<class T>
         void PropertiesDock::setSelection(const QList<T*>& aFeatureList)
 {
-    cleanUpUi();
-    Selection.clear();
+    aboutToChangeSelection();
+    clearSelection();
     for (int i=0; i<aFeatureList.size(); ++i)
-        Selection.push_back(aFeatureList[i]);
+        if (!SelectionSet.contains(aFeatureList[i])) {
+            SelectionSet.insert(aFeatureList[i], Selection.size());
+            Selection.push_back(aFeatureList[i]);
+        }
     FullSelection = Selection;
-    switchUi();
-    fillMultiUiSelectionBox();
+    selectionUpdated();
 }
 
 
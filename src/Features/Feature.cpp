@@ -11,6 +11,7 @@
 #include "Document.h"
 #include "Layer.h"
 #include "MasPaintStyle.h"
+#include "RenderProfiler.h"
 #include "TagSelector.h"
 #include "MapView.h"
 #include "PropertiesDock.h"
@@ -22,6 +23,7 @@
 #include <QProgressDialog>
 #include <QPainter>
 #include <QPainterPath>
+#include <QVector>
 
 #include <algorithm>
 
@@ -94,6 +96,7 @@ public:
         , theFeature(aFeature), LastPartNotification(0)
         , Deleted(false), Visible(true), Uploaded(false), FilterRevision(-1)
         , Virtual(false), Special(false), DirtyLevel(0)
+        , FiltersUpToDate(false)
         , parentLayer(0)
     #ifndef FRISIUS_BUILD
         , Time(QDateTime::currentDateTime().toTime_t()), User(0xffffffff)
@@ -111,6 +114,7 @@ public:
         , theFeature(NULL), LastPartNotification(0)
         , Deleted(false), Visible(true), Uploaded(false), FilterRevision(-1)
         , Virtual(other.Virtual), Special(other.Special), DirtyLevel(0)
+        , FiltersUpToDate(false)
         , parentLayer(0)
     #ifndef FRISIUS_BUILD
         , Time(other.Time), User(other.User)
@@ -156,7 +160,8 @@ public:
     bool Virtual; // 1
     bool Special; // 1
     int DirtyLevel; // 4
-    QList<FilterLayer*> FilterLayers; // 4
+    QVector<quint64> FilterMatches; // 4, one bit per FilterLayer::filterSlot(), empty if none match
+    bool FiltersUpToDate; // 1
     qreal Alpha; // 8
     Layer* parentLayer; // 4
 };
@@ -176,6 +181,8 @@ Feature::Feature(const Feature& other)
     p = new FeaturePrivate(*other.p);
     p->Id = IFeature::FId(IFeature::Uninitialized, 0);
     p->theFeature = this;
+    for (int i=0; i<p->Tags.size(); ++i)
+        g_backend.tagIndexAdd(this, p->Tags[i].first, p->Tags[i].second);
 }
 
 Feature::~Feature(void)
@@ -184,12 +191,16 @@ Feature::~Feature(void)
     //      Check for side effect of supressing them.
 //    while (sizeParents())
 //        getParent(0)->remove(this);
+    // No-op for features that went through deallocFeature()
+    for (int i=0; i<p->Tags.size(); ++i)
+        g_backend.tagIndexRemove(this, p->Tags[i].first, p->Tags[i].second);
     delete p;
 }
 
 void Feature::setLayer(Layer* aLayer)
 {
     p->parentLayer = aLayer;
+    p->FiltersUpToDate = false;
 }
 
 Layer* Feature::layer() const
@@ -445,13 +456,16 @@ void Feature::setTag(int index, const QString& key, const QString& value)
             if (p->Tags[i].second == pi.second)
                 return;
             g_removeFromTagList(p->Tags[i].first, p->Tags[i].second);
+            g_backend.tagIndexRemove(this, p->Tags[i].first, p->Tags[i].second);
             p->Tags[i].second = pi.second;
             break;
         }
     if (i == p->Tags.size()) {
         p->Tags.insert(p->Tags.begin() + index, pi);
     }
+    g_backend.tagIndexAdd(this, pi.first, pi.second);
     invalidatePainter();
+    p->FiltersUpToDate = false;
     invalidateMeta();
 }
 
@@ -469,12 +483,15 @@ void Feature::setTag(const QString& key, const QString& value)
             if (p->Tags[i].second == pi.second)
                 return;
             g_removeFromTagList(p->Tags[i].first, p->Tags[i].second);
+            g_backend.tagIndexRemove(this, p->Tags[i].first, p->Tags[i].second);
             p->Tags[i].second = pi.second;
             break;
         }
     if (i == p->Tags.size()) {
         p->Tags.push_back(pi);
     }
+    g_backend.tagIndexAdd(this, pi.first, pi.second);
+    p->FiltersUpToDate = false;
     invalidateMeta();
     invalidatePainter();
 }
@@ -483,8 +500,10 @@ void Feature::clearTags()
 {
     while (p->Tags.size()) {
         g_removeFromTagList(p->Tags[0].first, p->Tags[0].second);
+        g_backend.tagIndexRemove(this, p->Tags[0].first, p->Tags[0].second);
         p->Tags.erase(p->Tags.begin());
     }
+    p->FiltersUpToDate = false;
     invalidateMeta();
     invalidatePainter();
 }
@@ -497,9 +516,11 @@ void Feature::clearTag(const QString& k)
         if (p->Tags[i].first == ik)
         {
             g_removeFromTagList(p->Tags[i].first, p->Tags[i].second);
+            g_backend.tagIndexRemove(this, p->Tags[i].first, p->Tags[i].second);
             p->Tags.erase(p->Tags.begin()+i);
             break;
         }
+    p->FiltersUpToDate = false;
     invalidateMeta();
     invalidatePainter();
 }
@@ -507,7 +528,9 @@ void Feature::clearTag(const QString& k)
 void Feature::removeTag(int idx)
 {
     g_removeFromTagList(p->Tags[idx].first, p->Tags[idx].second);
+    g_backend.tagIndexRemove(this, p->Tags[idx].first, p->Tags[idx].second);
     p->Tags.erase(p->Tags.begin()+idx);
+    p->FiltersUpToDate = false;
     invalidateMeta();
     invalidatePainter();
 }
@@ -527,6 +550,16 @@ QString Feature::tagKey(int i) const
     return g_getTagKey(p->Tags[i].first);
 }
 
+quint32 Feature::tagKeyId(int i) const
+{
+    return p->Tags[i].first;
+}
+
+quint32 Feature::tagValueId(int i) const
+{
+    return p->Tags[i].second;
+}
+
 int Feature::findKey(const QString &k) const
 {
     for (int i=0; i<p->Tags.size(); ++i)
@@ -621,8 +654,10 @@ void FeaturePrivate::blankPainters()
 
 const FeaturePainter* Feature::getPainter(qreal PixelPerM) const
 {
-    if (p->PixelPerMForPainter != PixelPerM)
+    if (p->PixelPerMForPainter != PixelPerM) {
+        RenderTimer T(RenderProfiler::Painters);
         p->updatePainters(PixelPerM);
+    }
     return p->CurrentPainter;
 }
 
@@ -656,8 +691,10 @@ bool Feature::hasPainter(qreal PixelPerM) const
 
 void Feature::setParentFeature(Feature* F)
 {
-    if (std::find(p->Parents.begin(),p->Parents.end(),F) == p->Parents.end())
+    if (std::find(p->Parents.begin(),p->Parents.end(),F) == p->Parents.end()) {
         p->Parents.push_back(F);
+        p->FiltersUpToDate = false;
+    }
 }
 
 void Feature::unsetParentFeature(Feature* F)
@@ -666,13 +703,19 @@ void Feature::unsetParentFeature(Feature* F)
         if (p->Parents[i] == F)
         {
             p->Parents.erase(p->Parents.begin()+i);
+            p->FiltersUpToDate = false;
             return;
         }
 }
 
+/* Filter matches are kept per feature, one bit per filter slot. A changed
+ * filter is evaluated over the whole document by FilterLayer::evaluate();
+ * a feature whose tags, layer or parents changed re-evaluates all of them
+ * here, on its next updateMeta(). */
 void Feature::updateFilters()
 {
-    p->FilterLayers.clear();
+    p->FilterMatches.clear();
+    p->FiltersUpToDate = true;
 
     Layer* L = layer();
     if (!L)
@@ -684,29 +727,63 @@ void Feature::updateFilters()
 
     for (int i=0; i<D->layerSize(); ++i) {
         if (D->getLayer(i)->classType() == Layer::FilterLayerType) {
-            FilterLayer* Fl = dynamic_cast<FilterLayer*>(D->getLayer(i));
-            if (!Fl->isEnabled() || !Fl->selector())
-                continue;
-            if (Fl->selector()->matches(this, 0) != TagSelect_NoMatch)
-                p->FilterLayers << Fl;
+            FilterLayer* Fl = static_cast<FilterLayer*>(D->getLayer(i));
+            if (Fl->selector() && Fl->selector()->matches(this, 0) != TagSelect_NoMatch)
+                setFilterMatch(Fl->filterSlot(), true);
         }
     }
     invalidateMeta();
 }
 
+void Feature::setFilterMatch(int Slot, bool Match)
+{
+    if (Match == matchesFilter(Slot))
+        return;
+    int Word = Slot / 64;
+    if (Word >= p->FilterMatches.size())
+        p->FilterMatches.resize(Word + 1);
+    if (Match)
+        p->FilterMatches[Word] |= Q_UINT64_C(1) << (Slot % 64);
+    else
+        p->FilterMatches[Word] &= ~(Q_UINT64_C(1) << (Slot % 64));
+    invalidateMeta();
+}
+
+bool Feature::matchesFilter(int Slot) const
+{
+    int Word = Slot / 64;
+    if (Word >= p->FilterMatches.size())
+        return false;
+    return p->FilterMatches[Word] & (Q_UINT64_C(1) << (Slot % 64));
+}
+
 void Feature::updateMeta()
 {
-    updateFilters();
+    if (!p->FiltersUpToDate)
+        updateFilters();
 
     Layer* L = layer();
     if (!L)
         return;
 
+    // The enabled filters this feature matches, in layer order
+    QList<FilterLayer*> FilterLayers;
+    if (!p->FilterMatches.isEmpty() && L->getDocument()) {
+        Document* D = L->getDocument();
+        for (int i=0; i<D->layerSize(); ++i) {
+            if (D->getLayer(i)->classType() == Layer::FilterLayerType) {
+                FilterLayer* Fl = static_cast<FilterLayer*>(D->getLayer(i));
+                if (Fl->isEnabled() && matchesFilter(Fl->filterSlot()))
+                    FilterLayers << Fl;
+            }
+        }
+    }
+
     if (!L->isVisible())
         p->Visible = false;
     else {
         p->Visible = true;
-        foreach(FilterLayer* Fl, p->FilterLayers) {
+        foreach(FilterLayer* Fl, FilterLayers) {
             if (!Fl->isVisible()) {
                 p->Visible = false;
                 break;
@@ -718,7 +795,7 @@ void Feature::updateMeta()
         p->Alpha = L->getAlpha();
     else {
         p->Alpha = 1.0;
-        foreach(FilterLayer* Fl, p->FilterLayers) {
+        foreach(FilterLayer* Fl, FilterLayers) {
             if (Fl->getAlpha() != 1) {
                 p->Alpha = Fl->getAlpha();
                 break;
@@ -730,7 +807,7 @@ void Feature::updateMeta()
         ReadOnly = true;
     else {
         ReadOnly = false;
-        foreach(FilterLayer* Fl, p->FilterLayers) {
+        foreach(FilterLayer* Fl, FilterLayers) {
             if (Fl->isReadonly()) {
                 ReadOnly = true;
                 break;
@@ -755,10 +832,15 @@ const IFeature* Feature::getParent(int i) const
     return p->Parents[i];
 }
 
-void Feature::notifyChanges()
+int Feature::newChangeId()
 {
     static int Id = 0;
-    notifyParents(++Id);
+    return ++Id;
+}
+
+void Feature::notifyChanges()
+{
+    notifyParents(newChangeId());
 }
 
 void Feature::notifyParents(int Id)
@@ -766,8 +848,10 @@ void Feature::notifyParents(int Id)
     if (Id != p->LastPartNotification)
     {
         p->LastPartNotification = Id;
+        // Within a change transaction, parents are told once it ends
         for (int i=0; i<p->Parents.size(); ++i)
-            p->Parents[i]->partChanged(this, Id);
+            if (!g_backend.deferPartChanged(p->Parents[i]))
+                p->Parents[i]->partChanged(this, Id);
     }
 }
 
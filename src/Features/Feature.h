@@ -9,6 +9,7 @@ class Feature;
 #include "FeaturePainter.h"
 
 #include <QList>
+#include <QSet>
 #include <QPainter>
 #include <QPainterPath>
 #include <QString>
@@ -122,7 +123,7 @@ public:
     virtual void drawHighlight(QPainter& P, MapView* theView);
     virtual void drawFocus(QPainter& P, MapView* theView);
 
-    virtual qreal pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QList<Feature*>& NoSnap, MapView* theView) const = 0;
+    virtual qreal pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QSet<Feature*>& NoSnap, MapView* theView) const = 0;
     virtual void cascadedRemoveIfUsing(Document* theDocument, Feature* aFeature, CommandList* theList, const QList<Feature*>& Alternatives) = 0;
     virtual bool notEverythingDownloaded() = 0;
 
@@ -213,6 +214,13 @@ public:
         */
     virtual QString tagKey(int i) const;
 
+    /** return the interned ids of the key and value of the tag at the
+         * position "i", as used by g_getTagKey() and g_getTagValue().
+         * Be carefull: no verification is made on i.
+         */
+    quint32 tagKeyId(int i) const;
+    quint32 tagValueId(int i) const;
+
     /** remove the tag at the position "i".
          * position start at 0.
          * Be carefull: no verification is made on i.
@@ -310,6 +318,7 @@ public:
     virtual void partChanged(Feature* F, int ChangeId) = 0;
     void notifyChanges();
     void notifyParents(int Id);
+    static int newChangeId();
 
     static void fromXML(QXmlStreamReader& stream, Feature* F);
     virtual void toXML(QXmlStreamWriter& stream, bool strict, QString changetsetid = QString());
@@ -324,6 +333,8 @@ public:
     virtual char getType() const = 0;
     virtual void updateMeta();
     virtual void updateFilters();
+    void setFilterMatch(int Slot, bool Match);
+    bool matchesFilter(int Slot) const;
     virtual void invalidateMeta();
 
     virtual bool deleteChildren(Document* , CommandList* ) { return true; }
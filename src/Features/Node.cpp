@@ -246,7 +246,7 @@ void Node::drawChildrenSpecial(QPainter& thePainter, QPen& Pen, MapView* theView
 }
 
 
-qreal Node::pixelDistance(const QPointF& Target, qreal, const QList<Feature*>& /* NoSnap */, MapView* theView) const
+qreal Node::pixelDistance(const QPointF& Target, qreal, const QSet<Feature*>& /* NoSnap */, MapView* theView) const
 {
     qreal Best = 1000000;
 
@@ -679,18 +679,18 @@ PhotoNode::~PhotoNode(void)
     delete Photo;
 }
 
-QPixmap PhotoNode::photo() const
+QImage PhotoNode::photo() const
 {
     if (Photo)
         return *(Photo);
     else
-        return QPixmap();
+        return QImage();
 }
 
-void PhotoNode::setPhoto(QPixmap thePhoto)
+void PhotoNode::setPhoto(const QImage& thePhoto)
 {
     delete Photo;
-    Photo = new QPixmap(thePhoto.scaled(M_PREFS->getMaxGeoPicWidth(), M_PREFS->getMaxGeoPicWidth(), Qt::KeepAspectRatio));
+    Photo = new QImage(thePhoto.scaled(M_PREFS->getMaxGeoPicWidth(), M_PREFS->getMaxGeoPicWidth(), Qt::KeepAspectRatio));
 }
 
 void PhotoNode::drawTouchup(QPainter& thePainter , MapView* theView)
@@ -711,7 +711,7 @@ void PhotoNode::drawTouchup(QPainter& thePainter , MapView* theView)
             qreal phRt = 1. * Photo->width() / Photo->height();
             phPt = me - QPoint(10*rt, 10*rt) - QPoint(M_PREFS->getMaxGeoPicWidth()*rt, M_PREFS->getMaxGeoPicWidth()*rt/phRt);
         }
-        thePainter.drawPixmap(phPt, Photo->scaledToWidth(M_PREFS->getMaxGeoPicWidth()*rt));
+        thePainter.drawImage(phPt, Photo->scaledToWidth(M_PREFS->getMaxGeoPicWidth()*rt));
     }
 #endif
     Node::drawTouchup(thePainter, theView);
@@ -741,7 +741,7 @@ void PhotoNode::drawHover(QPainter& thePainter, MapView* theView)
 }
 #endif
 
-qreal PhotoNode::pixelDistance(const QPointF& Target, qreal ClearDistance, const QList<Feature*>& NoSnap, MapView* theView) const
+qreal PhotoNode::pixelDistance(const QPointF& Target, qreal ClearDistance, const QSet<Feature*>& NoSnap, MapView* theView) const
 {
 #ifdef GEOIMAGE
     QPoint me = theView->toView(const_cast<PhotoNode*>(this));
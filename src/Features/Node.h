@@ -45,7 +45,7 @@ public:
     virtual void drawParentsSpecial(QPainter& P, QPen& Pen, MapView* theView);
     virtual void drawChildrenSpecial(QPainter& P, QPen& Pen, MapView* theView, int depth);
 
-    virtual qreal pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QList<Feature*>& NoSnap, MapView* theView) const;
+    virtual qreal pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QSet<Feature*>& NoSnap, MapView* theView) const;
     virtual void cascadedRemoveIfUsing(Document* theDocument, Feature* aFeature, CommandList* theList, const QList<Feature*>& Alternatives);
     virtual bool notEverythingDownloaded();
     virtual QString description() const;
@@ -134,13 +134,14 @@ public:
 #ifdef GEOIMAGE
     virtual void drawHover(QPainter& P, MapView* theView);
 #endif
-    virtual qreal pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QList<Feature*>& NoSnap, MapView* theView) const;
+    virtual qreal pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QSet<Feature*>& NoSnap, MapView* theView) const;
 
-    QPixmap photo() const;
-    void setPhoto(QPixmap thePhoto);
+    QImage photo() const;
+    void setPhoto(const QImage& thePhoto);
 
 protected:
-    QPixmap* Photo;
+    // Not a QPixmap: photos are drawn on the wireframe worker
+    QImage* Photo;
     mutable bool photoLocationBR;
 };
 
@@ -6,6 +6,7 @@
 #include "RelationCommands.h"
 #include "Document.h"
 #include "LineF.h"
+#include "Painting.h"
 #include "Global.h"
 
 #include <QApplication>
@@ -15,6 +16,7 @@
 
 #include <algorithm>
 #include <utility>
+#include <QHash>
 #include <QList>
 
 #define TEST_RFLAGS(x) theView->renderOptions().options.testFlag(x)
@@ -41,6 +43,9 @@ class RelationPrivate
             : theRelation(R), theModel(0), ModelReferences(0)
             , PathUpToDate(false)
             , ProjectionRevision(0)
+            , MembersRevision(0)
+            , RingsRevision(-1)
+            , RingsProjectionRevision(0)
             , BBoxUpToDate(false)
             , Width(0)
         {
@@ -56,10 +61,19 @@ class RelationPrivate
         RelationMemberModel* theModel;
         int ModelReferences;
         QPainterPath thePath;
+        GeneralizedPaths Generalized;
         QPainterPath theBoundingPath;
         bool PathUpToDate;
         int ProjectionRevision;
 
+        // Rings chained from the member ways, with their role. They only
+        // depend on the members' geometry and roles, so they survive tag and
+        // style changes on the relation itself.
+        QList< QPair<QString, QPainterPath> > Rings;
+        int MembersRevision;
+        int RingsRevision;
+        int RingsProjectionRevision;
+
         bool BBoxUpToDate;
 
         RenderPriority theRenderPriority;
@@ -140,6 +154,7 @@ void Relation::partChanged(Feature*, int ChangeId)
     if (isDeleted())
         return;
 
+    ++p->MembersRevision;
     p->PathUpToDate = false;
     p->BBoxUpToDate = false;
     MetaUpToDate = false;
@@ -245,7 +260,7 @@ void Relation::drawChildrenSpecial(QPainter& thePainter, QPen& Pen, MapView* the
 }
 
 
-qreal Relation::pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QList<Feature*>& NoSnap, MapView* theView) const
+qreal Relation::pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QSet<Feature*>& NoSnap, MapView* theView) const
 {
     Q_UNUSED(NoSnap)
 
@@ -325,6 +340,7 @@ void Relation::add(const QString& Role, Feature* F)
 {
     p->Members.push_back(qMakePair(Role,F));
     F->setParentFeature(this);
+    ++p->MembersRevision;
     p->PathUpToDate = false;
     p->BBoxUpToDate = false;
     MetaUpToDate = false;
@@ -338,6 +354,7 @@ void Relation::add(const QString& Role, Feature* F, int Idx)
     p->Members.push_back(qMakePair(Role,F));
     std::rotate(p->Members.begin()+Idx,p->Members.end()-1,p->Members.end());
     F->setParentFeature(this);
+    ++p->MembersRevision;
     p->PathUpToDate = false;
     p->BBoxUpToDate = false;
     MetaUpToDate = false;
@@ -353,6 +370,7 @@ void Relation::remove(int Idx)
     p->Members.erase(p->Members.begin()+Idx);
     if (F && find(F) == p->Members.size())
         F->unsetParentFeature(this);
+    ++p->MembersRevision;
     p->PathUpToDate = false;
     p->BBoxUpToDate = false;
     MetaUpToDate = false;
@@ -419,6 +437,82 @@ void Relation::releaseMemberModel()
     }
 }
 
+typedef QPair<qreal, qreal> RingPointKey;
+
+static inline RingPointKey ringPointKey(const QPointF& P)
+{
+    return RingPointKey(P.x(), P.y());
+}
+
+// Appends to \a Ring the unused paths of the same role that continue from its
+// last point, until the ring closes or nothing connects
+static void extendRing(QPolygonF& Ring, const QString& Role, const QList< QPair<QString,QPainterPath> >& memberPaths,
+                       const QMultiHash<RingPointKey, int>& Ends, QVector<bool>& Used)
+{
+    while (!(Ring.size() > 2 && Ring.first() == Ring.last())) {
+        const RingPointKey Key = ringPointKey(Ring.last());
+        int Next = -1;
+        QMultiHash<RingPointKey, int>::const_iterator it = Ends.constFind(Key);
+        for (; it != Ends.constEnd() && it.key() == Key; ++it) {
+            if (!Used[it.value()] && memberPaths[it.value()].first == Role) {
+                Next = it.value();
+                break;
+            }
+        }
+        if (Next == -1)
+            return;
+
+        Used[Next] = true;
+        const QPainterPath& Path = memberPaths[Next].second;
+        const int n = Path.elementCount();
+        if (QPointF(Path.elementAt(0)) == Ring.last()) {
+            for (int l=1; l<n; ++l)
+                Ring << QPointF(Path.elementAt(l));
+        } else {
+            for (int l=n-2; l>=0; --l)
+                Ring << QPointF(Path.elementAt(l));
+        }
+    }
+}
+
+// Chains member paths of the same role that share an endpoint into rings.
+// Endpoints are hashed, so this is linear in the number of members.
+static void assembleRings(const QList< QPair<QString,QPainterPath> >& memberPaths, QList< QPair<QString,QPainterPath> >& Rings)
+{
+    QMultiHash<RingPointKey, int> Ends;
+    Ends.reserve(memberPaths.size()*2);
+    for (int i=0; i<memberPaths.size(); ++i) {
+        const QPainterPath& Path = memberPaths[i].second;
+        Ends.insert(ringPointKey(Path.elementAt(0)), i);
+        Ends.insert(ringPointKey(Path.elementAt(Path.elementCount()-1)), i);
+    }
+    QVector<bool> Used(memberPaths.size(), false);
+
+    for (int i=0; i<memberPaths.size(); ++i) {
+        if (Used[i])
+            continue;
+        Used[i] = true;
+
+        const QString& Role = memberPaths[i].first;
+        const QPainterPath& Path = memberPaths[i].second;
+        QPolygonF Ring;
+        Ring.reserve(Path.elementCount());
+        for (int j=0; j<Path.elementCount(); ++j)
+            Ring << QPointF(Path.elementAt(j));
+
+        // Grow from the end, then from the start
+        extendRing(Ring, Role, memberPaths, Ends, Used);
+        if (!(Ring.size() > 2 && Ring.first() == Ring.last())) {
+            std::reverse(Ring.begin(), Ring.end());
+            extendRing(Ring, Role, memberPaths, Ends, Used);
+        }
+
+        QPainterPath RingPath;
+        RingPath.addPolygon(Ring);
+        Rings << qMakePair(Role, RingPath);
+    }
+}
+
 void Relation::buildPath(Projection const &theProjection)
 {
 //    QPainterPath clipPath;
@@ -445,6 +539,7 @@ void Relation::buildPath(Projection const &theProjection)
 
     if (!p->PathUpToDate || p->ProjectionRevision != theProjection.projectionRevision()) {
         p->thePath = QPainterPath();
+        p->Generalized.clear();
 
         Way* outerWay = NULL;
         int numOuter = 0;
@@ -454,13 +549,16 @@ void Relation::buildPath(Projection const &theProjection)
 
 
         // Handle polygons made of scattered ways
+        bool RingsUpToDate = (p->RingsRevision == p->MembersRevision
+                              && p->RingsProjectionRevision == theProjection.projectionRevision());
         QList< QPair<QString,QPainterPath> > memberPaths;
         for (int i=0; i<size(); ++i) {
             if (CHECK_WAY(p->Members[i].second)) {
                 Way* M = STATIC_CAST_WAY(p->Members[i].second);
                 M->buildPath(theProjection);
                 if (M->getPath().elementCount() > 1) {
-                    memberPaths << qMakePair(p->Members[i].first, M->getPath());
+                    if (!RingsUpToDate)
+                        memberPaths << qMakePair(p->Members[i].first, M->getPath());
                     if (isMultipolygon && (p->Members[i].first == "outer" || p->Members[i].first.isEmpty())) {
                         if (!numOuter)
                             outerWay = M;
@@ -472,58 +570,32 @@ void Relation::buildPath(Projection const &theProjection)
             }
         }
 
-        QList<QPainterPath> innerPaths;
-        QList<QPainterPath> outerPaths;
-
-        while (memberPaths.size()) {
-            // handle the start...
-            QPointF curPoint;
-            QPainterPath curPath;
-            QString curRole;
-
-            curRole = memberPaths[0].first;
-            curPath.moveTo(memberPaths[0].second.elementAt(0));
-            for (int j=1; j<memberPaths[0].second.elementCount(); ++j) {
-                curPoint = memberPaths[0].second.elementAt(j);
-                curPath.lineTo(curPoint);
-            }
-            // ... and remove it
-            memberPaths.removeAt(0);
-            // Check if any remaining path starts or ends at the current point
-            for (int k=0; k<memberPaths.size(); ++k) {
-                if (memberPaths[k].second.elementAt(0) == curPoint && memberPaths[k].first == curRole) { // Check start
-                    for (int l=1; l<memberPaths[k].second.elementCount(); ++l) {
-                        curPoint = memberPaths[k].second.elementAt(l);
-                        curPath.lineTo(curPoint);
-                    }
-                    memberPaths.removeAt(k);
-                    k=0;
-                } else if (memberPaths[k].second.elementAt(memberPaths[k].second.elementCount()-1) == curPoint  && memberPaths[k].first == curRole) { // Check end
-                    for (int l=memberPaths[k].second.elementCount()-2; l>=0; --l) {
-                        curPoint = memberPaths[k].second.elementAt(l);
-                        curPath.lineTo(curPoint);
-                    }
-                    memberPaths.removeAt(k);
-                    k=0;
-                }
-            }
-            if (curRole == "inner" and isMultipolygon)
-                innerPaths << curPath;
-            else
-                outerPaths << curPath;
+        if (!RingsUpToDate) {
+            p->Rings.clear();
+            assembleRings(memberPaths, p->Rings);
+            p->RingsRevision = p->MembersRevision;
+            p->RingsProjectionRevision = theProjection.projectionRevision();
         }
 
+        // Holes come from the odd-even fill rule rather than from subtracting
+        // each inner ring, which is a full polygon boolean operation
         if (outerWay && tagSize() == 1) {
             outerWay->rebuildPath(theProjection);
-            for (int i=0; i<innerPaths.size(); ++i) {
-                outerWay->addPathHole(innerPaths[i]);
+            for (int i=0; i<p->Rings.size(); ++i) {
+                if (p->Rings[i].first == "inner")
+                    outerWay->addPathHole(p->Rings[i].second);
             }
         } else {
-            for (int i=0; i<outerPaths.size(); ++i) {
-                p->thePath.addPath(outerPaths[i]);
+            p->thePath.setFillRule(Qt::OddEvenFill);
+            for (int i=0; i<p->Rings.size(); ++i) {
+                if (!isMultipolygon || p->Rings[i].first != "inner")
+                    p->thePath.addPath(p->Rings[i].second);
             }
-            for (int i=0; i<innerPaths.size(); ++i) {
-                p->thePath = p->thePath.subtracted(innerPaths[i]);
+            if (isMultipolygon) {
+                for (int i=0; i<p->Rings.size(); ++i) {
+                    if (p->Rings[i].first == "inner")
+                        p->thePath.addPath(p->Rings[i].second);
+                }
             }
         }
 
@@ -537,6 +609,12 @@ const QPainterPath& Relation::getPath() const
     return p->thePath;
 }
 
+/// Path generalized for \a theTransform; to be called with the lock held
+const QPainterPath& Relation::getPath(const QTransform& theTransform)
+{
+    return p->Generalized.get(p->thePath, theTransform);
+}
+
 const RenderPriority& Relation::renderPriority()
 {
     if (!MetaUpToDate)
@@ -8,6 +8,7 @@ class MainWindow;
 class RelationPrivate;
 class QAbstractTableModel;
 class QProgressDialog;
+class QTransform;
 
 class Relation : public Feature
 {
@@ -30,7 +31,7 @@ public:
     virtual void drawParentsSpecial(QPainter& P, QPen& Pen, MapView* theView);
     virtual void drawChildrenSpecial(QPainter& P, QPen& Pen, MapView* theView, int depth);
 
-    virtual qreal pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QList<Feature*>& NoSnap, MapView* theView) const;
+    virtual qreal pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QSet<Feature*>& NoSnap, MapView* theView) const;
     virtual void cascadedRemoveIfUsing(Document* theDocument, Feature* aFeature, CommandList* theList, const QList<Feature*>& Alternatives);
     virtual bool notEverythingDownloaded();
     virtual const RenderPriority& renderPriority();
@@ -54,6 +55,7 @@ public:
     virtual void partChanged(Feature* F, int ChangeId);
 
     const QPainterPath& getPath() const;
+    const QPainterPath& getPath(const QTransform& theTransform);
     void buildPath(Projection const &theProjection);
 
     virtual bool toXML(QXmlStreamWriter& stream, QProgressDialog * progress, bool strict=false, QString changetsetid = QString());
@@ -12,23 +12,230 @@
 #include <QProgressDialog>
 
 #include <algorithm>
+#include <cmath>
+#include <climits>
+#include <QHash>
 #include <QList>
+#include <QPair>
+#include <QVector>
 
 #define TEST_RFLAGS(x) theView->renderOptions().options.testFlag(x)
 
+/* Long segments are indexed as chunks of TRACK_CHUNK_SIZE legs. Chunk k holds
+ * nodes k*TRACK_CHUNK_SIZE up to and including (k+1)*TRACK_CHUNK_SIZE, so
+ * that every leg belongs to exactly one chunk. */
+#define TRACK_CHUNK_SIZE 256
+
+/* Below this many nodes, segments are drawn without decimation */
+#define TRACK_DECIMATE_MIN 512
+#define NO_DECIMATION INT_MIN
+
+/* Points kept at one decimation level: each is at least 2^level projected
+ * units (about a pixel) from the previous one. Extended as nodes are added. */
+struct TrackDecimation
+{
+    TrackDecimation() : Scanned(0) {}
+
+    QVector<int> Kept;
+    int Scanned;
+};
+
 class TrackSegmentPrivate
 {
     public:
         TrackSegmentPrivate()
-        : Distance(0)
+        : Distance(0), BBoxUpToDate(true), ChunksUpToDate(true), DirtyChunk(0)
+        , LevelsRevision(-1), TimesUpToDate(true)
         {
         }
 
         QList<TrackNode*> Nodes;
         qreal Distance;
         CoordBox BBox;
+        bool BBoxUpToDate;
+
+        QVector<CoordBox> Chunks;
+        bool ChunksUpToDate;
+        int DirtyChunk;
+
+        /* Style bucket of the leg ending at each node; see legStyle() */
+        QVector<quint16> Styles;
+        QHash<int, TrackDecimation> Levels;
+        int LevelsRevision;
+
+        /* Indices of the timed nodes in time order, and their times in ms */
+        QVector<int> TimeOrder;
+        QVector<qint64> TimeKeys;
+        bool TimesUpToDate;
+
+        /* Index of each node; only built once a node is moved */
+        QHash<const Feature*, int> NodeIndex;
+
+        void appended();
+        void moved(int i);
+        void invalidate();
+        int indexOf(const Feature* F);
+        void updateChunk(int k);
+        void updateChunks();
+        void updateTimes();
+        int lowerTime(qint64 T) const;
+
+        quint16 legStyle(int i) const;
+        void updateStyles();
+        const QVector<int>& decimated(qreal PixelSize, const Projection& theProjection);
 };
 
+/* Nodes without a timestamp (stored as 0) are left out of the time index */
+static inline bool timeKey(const TrackNode* N, qint64& Key)
+{
+    const QDateTime T(N->time());
+    if (!T.isValid() || !T.toTime_t())
+        return false;
+    Key = T.toMSecsSinceEpoch();
+    return true;
+}
+
+/* Grow the boxes for the node just appended, instead of rescanning */
+void TrackSegmentPrivate::appended()
+{
+    int i = Nodes.size() - 1;
+    const Coord& C = Nodes[i]->position();
+
+    if (BBoxUpToDate) {
+        if (i == 0)
+            BBox = CoordBox(C, C);
+        else
+            BBox.merge(C);
+    }
+
+    // Tracks are recorded in time order, so the index usually just grows
+    if (TimesUpToDate) {
+        qint64 T;
+        if (timeKey(Nodes[i], T)) {
+            if (TimeKeys.isEmpty() || T >= TimeKeys.last()) {
+                TimeOrder.append(i);
+                TimeKeys.append(T);
+            } else
+                TimesUpToDate = false;
+        }
+    }
+
+    if (!NodeIndex.isEmpty())
+        NodeIndex.insert(Nodes[i], i);
+
+    if (!ChunksUpToDate)
+        return;
+    if (i == 0) {
+        Chunks.append(CoordBox(C, C));
+        DirtyChunk = 0;
+        return;
+    }
+    int k = (i-1) / TRACK_CHUNK_SIZE;
+    if (k == Chunks.size())
+        Chunks.append(CoordBox(Nodes[i-1]->position(), Nodes[i-1]->position()));
+    Chunks[k].merge(C);
+    DirtyChunk = qMin(DirtyChunk, k);
+}
+
+/* Node i was moved: only its chunks, its two legs and what was decimated
+ * after it change. Node moves keep their time, so the time index stays. */
+void TrackSegmentPrivate::moved(int i)
+{
+    if (ChunksUpToDate && !Chunks.isEmpty()) {
+        int From = i ? (i-1) / TRACK_CHUNK_SIZE : 0;
+        int To = qMin(i / TRACK_CHUNK_SIZE, Chunks.size() - 1);
+        for (int k=From; k<=To; ++k)
+            updateChunk(k);
+        DirtyChunk = qMin(DirtyChunk, From);
+
+        if (BBoxUpToDate) {
+            BBox = Chunks[0];
+            for (int k=1; k<Chunks.size(); ++k)
+                BBox.merge(Chunks[k]);
+        }
+    } else
+        BBoxUpToDate = false;
+
+    if (i < Styles.size())
+        Styles[i] = legStyle(i);
+    if (i+1 < Styles.size())
+        Styles[i+1] = legStyle(i+1);
+
+    // The nodes kept before i do not depend on it
+    QHash<int, TrackDecimation>::iterator it;
+    for (it = Levels.begin(); it != Levels.end(); ++it) {
+        TrackDecimation& D = it.value();
+        int j = std::lower_bound(D.Kept.constBegin(), D.Kept.constEnd(), i) - D.Kept.constBegin();
+        D.Kept.resize(j);
+        D.Scanned = j ? qMin(D.Scanned, i) : 0;
+    }
+}
+
+void TrackSegmentPrivate::invalidate()
+{
+    BBoxUpToDate = false;
+    ChunksUpToDate = false;
+    DirtyChunk = 0;
+    Styles.clear();
+    Levels.clear();
+    TimesUpToDate = false;
+    NodeIndex.clear();
+}
+
+int TrackSegmentPrivate::indexOf(const Feature* F)
+{
+    if (NodeIndex.isEmpty())
+        for (int i=0; i<Nodes.size(); ++i)
+            NodeIndex.insert(Nodes[i], i);
+    return NodeIndex.value(F, -1);
+}
+
+void TrackSegmentPrivate::updateChunk(int k)
+{
+    int First = k * TRACK_CHUNK_SIZE;
+    int Last = qMin(First + TRACK_CHUNK_SIZE, Nodes.size() - 1);
+    Chunks[k] = CoordBox(Nodes[First]->position(), Nodes[First]->position());
+    for (int i=First+1; i<=Last; ++i)
+        Chunks[k].merge(Nodes[i]->position());
+}
+
+void TrackSegmentPrivate::updateChunks()
+{
+    int Legs = qMax(Nodes.size() - 1, 1);
+    int Count = Nodes.isEmpty() ? 0 : (Legs + TRACK_CHUNK_SIZE - 1) / TRACK_CHUNK_SIZE;
+    Chunks.resize(Count);
+    for (int k=0; k<Count; ++k)
+        updateChunk(k);
+    ChunksUpToDate = true;
+    DirtyChunk = 0;
+}
+
+void TrackSegmentPrivate::updateTimes()
+{
+    QVector< QPair<qint64, int> > Keyed;
+    Keyed.reserve(Nodes.size());
+    qint64 T;
+    for (int i=0; i<Nodes.size(); ++i)
+        if (timeKey(Nodes[i], T))
+            Keyed.append(qMakePair(T, i));
+    // Ties keep the node order, as the index is part of the pair
+    std::sort(Keyed.begin(), Keyed.end());
+
+    TimeOrder.resize(Keyed.size());
+    TimeKeys.resize(Keyed.size());
+    for (int i=0; i<Keyed.size(); ++i) {
+        TimeKeys[i] = Keyed[i].first;
+        TimeOrder[i] = Keyed[i].second;
+    }
+    TimesUpToDate = true;
+}
+
+/* Position in the time index of the first node not earlier than T */
+int TrackSegmentPrivate::lowerTime(qint64 T) const
+{
+    return std::lower_bound(TimeKeys.constBegin(), TimeKeys.constEnd(), T) - TimeKeys.constBegin();
+}
+
 TrackSegment::TrackSegment(void)
     : Feature()
 {
@@ -52,18 +259,160 @@ TrackSegment::~TrackSegment(void)
 
 void TrackSegment::sortByTime()
 {
-    for (int i=0; i<p->Nodes.size(); ++i)
-    {
-        for (int j=i+1; j<p->Nodes.size(); ++j)
-        {
-            if (p->Nodes[i]->time() > p->Nodes[j]->time())
-            {
-                QDateTime dt(p->Nodes[i]->time());
-                p->Nodes[i]->setTime(p->Nodes[j]->time());
-                p->Nodes[j]->setTime(dt);
+    QMutexLocker mutlock(&featMutex);
+    QVector< QPair<qint64, int> > Keyed(p->Nodes.size());
+    bool Sorted = true;
+    for (int i=0; i<p->Nodes.size(); ++i) {
+        qint64 T = LLONG_MIN;
+        timeKey(p->Nodes[i], T);
+        Keyed[i] = qMakePair(T, i);
+        if (i && T < Keyed[i-1].first)
+            Sorted = false;
+    }
+    if (Sorted)
+        return;
+
+    // Nodes without a time go first, the others keep their order on ties
+    std::sort(Keyed.begin(), Keyed.end());
+    QList<TrackNode*> Nodes;
+    Nodes.reserve(Keyed.size());
+    for (int i=0; i<Keyed.size(); ++i)
+        Nodes.append(p->Nodes[Keyed[i].second]);
+    p->Nodes = Nodes;
+
+    p->invalidate();
+    MetaUpToDate = false;
+    g_backend.sync(this);
+}
+
+int TrackSegment::nearestInTime(const QDateTime& Time) const
+{
+    if (!p->TimesUpToDate)
+        p->updateTimes();
+    if (p->TimeKeys.isEmpty() || !Time.isValid())
+        return -1;
+
+    qint64 T = Time.toMSecsSinceEpoch();
+    int j = p->lowerTime(T);
+    if (j == p->TimeKeys.size())
+        return p->TimeOrder.last();
+    if (j > 0 && T - p->TimeKeys[j-1] <= p->TimeKeys[j] - T)
+        --j;
+    return p->TimeOrder[j];
+}
+
+bool TrackSegment::positionAt(const QDateTime& Time, Coord& Position, qreal* Elevation) const
+{
+    if (!p->TimesUpToDate)
+        p->updateTimes();
+    if (p->TimeKeys.isEmpty() || !Time.isValid())
+        return false;
+
+    qint64 T = Time.toMSecsSinceEpoch();
+    if (T < p->TimeKeys.first() || T > p->TimeKeys.last())
+        return false;
+
+    int j = p->lowerTime(T);
+    const TrackNode* B = p->Nodes[p->TimeOrder[j]];
+    if (p->TimeKeys[j] == T) {
+        Position = B->position();
+        if (Elevation)
+            *Elevation = B->elevation();
+        return true;
+    }
+
+    const TrackNode* A = p->Nodes[p->TimeOrder[j-1]];
+    qreal f = qreal(T - p->TimeKeys[j-1]) / (p->TimeKeys[j] - p->TimeKeys[j-1]);
+    Position = A->position() + (B->position() - A->position()) * f;
+    if (Elevation)
+        *Elevation = A->elevation() + (B->elevation() - A->elevation()) * f;
+    return true;
+}
+
+/* Speed is drawn as the pen width and slope as the colour. Both are bucketed,
+ * so that a track is drawn with a handful of pens: 17 width steps from 1 to
+ * 5 times the track width, and 8 colour steps each for climbs and descents. */
+#define STYLE_SLOPES 17
+
+quint16 TrackSegmentPrivate::legStyle(int i) const
+{
+    if (i == 0)
+        return STYLE_SLOPES/2;
+
+    qreal distance = Nodes[i-1]->position().distanceFrom(Nodes[i]->position());
+    qreal slope = (Nodes[i]->elevation() - Nodes[i-1]->elevation()) / (distance * 10.0);
+    qreal speed = Nodes[i]->speed();
+
+    int Width = 0;
+    if (speed > 10.0)
+        Width = qRound((qMin(1.0+speed*0.02, 5.0) - 1.0) * 4);
+    int Slope = 0;
+    if (slope > 2.0)
+        Slope = 1 + int((qMin(slope, (qreal)20.0) - 2.0) * 7 / 18);
+    else if (slope < -2.0)
+        Slope = -1 - int((qMin(-slope, (qreal)20.0) - 2.0) * 7 / 18);
+
+    return quint16(Width * STYLE_SLOPES + Slope + STYLE_SLOPES/2);
+}
+
+static QPen stylePen(quint16 Style, int width)
+{
+    int Width = Style / STYLE_SLOPES;
+    int Slope = Style % STYLE_SLOPES - STYLE_SLOPES/2;
+
+    int green = 0;
+    int red = 0;
+    qreal slope = qMin(2.0 + (qAbs(Slope) - 0.5) * 18 / 7, 20.0);
+    if (Slope > 0)
+        green = 48 + int(slope*79.0 / 20.0);
+    else if (Slope < 0)
+        red = 48 + int(slope*79.0 / 20.0);
+
+    QPen pen(QColor(128 + red, 128 + green, 128));
+    pen.setStyle(Qt::DotLine);
+    pen.setWidthF((1.0 + Width / 4.0) * width);
+    return pen;
+}
+
+void TrackSegmentPrivate::updateStyles()
+{
+    Styles.reserve(Nodes.size());
+    for (int i=Styles.size(); i<Nodes.size(); ++i)
+        Styles.append(legStyle(i));
+}
+
+/* Indices of the nodes to draw when a pixel is PixelSize projected units */
+const QVector<int>& TrackSegmentPrivate::decimated(qreal PixelSize, const Projection& theProjection)
+{
+    if (LevelsRevision != theProjection.projectionRevision()) {
+        Levels.clear();
+        LevelsRevision = theProjection.projectionRevision();
+    }
+
+    int Level = NO_DECIMATION;
+    if (Nodes.size() >= TRACK_DECIMATE_MIN && PixelSize > 0 && std::isfinite(PixelSize))
+        Level = int(floor(log(PixelSize)/log(2.)));
+    qreal Tolerance = (Level == NO_DECIMATION) ? 0. : pow(2., Level);
+
+    TrackDecimation& D = Levels[Level];
+    if (D.Scanned < Nodes.size()) {
+        QPointF Last;
+        if (D.Kept.isEmpty()) {
+            Last = Nodes[0]->projected(theProjection);
+            D.Kept.append(0);
+            D.Scanned = 1;
+        } else
+            Last = Nodes[D.Kept.last()]->projected(theProjection);
+        for (int i=D.Scanned; i<Nodes.size(); ++i) {
+            const QPointF& Pt = Nodes[i]->projected(theProjection);
+            if (fabs(Pt.x()-Last.x()) + fabs(Pt.y()-Last.y()) >= Tolerance) {
+                D.Kept.append(i);
+                Last = Pt;
             }
         }
+        D.Scanned = Nodes.size();
     }
+    return D.Kept;
 }
 
 QString TrackSegment::description() const
@@ -73,15 +422,38 @@ QString TrackSegment::description() const
 
 void TrackSegment::add(TrackNode* aPoint)
 {
+    QMutexLocker mutlock(&featMutex);
     p->Nodes.push_back(aPoint);
     aPoint->setParentFeature(this);
+    p->appended();
+    g_backend.sync(this);
+}
+
+/// Append \a Points in order, updating the backend once for the whole batch
+void TrackSegment::add(const QList<TrackNode*>& Points)
+{
+    if (Points.isEmpty())
+        return;
+
+    QMutexLocker mutlock(&featMutex);
+    p->Nodes.reserve(p->Nodes.size() + Points.size());
+    foreach (TrackNode* Pt, Points) {
+        p->Nodes.push_back(Pt);
+        Pt->setParentFeature(this);
+        p->appended();
+    }
     g_backend.sync(this);
 }
 
 void TrackSegment::add(TrackNode* Pt, int Idx)
 {
+    QMutexLocker mutlock(&featMutex);
     p->Nodes.push_back(Pt);
-    std::rotate(p->Nodes.begin()+Idx,p->Nodes.end()-1,p->Nodes.end());
+    if (Idx < p->Nodes.size()-1) {
+        std::rotate(p->Nodes.begin()+Idx,p->Nodes.end()-1,p->Nodes.end());
+        p->invalidate();
+    } else
+        p->appended();
     g_backend.sync(this);
 }
 
@@ -95,9 +467,11 @@ int TrackSegment::find(Feature* Pt) const
 
 void TrackSegment::remove(int idx)
 {
+    QMutexLocker mutlock(&featMutex);
     Node* Pt = p->Nodes[idx];
     p->Nodes.erase(p->Nodes.begin()+idx);
     Pt->unsetParentFeature(this);
+    p->invalidate();
     g_backend.sync(this);
 }
 
@@ -133,7 +507,7 @@ bool TrackSegment::isNull() const
     return (p->Nodes.size() == 0);
 }
 
-void TrackSegment::drawDirectionMarkers(QPainter &P, QPen &pen, const QPointF & FromF, const QPointF & ToF)
+void TrackSegment::addDirectionMarkers(QVector<QLineF>& Lines, const QPointF & FromF, const QPointF & ToF)
 {
     if (::distance(FromF,ToF) <= 30.0)
         return;
@@ -146,91 +520,95 @@ void TrackSegment::drawDirectionMarkers(QPainter &P, QPen &pen, const QPointF &
     QPointF V1(theWidth*cos(A+M_PI/6),theWidth*sin(A+M_PI/6));
     QPointF V2(theWidth*cos(A-M_PI/6),theWidth*sin(A-M_PI/6));
 
-    pen.setStyle(Qt::SolidLine);
-    P.setPen(pen);
-
     QPointF H(FromF+ToF);
     H /= 2.0;
-    P.drawLine(H-T,H-T+V1);
-    P.drawLine(H-T,H-T+V2);
+    Lines << QLineF(H-T,H-T+V1);
+    Lines << QLineF(H-T,H-T+V2);
 }
 
+
 void TrackSegment::drawSimple(QPainter &P, MapView *theView)
 {
     Q_UNUSED(P)
     Q_UNUSED(theView)
 }
 
+/* Runs on the wireframe worker; the lock keeps the edits on the GUI thread
+ * away from the nodes and the caches rebuilt here */
 void TrackSegment::drawTouchup(QPainter &P, MapView* theView)
 {
-    QPen pen;
-
-    if (!TEST_RFLAGS(RendererOptions::TrackSegmentVisible))
+    QMutexLocker mutlock(&featMutex);
+    if (!TEST_RFLAGS(RendererOptions::TrackSegmentVisible) || p->Nodes.size() < 2)
         return;
 
-    for (int i=1; i<p->Nodes.size(); ++i)
-    {
-        if (!theView->viewport().contains(p->Nodes[i-1]->position()) && !theView->viewport().contains(p->Nodes[i]->position()))
-            continue;
-
-        QPointF FromF = theView->toView(p->Nodes[i-1]);
-        QPointF ToF = theView->toView(p->Nodes[i]);
+    const Projection& theProjection = theView->projection();
+    const QTransform& theTransform = theView->transform();
+    bool Simple = M_PREFS->getSimpleGpxTrack();
+    if (!Simple)
+        p->updateStyles();
 
-        if (!M_PREFS->getSimpleGpxTrack())
-        {
-            qreal distance = p->Nodes[i-1]->position().distanceFrom(p->Nodes[i]->position());
-            qreal slope = (p->Nodes[i]->elevation() - p->Nodes[i-1]->elevation()) / (distance * 10.0);
-            qreal speed = p->Nodes[i]->speed();
-
-            int width = M_PREFS->getGpxTrackWidth();
-            // Dynamic track line width adaption to zoom level
-            if (theView->pixelPerM() > 2)
-                width++;
-            else if (theView->pixelPerM() < 1)
-                width--;
-
-            // Encode speed in width of path ...
-            qreal penWidth = 1.0;
-            if (speed > 10.0)
-                penWidth = qMin(1.0+speed*0.02, 5.0);
+    // Draw about one point per pixel, and only the legs in view
+    const QVector<int>& Kept = p->decimated(1. / sqrt(fabs(theTransform.determinant())), theProjection);
+    QRectF Visible = theView->invertedTransform().mapRect(QRectF(theView->rect()));
 
-            penWidth *= width;
+    // Lines are batched per style bucket
+    QHash<quint16, QVector<QLineF> > Lines;
+    QHash<quint16, QVector<QLineF> > Markers;
 
-            // ... and slope in the color
-            int green = 0;
-            int red = 0;
+    const CoordBox& Vp = theView->viewport();
+    int Next = 0;
+    for (int k=0; k<chunkCount(); ++k)
+    {
+        const CoordBox& Box = p->Chunks[k];
+        if (Box.right() < Vp.left() || Vp.right() < Box.left() || Box.top() < Vp.bottom() || Vp.top() < Box.bottom())
+            continue;
 
-            if (slope > 2.0)
-            {
-                slope = qMin(slope, (qreal)20.0);
-                green = 48 + int(slope*79.0 / 20.0);
-            }
-            else if (slope < -2.0)
-            {
-                slope = qMax(slope, (qreal)-20.0);
-                red = 48 + int(-slope*79.0 / 20.0);
-            }
+        int First = k*TRACK_CHUNK_SIZE;
+        int Last = qMin(First+TRACK_CHUNK_SIZE, p->Nodes.size()-1);
+        int j = std::upper_bound(Kept.constBegin(), Kept.constEnd(), First) - Kept.constBegin() - 1;
+        for (j = qMax(j, Next); j < Kept.size() && Kept[j] < Last; ++j)
+        {
+            int From = Kept[j];
+            int To = (j+1 < Kept.size()) ? Kept[j+1] : p->Nodes.size()-1;
+            const QPointF& A = p->Nodes[From]->projected(theProjection);
+            const QPointF& B = p->Nodes[To]->projected(theProjection);
+            if (qMax(A.x(), B.x()) < Visible.left() || Visible.right() < qMin(A.x(), B.x()) ||
+                qMax(A.y(), B.y()) < Visible.top() || Visible.bottom() < qMin(A.y(), B.y()))
+                continue;
+
+            QPointF FromF = theTransform.map(A);
+            QPointF ToF = theTransform.map(B);
+            quint16 Style = Simple ? 0 : p->Styles[To];
+            Lines[Style] << QLineF(FromF, ToF);
+            addDirectionMarkers(Markers[Style], FromF, ToF);
+        }
+        Next = j;
+    }
 
-            pen.setColor(QColor(128 + red, 128 + green, 128));
+    int width = M_PREFS->getGpxTrackWidth();
+    // Dynamic track line width adaption to zoom level
+    if (theView->pixelPerM() > 2)
+        width++;
+    else if (theView->pixelPerM() < 1)
+        width--;
 
-            pen.setStyle(Qt::DotLine);
-            pen.setWidthF(penWidth);
-        }
+    QHash<quint16, QVector<QLineF> >::const_iterator it;
+    for (it = Lines.constBegin(); it != Lines.constEnd(); ++it)
+    {
+        QPen pen;
+        if (!Simple)
+            pen = stylePen(it.key(), width);
         else
         {
-            int width = M_PREFS->getGpxTrackWidth();
-            // Dynamic track line width adaption to zoom level
-            if (theView->pixelPerM() > 2)
-                width++;
-            else if (theView->pixelPerM() < 1)
-                width--;
             pen.setWidthF(width);
             pen.setColor(M_PREFS->getGpxTrackColor());
         }
         P.setPen(pen);
+        P.drawLines(it.value());
 
-        P.drawLine(FromF,ToF);
-        drawDirectionMarkers(P, pen, FromF, ToF);
+        pen.setStyle(Qt::SolidLine);
+        P.setPen(pen);
+        P.drawLines(Markers.value(it.key()));
     }
 }
 
@@ -257,17 +635,44 @@ void TrackSegment::drawChildrenSpecial(QPainter&, QPen&, MapView*, int)
 
 const CoordBox& TrackSegment::boundingBox(bool) const
 {
-    if (p->Nodes.size())
-    {
-        p->BBox = CoordBox(p->Nodes[0]->position(),p->Nodes[0]->position());
-        for (int i=1; i<p->Nodes.size(); ++i)
-            p->BBox.merge(p->Nodes[i]->position());
-    } else
-        p->BBox = CoordBox();
+    if (!p->BBoxUpToDate) {
+        if (p->Nodes.size())
+        {
+            p->BBox = CoordBox(p->Nodes[0]->position(),p->Nodes[0]->position());
+            for (int i=1; i<p->Nodes.size(); ++i)
+                p->BBox.merge(p->Nodes[i]->position());
+        } else
+            p->BBox = CoordBox();
+        p->BBoxUpToDate = true;
+    }
     return p->BBox;
 }
 
-qreal TrackSegment::pixelDistance(const QPointF& , qreal , const QList<Feature*>& , MapView*) const
+int TrackSegment::chunkCount() const
+{
+    if (!p->ChunksUpToDate)
+        p->updateChunks();
+    return p->Chunks.size();
+}
+
+const CoordBox& TrackSegment::chunkBox(int k) const
+{
+    if (!p->ChunksUpToDate)
+        p->updateChunks();
+    return p->Chunks[k];
+}
+
+int TrackSegment::dirtyChunk() const
+{
+    return p->DirtyChunk;
+}
+
+void TrackSegment::setChunksIndexed()
+{
+    p->DirtyChunk = p->Chunks.size();
+}
+
+qreal TrackSegment::pixelDistance(const QPointF& , qreal , const QSet<Feature*>& , MapView*) const
 {
     // unable to select that one
     return 1000000;
@@ -309,8 +714,21 @@ void TrackSegment::cascadedRemoveIfUsing(Document* theDocument, Feature* aFeatur
     }
 }
 
-void TrackSegment::partChanged(Feature*, int)
+void TrackSegment::partChanged(Feature* F, int)
 {
+    if (isDeleted())
+        return;
+
+    // The chunk boxes in the index move with the trackpoints. Flushed
+    // transactions do not say which node changed.
+    QMutexLocker mutlock(&featMutex);
+    int i = F ? p->indexOf(F) : -1;
+    if (i == -1)
+        p->invalidate();
+    else
+        p->moved(i);
+    MetaUpToDate = false;
+    g_backend.sync(this);
 }
 
 void TrackSegment::updateMeta()
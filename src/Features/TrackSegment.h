@@ -3,6 +3,9 @@
 
 #include "Feature.h"
 
+#include <QLineF>
+#include <QVector>
+
 class TrackSegmentPrivate;
 class TrackNode;
 
@@ -18,7 +21,9 @@ protected:
     TrackSegment(const TrackSegment& other);
 
 private:
-    void drawDirectionMarkers(QPainter & P, QPen & pen, const QPointF & FromF, const QPointF & ToF);
+    int dirtyChunk() const;
+    void setChunksIndexed();
+    void addDirectionMarkers(QVector<QLineF>& Lines, const QPointF & FromF, const QPointF & ToF);
 
 public:
     virtual QString getClass() const {return "TrackSegment";}
@@ -26,19 +31,23 @@ public:
     virtual void updateMeta();
 
     virtual const CoordBox& boundingBox(bool update=true) const;
+    /// The segment is indexed as consecutive chunks of legs, each with its own box
+    int chunkCount() const;
+    const CoordBox& chunkBox(int k) const;
     virtual void drawSimple(QPainter& P, MapView* theView);
     virtual void drawTouchup(QPainter& P, MapView* theView);
     virtual void drawSpecial(QPainter& P, QPen& Pen, MapView* theView);
     virtual void drawParentsSpecial(QPainter& P, QPen& Pen, MapView* theView);
     virtual void drawChildrenSpecial(QPainter& P, QPen& Pen, MapView* theView, int depth);
 
-    virtual qreal pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QList<Feature*>& NoSnap, MapView* theView) const;
+    virtual qreal pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QSet<Feature*>& NoSnap, MapView* theView) const;
     void cascadedRemoveIfUsing(Document* theDocument, Feature* aFeature, CommandList* theList, const QList<Feature*>& Alternatives);
     virtual bool notEverythingDownloaded();
     virtual QString description() const;
 
     void add(TrackNode* aPoint);
     void add(TrackNode* Pt, int Idx);
+    void add(const QList<TrackNode*>& Points);
     virtual int find(Feature* Pt) const;
     virtual void remove(int idx);
     virtual void remove(Feature* F);
@@ -48,7 +57,14 @@ public:
     virtual const Feature* get(int Idx) const;
     virtual bool isNull() const;
 
+    /// Reorder the nodes by their time, in O(n log n)
     void sortByTime();
+    /// Index of the node closest in time to \a Time, or -1 if none has a time.
+    /// Nodes are looked up through a time index, built when first needed.
+    int nearestInTime(const QDateTime& Time) const;
+    /// Position (and elevation) at \a Time, linearly interpolated between the
+    /// nodes around it. Returns false if \a Time is outside the track's span.
+    bool positionAt(const QDateTime& Time, Coord& Position, qreal* Elevation = 0) const;
     virtual void partChanged(Feature* F, int ChangeId);
 
     qreal distance();
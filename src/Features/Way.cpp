@@ -20,6 +20,8 @@
 
 #include <algorithm>
 #include <QList>
+#include <QMap>
+#include <QVector>
 
 #define TEST_RFLAGS(x) theView->renderOptions().options.testFlag(x)
 
@@ -33,12 +35,15 @@ class WayPrivate
             , ProjectionRevision(0)
             , BestSegment(-1)
             , SimpleWidth(0)
+            , SegmentBoxesUpToDate(false), SegmentBoxesRevision(0)
         {
         }
         Way* theWay;
 
         QList<Node*> Nodes;
-        QList<Node*> virtualNodes;
+        // Virtual nodes are the implicit midpoints of the segments; a Node is
+        // only allocated for the ones the user points at, by segment index
+        QMap<int, Node*> virtualNodes;
 
         bool BBoxUpToDate;
 
@@ -48,6 +53,7 @@ class WayPrivate
         bool PathUpToDate;
         bool VirtualsUptodate;
         QPainterPath thePath;
+        GeneralizedPaths Generalized;
         int ProjectionRevision;
         int BestSegment;
         qreal SimpleWidth;
@@ -55,10 +61,20 @@ class WayPrivate
 
         RenderPriority theRenderPriority; // 10 (24)
 
+        // Projected bounding boxes of runs of consecutive segments, as an
+        // implicit binary tree (children of i at 2i+1 and 2i+2), so that
+        // hit-testing only looks at the segments near the pointer
+        QVector<QRectF> SegmentBoxes;
+        bool SegmentBoxesUpToDate;
+        int SegmentBoxesRevision;
+
         void CalculateWidth();
+        QRectF buildSegmentBoxes(const Projection& theProjection, int Idx, int From, int To);
+        void findSegments(const QRectF& R, int Idx, int From, int To, QList<int>& Segments) const;
         void doUpdateVirtuals();
         void removeVirtuals();
-        void addVirtuals();
+        Coord virtualPosition(int Segment) const;
+        Node* virtualNode(int Segment);
 };
 
 #define DEFAULTWIDTH 6
@@ -100,29 +116,80 @@ void WayPrivate::CalculateWidth()
         SimpleWidth = s.toDouble();
 }
 
+// Segments per leaf of the segment box tree
+#define SEGMENT_LEAF_SIZE 8
+
+QRectF WayPrivate::buildSegmentBoxes(const Projection& theProjection, int Idx, int From, int To)
+{
+    QRectF Box;
+    if (To-From <= SEGMENT_LEAF_SIZE) {
+        QPointF Min(Nodes[From]->projected(theProjection));
+        QPointF Max(Min);
+        for (int i=From+1; i<=To; ++i) {
+            const QPointF& P = Nodes[i]->projected(theProjection);
+            Min.setX(qMin(Min.x(), P.x()));
+            Min.setY(qMin(Min.y(), P.y()));
+            Max.setX(qMax(Max.x(), P.x()));
+            Max.setY(qMax(Max.y(), P.y()));
+        }
+        Box = QRectF(Min, Max);
+    } else {
+        int Mid = (From+To)/2;
+        QRectF A = buildSegmentBoxes(theProjection, 2*Idx+1, From, Mid);
+        QRectF B = buildSegmentBoxes(theProjection, 2*Idx+2, Mid, To);
+        // QRectF::united() ignores degenerate boxes
+        Box = QRectF(QPointF(qMin(A.left(), B.left()), qMin(A.top(), B.top())),
+                     QPointF(qMax(A.right(), B.right()), qMax(A.bottom(), B.bottom())));
+    }
+    if (Idx >= SegmentBoxes.size())
+        SegmentBoxes.resize(Idx+1);
+    SegmentBoxes[Idx] = Box;
+    return Box;
+}
+
+void WayPrivate::findSegments(const QRectF& R, int Idx, int From, int To, QList<int>& Segments) const
+{
+    // Not QRectF::intersects(), which fails for flat boxes
+    const QRectF& Box = SegmentBoxes[Idx];
+    if (Box.left() > R.right() || Box.right() < R.left() || Box.top() > R.bottom() || Box.bottom() < R.top())
+        return;
+
+    if (To-From <= SEGMENT_LEAF_SIZE) {
+        for (int i=From; i<To; ++i)
+            Segments << i;
+    } else {
+        int Mid = (From+To)/2;
+        findSegments(R, 2*Idx+1, From, Mid, Segments);
+        findSegments(R, 2*Idx+2, Mid, To, Segments);
+    }
+}
+
 void WayPrivate::removeVirtuals()
 {
-    while (virtualNodes.size()) {
-        virtualNodes[0]->unsetParentFeature(theWay);
-        g_backend.deallocVirtualNode(virtualNodes[0]);
-//        if (virtualNodes[0]->layer())
-//            virtualNodes[0]->layer()->deleteFeature(virtualNodes[0]);
-//		delete p->virtualNodes[0];
-        virtualNodes.erase(virtualNodes.begin());
+    foreach (Node* v, virtualNodes) {
+        v->unsetParentFeature(theWay);
+        g_backend.deallocVirtualNode(v);
     }
+    virtualNodes.clear();
+}
+
+Coord WayPrivate::virtualPosition(int Segment) const
+{
+    QLineF l(Nodes[Segment]->position(), Nodes[Segment+1]->position());
+    l.setLength(l.length()/2);
+    return l.p2();
 }
 
-void WayPrivate::addVirtuals()
+Node* WayPrivate::virtualNode(int Segment)
 {
-    for (int i=1; i<Nodes.size(); ++i) {
-        QLineF l(Nodes[i-1]->position(), Nodes[i]->position());
-        l.setLength(l.length()/2);
-        Node* v = g_backend.allocVirtualNode(l.p2());
+    Node* v = virtualNodes.value(Segment);
+    if (!v) {
+        v = g_backend.allocVirtualNode(virtualPosition(Segment));
         v->setVirtual(true);
         v->setParentFeature(theWay);
-//        theWay->layer()->add(v);
-        virtualNodes.push_back(v);
+        virtualNodes.insert(Segment, v);
     }
+    return v;
 }
 
 void WayPrivate::doUpdateVirtuals()
@@ -132,9 +199,9 @@ void WayPrivate::doUpdateVirtuals()
     if (VirtualsUptodate)
         return;
 
+    // The midpoints are recomputed on the fly; only the nodes handed out for
+    // the old geometry have to go
     removeVirtuals();
-    if (theWay->canAddVirtualNodes())
-        addVirtuals();
 
     VirtualsUptodate = true;
 }
@@ -210,6 +277,7 @@ void Way::partChanged(Feature* /*F*/, int ChangeId)
 
     p->BBoxUpToDate = false;
     p->PathUpToDate = false;
+    p->SegmentBoxesUpToDate = false;
     MetaUpToDate = false;
     p->VirtualsUptodate = false;
     g_backend.sync(this);
@@ -240,6 +308,7 @@ void Way::add(Node* Pt, int Idx)
     g_backend.sync(Pt);
     p->BBoxUpToDate = false;
     p->PathUpToDate = false;
+    p->SegmentBoxesUpToDate = false;
     MetaUpToDate = false;
     p->VirtualsUptodate = false;
     g_backend.sync(this);
@@ -257,10 +326,11 @@ int Way::find(Feature* Pt) const
 
 int Way::findVirtual(Feature* Pt) const
 {
-    for (int i=0; i<p->virtualNodes.size(); ++i)
-        if (p->virtualNodes[i] == Pt)
-            return i;
-    return p->virtualNodes.size();
+    QMap<int, Node*>::const_iterator it;
+    for (it = p->virtualNodes.constBegin(); it != p->virtualNodes.constEnd(); ++it)
+        if (it.value() == Pt)
+            return it.key();
+    return qMax(p->Nodes.size()-1, 0);
 }
 
 void Way::remove(int idx)
@@ -274,6 +344,7 @@ void Way::remove(int idx)
     g_backend.sync(Pt);
     p->BBoxUpToDate = false;
     p->PathUpToDate = false;
+    p->SegmentBoxesUpToDate = false;
     MetaUpToDate = false;
     p->VirtualsUptodate = false;
     g_backend.sync(this);
@@ -308,9 +379,20 @@ const QList<NodePtr>& Way::getNodes() const
     return p->Nodes;
 }
 
-const QList<NodePtr>& Way::getVirtuals() const
+/// Candidate segments (by index of their first node) whose projected geometry
+/// may intersect the projected rectangle \a aRect
+void Way::segmentsIn(const QRectF& aRect, const Projection& theProjection, QList<int>& Segments) const
 {
-    return p->virtualNodes;
+    if (p->Nodes.size() < 2)
+        return;
+
+    if (!p->SegmentBoxesUpToDate || p->SegmentBoxesRevision != theProjection.projectionRevision()) {
+        p->SegmentBoxes.clear();
+        p->buildSegmentBoxes(theProjection, 0, 0, p->Nodes.size()-1);
+        p->SegmentBoxesRevision = theProjection.projectionRevision();
+        p->SegmentBoxesUpToDate = true;
+    }
+    p->findSegments(aRect.normalized(), 0, 0, p->Nodes.size()-1, Segments);
 }
 
 
@@ -385,7 +467,9 @@ void Way::drawSimple(QPainter &P, MapView *theView)
 
     P.setBrush(theBrush);
     P.setPen(thePen);
-    P.drawPath(theView->transform().map(p->thePath));
+    getLock();
+    P.drawPath(theView->transform().map(getPath(theView->transform())));
+    releaseLock();
 }
 
 void Way::updateMeta()
@@ -482,7 +566,9 @@ void Way::drawTouchup(QPainter& P, MapView* theView)
     if (isDirty() && isUploadable() && M_PREFS->getDirtyVisible()) {
         QPen thePen(M_PREFS->getDirtyColor(),M_PREFS->getDirtyWidth());
         P.setPen(thePen);
-        P.drawPath(theView->transform().map(getPath()));
+        getLock();
+        P.drawPath(theView->transform().map(getPath(theView->transform())));
+        releaseLock();
     }
 
     qreal theWidth = theView->nodeWidth();
@@ -490,11 +576,17 @@ void Way::drawTouchup(QPainter& P, MapView* theView)
     if (!Draw || !theView->renderOptions().options.testFlag(RendererOptions::VirtualNodesVisible) || !theView->renderOptions().options.testFlag(RendererOptions::NodesVisible) || isReadonly())
         return;
 
+    if (!canAddVirtualNodes())
+        return;
+
     theWidth /= 2;
     P.setPen(QColor(0,0,0));
-    foreach (NodePtr N, p->virtualNodes) {
-        if (theView->viewport().contains(N->position())) {
-            QPoint p =  theView->toView(N);
+    // Runs on the render worker; keep the node list stable while it is walked
+    QMutexLocker mutlock(&featMutex);
+    for (int i=0; i<p->Nodes.size()-1; ++i) {
+        Coord C(p->virtualPosition(i));
+        if (theView->viewport().contains(C)) {
+            QPoint p =  theView->toView(C);
             P.drawLine(p+QPoint(-theWidth, -theWidth), p+QPoint(theWidth, theWidth));
             P.drawLine(p+QPoint(theWidth, -theWidth), p+QPoint(-theWidth, theWidth));
         }
@@ -544,7 +636,7 @@ void Way::drawChildrenSpecial(QPainter& thePainter, QPen& Pen, MapView* theView,
 }
 
 
-qreal Way::pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QList<Feature*>& NoSnap, MapView* theView) const
+qreal Way::pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QSet<Feature*>& NoSnap, MapView* theView) const
 {
     qreal Best = 1000000;
     p->BestSegment = -1;
@@ -559,7 +651,10 @@ qreal Way::pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QL
 //            }
 //        }
 //    }
-    for (int i=0; i<p->Nodes.size()-1; ++i)
+    QList<int> Segments;
+    segmentsIn(theView->invertedTransform().mapRect(QRectF(Target.x()-ClearEndDistance, Target.y()-ClearEndDistance, 2*ClearEndDistance, 2*ClearEndDistance)),
+               theView->projection(), Segments);
+    foreach (int i, Segments)
     {
         if (NoSnap.contains(p->Nodes.at(i)) || NoSnap.contains(p->Nodes.at(i+1)))
             continue;
@@ -577,12 +672,22 @@ qreal Way::pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QL
     return Best;
 }
 
-Node* Way::pixelDistanceNode(const QPointF& Target, qreal ClearEndDistance, MapView* theView, const QList<Feature*>& NoSnap, bool NoSelectVirtuals) const
+Node* Way::pixelDistanceNode(const QPointF& Target, qreal ClearEndDistance, MapView* theView, const QSet<Feature*>& NoSnap, bool NoSelectVirtuals) const
 {
     qreal Best = 1000000;
     Node* ret = NULL;
 
-    for (int i=0; i<p->Nodes.size(); ++i)
+    QList<int> Segments;
+    segmentsIn(theView->invertedTransform().mapRect(QRectF(Target.x()-ClearEndDistance, Target.y()-ClearEndDistance, 2*ClearEndDistance, 2*ClearEndDistance)),
+               theView->projection(), Segments);
+
+    QList<int> Candidates;
+    foreach (int i, Segments)
+        Candidates << i << i+1;
+    if (p->Nodes.size() == 1)
+        Candidates << 0;
+
+    foreach (int i, Candidates)
     {
         if (p->Nodes.at(i) && !NoSnap.contains(p->Nodes.at(i))) {
             qreal D = ::distance(Target,theView->toView(p->Nodes.at(i)));
@@ -592,18 +697,21 @@ Node* Way::pixelDistanceNode(const QPointF& Target, qreal ClearEndDistance, MapV
             }
         }
     }
-    if (!NoSelectVirtuals && M_PREFS->getVirtualNodesVisible()) {
-        for (int i=0; i<p->virtualNodes.size(); ++i)
+    if (!NoSelectVirtuals && M_PREFS->getVirtualNodesVisible() && canAddVirtualNodes()) {
+        int BestSegment = -1;
+        foreach (int i, Segments)
         {
-            if (p->virtualNodes.at(i)) {
-                p->virtualNodes.at(i)->buildPath(theView->projection());
-                qreal D = ::distance(Target,theView->toView(p->virtualNodes.at(i)));
-                if (D < ClearEndDistance && D < Best) {
-                    Best = D;
-                    return p->virtualNodes.at(i);
-                }
+            qreal D = ::distance(Target,theView->toView(p->virtualPosition(i)));
+            if (D < ClearEndDistance && D < Best) {
+                Best = D;
+                BestSegment = i;
             }
         }
+        if (BestSegment != -1) {
+            Node* v = p->virtualNode(BestSegment);
+            v->buildPath(theView->projection());
+            return v;
+        }
     }
     return ret;
 }
@@ -648,17 +756,27 @@ const QPainterPath& Way::getPath() const
     return p->thePath;
 }
 
+/// Path generalized for \a theTransform; to be called with the lock held
+const QPainterPath& Way::getPath(const QTransform& theTransform)
+{
+    return p->Generalized.get(p->thePath, theTransform);
+}
+
 void Way::addPathHole(const QPainterPath& pth)
 {
     if (!p->PathUpToDate)
         return;
 
-    p->thePath = p->thePath.subtracted(pth);
+    // Rendered as a hole by the path's odd-even fill rule
+    p->thePath.setFillRule(Qt::OddEvenFill);
+    p->thePath.addPath(pth);
+    p->Generalized.clear();
 }
 
 void Way::rebuildPath(const Projection &theProjection)
 {
     p->PathUpToDate = false;
+    p->SegmentBoxesUpToDate = false;
     buildPath(theProjection);
 }
 
@@ -669,6 +787,7 @@ void Way::buildPath(const Projection &theProjection)
         return;
     else {
         p->thePath = QPainterPath();
+        p->Generalized.clear();
         if (p->Nodes.size() < 2) {
             p->PathUpToDate = true;
             return;
@@ -685,9 +804,8 @@ void Way::buildPath(const Projection &theProjection)
                 }
             }
         }
-        for (int i=0; i<p->virtualNodes.size(); ++i) {
-            p->virtualNodes[i]->buildPath(theProjection);
-        }
+        foreach (Node* v, p->virtualNodes)
+            v->buildPath(theProjection);
         p->ProjectionRevision = theProjection.projectionRevision();
         p->PathUpToDate = true;
     }
@@ -1010,7 +1128,7 @@ int Way::createJunction(Document* theDocument, CommandList* theList, Way* R1, Wa
     return numInter;
 }
 
-bool Way::canAddVirtualNodes()
+bool Way::canAddVirtualNodes() const
 {
     if (M_PREFS->getUseVirtualNodes() && layer() && !ReadOnly && !isDeleted())
         return true;
@@ -11,6 +11,7 @@ class WayPrivate;
 class Node;
 class QProgressDialog;
 class MapRenderer;
+class QTransform;
 
 class Way : public Feature
 {
@@ -35,8 +36,8 @@ public:
     virtual void drawParentsSpecial(QPainter& P, QPen& Pen, MapView* theView);
     virtual void drawChildrenSpecial(QPainter& P, QPen& Pen, MapView* theView, int depth);
 
-    virtual qreal pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QList<Feature*>& NoSnap, MapView* theView) const;
-    Node* pixelDistanceNode(const QPointF& Target, qreal ClearEndDistance, MapView* theView, const QList<Feature*>& NoSnap, bool NoSelectVirtuals) const;
+    virtual qreal pixelDistance(const QPointF& Target, qreal ClearEndDistance, const QSet<Feature*>& NoSnap, MapView* theView) const;
+    Node* pixelDistanceNode(const QPointF& Target, qreal ClearEndDistance, MapView* theView, const QSet<Feature*>& NoSnap, bool NoSelectVirtuals) const;
     virtual void cascadedRemoveIfUsing(Document* theDocument, Feature* aFeature, CommandList* theList, const QList<Feature*>& Alternatives);
     virtual bool notEverythingDownloaded();
     virtual QString description() const;
@@ -56,7 +57,7 @@ public:
     Node* getNode(int idx);
     const Node* getNode(int idx) const;
     const QList<NodePtr>& getNodes() const;
-    const QList<NodePtr>& getVirtuals() const;
+    void segmentsIn(const QRectF& aRect, const Projection& theProjection, QList<int>& Segments) const;
 
     int segmentCount();
     QLineF getSegment(int i);
@@ -77,6 +78,7 @@ public:
     virtual bool deleteChildren(Document* theDocument, CommandList* theList);
 
     const QPainterPath& getPath() const;
+    const QPainterPath& getPath(const QTransform& theTransform);
     void addPathHole(const QPainterPath &pth);
     void rebuildPath(const Projection &theProjection);
     void buildPath(Projection const &theProjection);
@@ -94,7 +96,7 @@ public:
     static int createJunction(Document* theDocument, CommandList* theList, Way* R1, Way* R2, bool doIt);
 
 protected:
-    bool canAddVirtualNodes();
+    bool canAddVirtualNodes() const;
     WayPrivate* p;
 };
 
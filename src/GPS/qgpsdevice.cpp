@@ -79,7 +79,7 @@ void GPSSlotForwarder::checkDataAvailable()
  */
 
 QGPSDevice::QGPSDevice()
-    :LogFile(0)
+    :LogFile(0), RingHead(0), RingTail(0)
 {
     mutex = new QMutex(QMutex::Recursive);
 
@@ -103,6 +103,41 @@ QGPSDevice::QGPSDevice()
     }
 }
 
+/**
+ * Position queue
+ *
+ * Fixes are handed to the GUI thread through a lock-free ring instead of a
+ * queued signal each, so that the consumer can pick them up in batches.
+ */
+
+void QGPSDevice::queuePosition(qreal latitude, qreal longitude, const QDateTime& time, qreal altitude, qreal speed, qreal heading)
+{
+    uint Head = uint(RingHead.load());
+    if (Head - uint(RingTail.loadAcquire()) >= GPS_RING_SIZE) {
+        // The consumer is not keeping up; drop the fix rather than block
+        return;
+    }
+
+    GpsPosition& P = Ring[Head % GPS_RING_SIZE];
+    P.latitude = latitude;
+    P.longitude = longitude;
+    P.time = time.isValid() ? time.toTime_t() : 0;
+    P.altitude = altitude;
+    P.speed = speed;
+    P.heading = heading;
+    RingHead.storeRelease(int(Head + 1));
+}
+
+int QGPSDevice::takePositions(QVector<GpsPosition>& Out)
+{
+    uint Tail = uint(RingTail.load());
+    uint Head = uint(RingHead.loadAcquire());
+    for (uint i = Tail; i != Head; ++i)
+        Out << Ring[i % GPS_RING_SIZE];
+    RingTail.storeRelease(int(Head));
+    return int(Head - Tail);
+}
+
 /**
  * Accessor functions
  */
@@ -227,7 +262,7 @@ void QGPSDevice::parseNMEA(const QByteArray& bufferString)
         //strcpy(nmeastr_rmc, bufferString);
         if (parseRMC(bufferString.data()))
             if (fixStatus() == QGPSDevice::StatusActive && (fixType() == QGPSDevice::Fix3D || fixType() == QGPSDevice::FixUnavailable))
-                emit updatePosition(latitude(), longitude(), dateTime(), altitude(), speed(), heading());
+                queuePosition(latitude(), longitude(), dateTime(), altitude(), speed(), heading());
     }
     emit updateStatus();
 }
@@ -459,6 +494,7 @@ bool QGPSDevice::parseRMC(const char *rmcString)
 
     QString strDate = tokens[9] + tokens[1];
     cur_datetime = QDateTime::fromString(strDate, "ddMMyyHHmmss.zzz");
+    cur_datetime.setTimeSpec(Qt::UTC);
 
     if (cur_datetime.date().year() < 1970)
         cur_datetime = cur_datetime.addYears(100);
@@ -904,7 +940,7 @@ void QGPSFileDevice::onDataAvailable()
             //strcpy(nmeastr_rmc, bufferString);
             if (parseRMC(bufferString))
                 if (fixStatus() == QGPSDevice::StatusActive && (fixType() == QGPSDevice::Fix3D || fixType() == QGPSDevice::FixUnavailable))
-                    emit updatePosition(latitude(), longitude(), dateTime(), altitude(), speed(), heading());
+                    queuePosition(latitude(), longitude(), dateTime(), altitude(), speed(), heading());
         }
 
         mutex->unlock();
@@ -1060,7 +1096,7 @@ void QGPSDDevice::onDataAvailable()
     if (gpsdata->FIX_TIME)
         cur_datetime = QDateTime::fromTime_t(gpsdata->FIX_TIME);
 #undef FIX_TIME
-    emit updatePosition(gpsdata->fix.latitude,
+    queuePosition(gpsdata->fix.latitude,
                         gpsdata->fix.longitude,
                         cur_datetime,
                         cur_altitude, cur_speed, cur_heading);
@@ -1244,7 +1280,7 @@ void QGPSDDevice::parseO(const QString& s)
     qreal Heading = 0;
     if (Args.count() > 7)
         Heading = Args[7].toDouble();
-    emit updatePosition(Args[3].toDouble(),
+    queuePosition(Args[3].toDouble(),
         Args[4].toDouble(),
         QDateTime::currentDateTime(),
         Alt, Speed, Heading);
@@ -1353,7 +1389,7 @@ void QGPSMobileDevice::onPositionUpdated(const QGeoPositionInfo &update)
         setFixType(Fix2D);
     }
 
-    emit updatePosition(latitude(), longitude(), dateTime(), altitude(), speed(), heading());
+    queuePosition(latitude(), longitude(), dateTime(), altitude(), speed(), heading());
     emit updateStatus();
 }
 
@@ -21,8 +21,10 @@
 #ifndef QGPS_DEVICE_H
 #define QGPS_DEVICE_H
 
+#include <QAtomicInt>
 #include <QObject>
 #include <QThread>
+#include <QVector>
 #include <QDateTime>
 #include <QFile>
 
@@ -31,6 +33,19 @@ class QMutex;
 class QextSerialPort;
 class QFile;
 
+#define GPS_RING_SIZE 1024  // must be a power of two
+
+/// A position fix, as queued by the device thread
+struct GpsPosition
+{
+    qreal latitude;
+    qreal longitude;
+    uint time;          // 0 if the device gave none
+    qreal altitude;
+    qreal speed;
+    qreal heading;
+};
+
 class QGPSDevice;
 // We want these slots to be executed within the thread represented by
 // QGPSDDevice. Since that class itself lives in the main thread, we need
@@ -118,6 +133,10 @@ public:
     CardinalDirection longCardinal()    { return cur_longCardinal;  }
     CardinalDirection varCardinal()     { return cur_varCardinal;   }
 
+    /// Move the fixes queued since the last call to \a Out, oldest first.
+    /// Only one thread (the GUI one) may take positions.
+    int takePositions(QVector<GpsPosition>& Out);
+
     bool isActiveSat(int prn);
     void satInfo(int index, int &elev, int &azim, int &snr);
 
@@ -138,7 +157,6 @@ public slots:
 
 signals:
 
-    void  updatePosition(qreal latitude, qreal longitude, QDateTime time, qreal altitude, qreal speed, qreal heading);
     void  updateStatus();
     void doStopDevice();
 
@@ -148,6 +166,8 @@ protected:
     virtual void checkDataAvailable() {};
     virtual void run() = 0;
 
+    void queuePosition(qreal latitude, qreal longitude, const QDateTime& time, qreal altitude, qreal speed, qreal heading);
+
     int     fd;
     bool    stopLoop;
 
@@ -210,6 +230,12 @@ private:
     virtual void onDataAvailable() = 0;
     virtual void onStop() = 0;
 
+    // Single producer (the device thread), single consumer ring; the
+    // counters only ever grow and wrap, the slot is counter % GPS_RING_SIZE
+    GpsPosition Ring[GPS_RING_SIZE];
+    QAtomicInt RingHead;    // written by the device thread only
+    QAtomicInt RingTail;    // written by the consumer only
+
     friend class GPSSlotForwarder;
 };
 
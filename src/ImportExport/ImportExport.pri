@@ -7,6 +7,7 @@ HEADERS += \
     ImportGPX.h \
     ImportNGT.h \
     ImportOSM.h \
+    OsmXmlParser.h \
     ImportNGT.h \
     IImportExport.h \
     ImportNMEA.h \
@@ -20,6 +21,7 @@ SOURCES += \
     ExportOSM.cpp \
     ImportGPX.cpp \
     ImportOSM.cpp \
+    OsmXmlParser.cpp \
     ImportNGT.cpp \
     IImportExport.cpp \
     ImportNMEA.cpp \
@@ -26,6 +26,13 @@
 #include <gdal_priv.h>
 
 #include <QDir>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include <QtConcurrent/QtConcurrentMap>
 
 
 bool parseContainer(QDomElement& e, Layer* aLayer);
@@ -206,32 +213,21 @@ bool ImportExportGdal::export_(const QList<Feature *>& featList)
 
 /***************/
 
-// Make OGRPoint usable in a QHash<>
-static bool operator==(const OGRPoint a, const OGRPoint b)
-{
-    return a.getX() == b.getX()
-        && a.getY() == b.getY()
-        && a.getDimension() == b.getDimension()
-        && (a.getDimension() < 3 || a.getZ() == b.getZ());
-}
-static uint qHash(const OGRPoint o)
-{
-    // A good algorithm depends strongly on the data.  In particular,
-    // on the projection and extent of the map.  This is written for
-    // EPSG:27700 10kmx10km at 1m resolution (i.e. OS OpenData tiles).
-    return (uint)(o.getX() * 100000 + o.getY() * 1000000000);
-}
-
+// WGS84 coordinates are quantised to the OSM precision, which is well
+// below the accuracy of any source data
+#define GDAL_COORD_PRECISION 1e7
 
 Node *ImportExportGdal::nodeFor(Layer* aLayer, const OGRPoint p)
 {
-    if (pointHash.contains(p)) {
-        return pointHash[p];
-    }
-
-    pointHash[p] = g_backend.allocNode(aLayer, Coord(p.getX(), p.getY()));
-    aLayer->add(pointHash[p]);
-    return pointHash[p];
+    QPair<qint64, qint64> Key(qRound64(p.getX() * GDAL_COORD_PRECISION), qRound64(p.getY() * GDAL_COORD_PRECISION));
+    QHash<QPair<qint64, qint64>, Node*>::const_iterator it = pointHash.constFind(Key);
+    if (it != pointHash.constEnd())
+        return it.value();
+
+    Node* N = g_backend.allocNode(aLayer, Coord(p.getX(), p.getY()));
+    aLayer->add(N);
+    pointHash.insert(Key, N);
+    return N;
 }
 
 // IMPORT
@@ -320,6 +316,198 @@ Feature* ImportExportGdal::parseGeometry(Layer* aLayer, OGRGeometry *poGeometry)
     }
 }
 
+/**
+  Reads the features of OGR layers and reprojects their geometry to WGS84
+  off the GUI thread.
+
+  OGR layers are read sequentially, but each batch is reprojected in
+  parallel chunks, each chunk with its own coordinate transformation since
+  those are not thread-safe. Batches are handed over through a bounded
+  queue; the features taken belong to the caller.
+*/
+class GdalFeatureReader : public QThread
+{
+public:
+    GdalFeatureReader(const QList<OGRLayer*>& aLayers, OGRSpatialReference* aSrs, OGRSpatialReference* aWgs84)
+        : Layers(aLayers), Srs(aSrs), Wgs84(aWgs84), Read(0), Finished(false), Cancelled(false)
+    {
+    }
+    ~GdalFeatureReader()
+    {
+        cancel();
+        wait();
+        while (!Queue.isEmpty())
+            foreach (OGRFeature* F, Queue.dequeue())
+                OGRFeature::DestroyFeature(F);
+    }
+
+    /// Get the next batch. Returns false once the reader is finished and the
+    /// queue is drained; may return true with an empty batch on timeout.
+    bool takeBatch(QVector<OGRFeature*>& batch, int timeout = 100)
+    {
+        batch.clear();
+
+        QMutexLocker lock(&Mutex);
+        if (Queue.isEmpty() && !Finished)
+            NotEmpty.wait(&Mutex, timeout);
+        if (!Queue.isEmpty()) {
+            batch = Queue.dequeue();
+            NotFull.wakeAll();
+            return true;
+        }
+        return !Finished;
+    }
+
+    void cancel()
+    {
+        QMutexLocker lock(&Mutex);
+        Cancelled = true;
+        NotFull.wakeAll();
+    }
+
+    int featuresRead() const
+    {
+        QMutexLocker lock(&Mutex);
+        return Read;
+    }
+
+protected:
+    virtual void run();
+
+private:
+    struct Chunk
+    {
+        OGRCoordinateTransformation* Transformation;
+        OGRFeature** Features;
+        int Count;
+    };
+    static void transformChunk(Chunk& C);
+    bool push(QVector<OGRFeature*>& batch);
+    bool isCancelled() const
+    {
+        QMutexLocker lock(&Mutex);
+        return Cancelled;
+    }
+
+    QList<OGRLayer*> Layers;
+    OGRSpatialReference* Srs;
+    OGRSpatialReference* Wgs84;
+    QVector<OGRCoordinateTransformation*> Transformations;
+
+    mutable QMutex Mutex;
+    QWaitCondition NotEmpty;
+    QWaitCondition NotFull;
+    QQueue< QVector<OGRFeature*> > Queue;
+    int Read;
+    bool Finished;
+    bool Cancelled;
+};
+
+#define GDAL_BATCH_SIZE 1024
+#define GDAL_MAX_QUEUED_BATCHES 4
+
+void GdalFeatureReader::transformChunk(Chunk& C)
+{
+    for (int i=0; i<C.Count; ++i)
+        C.Features[i]->GetGeometryRef()->transform(C.Transformation);
+}
+
+bool GdalFeatureReader::push(QVector<OGRFeature*>& batch)
+{
+    if (batch.isEmpty())
+        return true;
+
+    QList<Chunk> Chunks;
+    int ChunkSize = (batch.size() + Transformations.size() - 1) / Transformations.size();
+    for (int i=0; i<Transformations.size() && i*ChunkSize < batch.size(); ++i) {
+        Chunk C;
+        C.Transformation = Transformations[i];
+        C.Features = batch.data() + i*ChunkSize;
+        C.Count = qMin(ChunkSize, batch.size() - i*ChunkSize);
+        Chunks << C;
+    }
+    QtConcurrent::blockingMap(Chunks, transformChunk);
+
+    QMutexLocker lock(&Mutex);
+    while (Queue.size() >= GDAL_MAX_QUEUED_BATCHES && !Cancelled)
+        NotFull.wait(&Mutex);
+    if (Cancelled) {
+        foreach (OGRFeature* F, batch)
+            OGRFeature::DestroyFeature(F);
+        batch.clear();
+        return false;
+    }
+    Read += batch.size();
+    Queue.enqueue(batch);
+    batch = QVector<OGRFeature*>();
+    batch.reserve(GDAL_BATCH_SIZE);
+    NotEmpty.wakeAll();
+    return true;
+}
+
+void GdalFeatureReader::run()
+{
+    for (int i=0; i<qMax(1, QThread::idealThreadCount()); ++i) {
+        OGRCoordinateTransformation* T = OGRCreateCoordinateTransformation(Srs, Wgs84);
+        if (!T)
+            break;
+        Transformations << T;
+    }
+
+    if (Transformations.size()) {
+        QVector<OGRFeature*> Pending;
+        Pending.reserve(GDAL_BATCH_SIZE);
+        OGRFeature *poFeature;
+        for (int l=0; l<Layers.size() && !isCancelled(); ++l) {
+            while (!isCancelled() && (poFeature = Layers[l]->GetNextFeature()) != NULL) {
+                if (!poFeature->GetGeometryRef()) {
+                    qDebug( "no geometry" );
+                    OGRFeature::DestroyFeature(poFeature);
+                    continue;
+                }
+                Pending << poFeature;
+                if (Pending.size() >= GDAL_BATCH_SIZE && !push(Pending))
+                    break;
+            }
+        }
+        if (!isCancelled())
+            push(Pending);
+        foreach (OGRFeature* F, Pending)
+            OGRFeature::DestroyFeature(F);
+    }
+
+    foreach (OGRCoordinateTransformation* T, Transformations)
+        delete T;
+    Transformations.clear();
+
+    QMutexLocker lock(&Mutex);
+    Finished = true;
+    NotEmpty.wakeAll();
+}
+
+static void importFields(Feature* F, OGRFeature* poFeature)
+{
+    for (int i=0; i<poFeature->GetFieldCount(); ++i) {
+        OGRFieldDefn  *fd = poFeature->GetFieldDefnRef(i);
+        QString k = QString::fromUtf8(fd->GetNameRef());
+        if (k == "osm_id") {
+            F->setId(IFeature::FId(F->getType(), (qint64)poFeature->GetFieldAsDouble(i)));
+#ifndef FRISIUS_BUILD
+        } else if (k == "osm_version") {
+            F->setVersionNumber(poFeature->GetFieldAsInteger(i));
+        } else if (k == "osm_timestamp") {
+            F->setTime(QDateTime::fromTime_t(poFeature->GetFieldAsInteger(i)));
+#endif
+        } else {
+            if (!g_Merk_NoGuardedTagsImport) {
+                k.prepend("_");
+                k.append("_");
+            }
+            F->setTag(k, QString::fromUtf8(poFeature->GetFieldAsString(i)));
+        }
+    }
+}
+
 // import the  input
 
 #ifndef GDAL2
@@ -407,65 +595,55 @@ bool ImportExportGdal::importGDALDataset(GDALDataset* poDS, Layer* aLayer, bool
     progress.setRange(0, 0);
     progress.show();
 
-    int totimported = 0;
-    OGRFeature *poFeature;
-    for (int l=0; l<poDS->GetLayerCount() && !progress.wasCanceled(); ++l) {
+    QList<OGRLayer*> Layers;
+    int Total = 0;
+    for (int l=0; l<poDS->GetLayerCount(); ++l) {
         poLayer = poDS->GetLayer(l);
+        Layers << poLayer;
 
         int sz = poLayer->GetFeatureCount(FALSE);
-        if (sz != -1)
-            progress.setMaximum(progress.maximum()+sz);
-
-        int curImported = 0;
-//        poLayer->ResetReading();
-        while( (poFeature = poLayer->GetNextFeature()) != NULL && !progress.wasCanceled())
-        {
-            OGRGeometry *poGeometry;
-
-            poGeometry = poFeature->GetGeometryRef();
-            if( poGeometry != NULL) {
-                // qDebug( "GeometryType : %d,", poGeometry->getGeometryType() );
-
-                poGeometry->transform(toWGS84);
+        if (sz != -1 && Total != -1)
+            Total += sz;
+        else
+            Total = -1;
+    }
+    if (Total > 0)
+        progress.setMaximum(Total);
 
-                Feature* F = parseGeometry(aLayer, poGeometry);
-                if (F) {
-                    for (int i=0; i<poFeature->GetFieldCount(); ++i) {
-                        OGRFieldDefn  *fd = poFeature->GetFieldDefnRef(i);
-                        QString k = QString::fromUtf8(fd->GetNameRef());
-                        if (k == "osm_id") {
-                            F->setId(IFeature::FId(F->getType(), (qint64)poFeature->GetFieldAsDouble(i)));
-#ifndef FRISIUS_BUILD
-                        } else if (k == "osm_version") {
-                            F->setVersionNumber(poFeature->GetFieldAsInteger(i));
-                        } else if (k == "osm_timestamp") {
-                            F->setTime(QDateTime::fromTime_t(poFeature->GetFieldAsInteger(i)));
-#endif
-                        } else {
-                            if (!g_Merk_NoGuardedTagsImport) {
-                                k.prepend("_");
-                                k.append("_");
-                            }
-                            F->setTag(k, QString::fromUtf8(poFeature->GetFieldAsString(i)));
-                        }
-                    }
+    // Features are read and reprojected on other threads, while they are
+    // turned into nodes and ways here a batch at a time
+    int totimported = 0;
+    {
+        GdalFeatureReader Reader(Layers, theSrs, &wgs84srs);
+        Reader.start();
+
+        QElapsedTimer Refresh;
+        Refresh.start();
+        QVector<OGRFeature*> Batch;
+        while (Reader.takeBatch(Batch)) {
+            foreach (OGRFeature* poFeature, Batch) {
+                if (!progress.wasCanceled()) {
+                    Feature* F = parseGeometry(aLayer, poFeature->GetGeometryRef());
+                    if (F)
+                        importFields(F, poFeature);
+                    ++totimported;
                 }
-                ++curImported;
-                ++totimported;
+                OGRFeature::DestroyFeature(poFeature);
+            }
+
+            if (Refresh.elapsed() > 100 || Batch.isEmpty()) {
                 progress.setLabelText(QApplication::tr("Imported: %1").arg(totimported));
                 if (progress.maximum() > 0)
-                    progress.setValue(totimported);
+                    progress.setValue(qMin(totimported, progress.maximum()));
                 qApp->processEvents();
+                Refresh.restart();
             }
-            else
-            {
-                qDebug( "no geometry" );
-            }
-//            if (progress.maximum() != 0)
-//                progress.setValue(progress.value()+1);
+            if (progress.wasCanceled())
+                Reader.cancel();
         }
-        qDebug() << "Layer #" << l << "Features#:" << curImported;
+        qDebug() << "Features#:" << Reader.featuresRead();
     }
+    theSrs->Release();
 
     pointHash.clear();
 
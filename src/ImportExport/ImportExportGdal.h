@@ -14,6 +14,9 @@
 
 #include "IImportExport.h"
 
+#include <QHash>
+#include <QPair>
+
 #include <ogrsf_frmts.h>
 #include <gdal.h>
 #include <gdal_priv.h>
@@ -67,7 +70,9 @@ protected:
 #undef GDALDataset
 
 private:
-    QHash<OGRPoint, Node*> pointHash;
+    // Vertices shared between geometries, by WGS84 position quantised to
+    // 1e-7 degree
+    QHash<QPair<qint64, qint64>, Node*> pointHash;
 };
 
 #endif
@@ -13,11 +13,22 @@
 //
 
 #include <QApplication>
+#include <QFile>
+#include <QLabel>
 #include <QMessageBox>
+#include <QProgressBar>
+#include <QProgressDialog>
 #include <QDateTime>
+#include <QQueue>
+#include <QThread>
+#include <QtConcurrent>
+
+#include <algorithm>
 
 #include "ImportExportPBF.h"
 #include "Global.h"
+#include "IProgressWindow.h"
+#include "MainWindow.h"
 
 #include "zlib.h"
 //#include "bzlib.h"
@@ -26,6 +37,12 @@
 #define MAX_BLOCK_HEADER_SIZE ( 64 * 1024 )
 #define MAX_BLOB_SIZE ( 32 * 1024 * 1024 )
 
+// Writer settings: coordinates in 100 nanodegrees, timestamps in seconds,
+// and at most 8000 entities per PrimitiveBlock (as osmosis/osmium do).
+#define EXPORT_GRANULARITY 100
+#define EXPORT_DATE_GRANULARITY 1000
+#define EXPORT_BLOCK_SIZE 8000
+
 ImportExportPBF::ImportExportPBF(Document* doc)
     : IImportExport(doc)
 {
@@ -36,10 +53,392 @@ ImportExportPBF::~ImportExportPBF()
 {
 }
 
+/* Plain copy of a feature, taken on the GUI thread so that the encoding
+   workers never touch the live document. */
+struct ImportExportPBF::ExportEntity
+{
+    qint64 id;
+    qint64 lat;
+    qint64 lon;
+    int version;
+    qint64 timestamp;
+    QString user;
+    QList< QPair<QString, QString> > tags;
+    QVector<qint64> refs;
+    QVector<int> types;
+    QStringList roles;
+};
+
+struct ImportExportPBF::ExportBlock
+{
+    Mode mode;
+    QVector<ExportEntity> entities;
+};
+
+static bool idLessThan(const Feature* a, const Feature* b)
+{
+    return a->id().numId < b->id().numId;
+}
+
+void ImportExportPBF::snapshotFeature(const Feature* F, ExportEntity& E)
+{
+    E.id = F->id().numId;
+    E.lat = E.lon = 0;
+#ifndef FRISIUS_BUILD
+    E.version = F->versionNumber();
+    E.timestamp = F->time().isValid() ? F->time().toTime_t() : 0;
+    E.user = F->user();
+#else
+    E.version = 0;
+    E.timestamp = 0;
+#endif
+    for (int i=0; i<F->tagSize(); ++i) {
+        QString k = F->tagKey(i);
+        if (k.startsWith('_') && k.endsWith('_'))
+            continue;
+        E.tags.append(qMakePair(k, F->tagValue(i)));
+    }
+}
+
+void ImportExportPBF::snapshotNode(const Node* N, ExportEntity& E)
+{
+    snapshotFeature(N, E);
+    E.lat = qRound64(N->position().y() * NANO / EXPORT_GRANULARITY);
+    E.lon = qRound64(N->position().x() * NANO / EXPORT_GRANULARITY);
+}
+
+void ImportExportPBF::snapshotWay(const Way* W, ExportEntity& E)
+{
+    snapshotFeature(W, E);
+    E.refs.reserve(W->size());
+    for (int i=0; i<W->size(); ++i) {
+        const Node* N = W->getNode(i);
+        if (N->isVirtual())
+            continue;
+        if (!E.refs.isEmpty() && E.refs.last() == N->id().numId)
+            continue;
+        E.refs.append(N->id().numId);
+    }
+}
+
+void ImportExportPBF::snapshotRelation(const Relation* R, ExportEntity& E)
+{
+    snapshotFeature(R, E);
+    for (int i=0; i<R->size(); ++i) {
+        const Feature* F = R->get(i);
+        if (CHECK_RELATION(F))
+            E.types.append(OSMPBF::Relation::RELATION);
+        else if (CHECK_WAY(F))
+            E.types.append(OSMPBF::Relation::WAY);
+        else if (CHECK_NODE(F))
+            E.types.append(OSMPBF::Relation::NODE);
+        else
+            continue;
+        E.refs.append(F->id().numId);
+        E.roles.append(R->getRole(i));
+    }
+}
+
+/* Frame a serialized message as BlobHeader + zlib Blob, ready to append to the file. */
+QByteArray ImportExportPBF::packBlob(const std::string& type, const std::string& data)
+{
+    OSMPBF::Blob blob;
+    uLongf zsize = compressBound(data.size());
+    std::string zdata(zsize, '\0');
+    if (compress2((Bytef*)&zdata[0], &zsize, (const Bytef*)data.data(), data.size(), Z_DEFAULT_COMPRESSION) == Z_OK) {
+        zdata.resize(zsize);
+        blob.set_raw_size(data.size());
+        blob.set_zlib_data(zdata);
+    } else {
+        blob.set_raw(data);
+    }
+    std::string blobData;
+    blob.SerializeToString(&blobData);
+
+    OSMPBF::BlobHeader header;
+    header.set_type(type);
+    header.set_datasize(blobData.size());
+    std::string headerData;
+    header.SerializeToString(&headerData);
+
+    quint32 size = headerData.size();
+    QByteArray out;
+    out.reserve(4 + headerData.size() + blobData.size());
+    out.append(char((size >> 24) & 0xff));
+    out.append(char((size >> 16) & 0xff));
+    out.append(char((size >> 8) & 0xff));
+    out.append(char(size & 0xff));
+    out.append(headerData.data(), headerData.size());
+    out.append(blobData.data(), blobData.size());
+    return out;
+}
+
+/* Build, serialize and compress one PrimitiveBlock. Runs on a worker thread. */
+QByteArray ImportExportPBF::encodeBlock(const ExportBlock& block)
+{
+    // Per-block string table, most frequent strings first so that they get
+    // the shortest varints. Index 0 is reserved for the empty string.
+    QHash<QString, int> counts;
+    foreach (const ExportEntity& E, block.entities) {
+        for (int i=0; i<E.tags.size(); ++i) {
+            ++counts[E.tags[i].first];
+            ++counts[E.tags[i].second];
+        }
+        foreach (const QString& role, E.roles)
+            ++counts[role];
+        ++counts[E.user];
+    }
+    QVector< QPair<int, QString> > sorted;
+    sorted.reserve(counts.size());
+    QHashIterator<QString, int> it(counts);
+    while (it.hasNext()) {
+        it.next();
+        if (!it.key().isEmpty())
+            sorted.append(qMakePair(-it.value(), it.key()));
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    OSMPBF::PrimitiveBlock pb;
+    pb.set_granularity(EXPORT_GRANULARITY);
+    pb.set_date_granularity(EXPORT_DATE_GRANULARITY);
+
+    QHash<QString, int> sid;
+    OSMPBF::StringTable* table = pb.mutable_stringtable();
+    table->add_s("");
+    sid[QString()] = 0;
+    for (int i=0; i<sorted.size(); ++i) {
+        const QByteArray utf8 = sorted[i].second.toUtf8();
+        table->add_s(utf8.constData(), utf8.size());
+        sid[sorted[i].second] = i+1;
+    }
+
+    OSMPBF::PrimitiveGroup* group = pb.add_primitivegroup();
+    switch (block.mode) {
+    case ModeDense: {
+        OSMPBF::DenseNodes* dense = group->mutable_dense();
+        bool hasTags = false;
+        foreach (const ExportEntity& E, block.entities)
+            if (!E.tags.isEmpty()) {
+                hasTags = true;
+                break;
+            }
+
+        qint64 lastId = 0, lastLat = 0, lastLon = 0;
+#ifndef FRISIUS_BUILD
+        OSMPBF::DenseInfo* info = dense->mutable_denseinfo();
+        qint64 lastTimestamp = 0;
+        int lastUserSid = 0;
+#endif
+        foreach (const ExportEntity& E, block.entities) {
+            dense->add_id(E.id - lastId);
+            dense->add_lat(E.lat - lastLat);
+            dense->add_lon(E.lon - lastLon);
+            lastId = E.id;
+            lastLat = E.lat;
+            lastLon = E.lon;
+#ifndef FRISIUS_BUILD
+            int userSid = sid.value(E.user);
+            info->add_version(E.version);
+            info->add_timestamp(E.timestamp - lastTimestamp);
+            info->add_changeset(0);
+            info->add_uid(0);
+            info->add_user_sid(userSid - lastUserSid);
+            lastTimestamp = E.timestamp;
+            lastUserSid = userSid;
+#endif
+            if (hasTags) {
+                for (int i=0; i<E.tags.size(); ++i) {
+                    dense->add_keys_vals(sid.value(E.tags[i].first));
+                    dense->add_keys_vals(sid.value(E.tags[i].second));
+                }
+                dense->add_keys_vals(0);
+            }
+        }
+        break;
+    }
+    case ModeWay:
+        foreach (const ExportEntity& E, block.entities) {
+            OSMPBF::Way* way = group->add_ways();
+            way->set_id(E.id);
+            for (int i=0; i<E.tags.size(); ++i) {
+                way->add_keys(sid.value(E.tags[i].first));
+                way->add_vals(sid.value(E.tags[i].second));
+            }
+#ifndef FRISIUS_BUILD
+            OSMPBF::Info* info = way->mutable_info();
+            info->set_version(E.version);
+            info->set_timestamp(E.timestamp);
+            info->set_user_sid(sid.value(E.user));
+#endif
+            qint64 lastRef = 0;
+            foreach (qint64 ref, E.refs) {
+                way->add_refs(ref - lastRef);
+                lastRef = ref;
+            }
+        }
+        break;
+    case ModeRelation:
+        foreach (const ExportEntity& E, block.entities) {
+            OSMPBF::Relation* rel = group->add_relations();
+            rel->set_id(E.id);
+            for (int i=0; i<E.tags.size(); ++i) {
+                rel->add_keys(sid.value(E.tags[i].first));
+                rel->add_vals(sid.value(E.tags[i].second));
+            }
+#ifndef FRISIUS_BUILD
+            OSMPBF::Info* info = rel->mutable_info();
+            info->set_version(E.version);
+            info->set_timestamp(E.timestamp);
+            info->set_user_sid(sid.value(E.user));
+#endif
+            qint64 lastRef = 0;
+            for (int i=0; i<E.refs.size(); ++i) {
+                rel->add_roles_sid(sid.value(E.roles[i]));
+                rel->add_memids(E.refs[i] - lastRef);
+                rel->add_types((OSMPBF::Relation::MemberType)E.types[i]);
+                lastRef = E.refs[i];
+            }
+        }
+        break;
+    case ModeNode:
+        break;
+    }
+
+    std::string data;
+    pb.SerializeToString(&data);
+    return packBlob("OSMData", data);
+}
+
+bool ImportExportPBF::writeHeader(const CoordBox& bbox)
+{
+    OSMPBF::HeaderBlock header;
+    header.add_required_features("OsmSchema-V0.6");
+    header.add_required_features("DenseNodes");
+    header.set_writingprogram(QString("%1 %2").arg(qApp->applicationName()).arg(STRINGIFY(VERSION)).toUtf8().constData());
+    if (!bbox.isNull()) {
+        OSMPBF::HeaderBBox* box = header.mutable_bbox();
+        box->set_left(qRound64(bbox.left() * NANO));
+        box->set_right(qRound64(bbox.right() * NANO));
+        box->set_top(qRound64(bbox.top() * NANO));
+        box->set_bottom(qRound64(bbox.bottom() * NANO));
+    }
+
+    std::string data;
+    header.SerializeToString(&data);
+    QByteArray out = packBlob("OSMHeader", data);
+    return Device->write(out) == out.size();
+}
+
 // export
-bool ImportExportPBF::export_(const QList<Feature *>& /*featList*/)
+bool ImportExportPBF::export_(const QList<Feature *>& featList)
 {
-    return false;
+    if (!IImportExport::export_(featList))
+        return false;
+    if (!Device || !Device->isOpen())
+        return false;
+
+    QList<Feature*> nodes, ways, relations;
+    CoordBox bbox;
+    foreach (Feature* F, theFeatures) {
+        if (F->isDeleted() || F->isVirtual())
+            continue;
+        if (Node* N = CAST_NODE(F)) {
+            nodes.append(N);
+            if (bbox.isNull())
+                bbox = CoordBox(N->position(), N->position());
+            else
+                bbox.merge(N->position());
+        } else if (CAST_WAY(F))
+            ways.append(F);
+        else if (CAST_RELATION(F))
+            relations.append(F);
+    }
+    // OSM tools expect each type sorted by id
+    std::sort(nodes.begin(), nodes.end(), idLessThan);
+    std::sort(ways.begin(), ways.end(), idLessThan);
+    std::sort(relations.begin(), relations.end(), idLessThan);
+
+    IProgressWindow* aProgressWindow = dynamic_cast<IProgressWindow*>(g_Merk_MainWindow);
+    QProgressDialog* dlg = aProgressWindow ? aProgressWindow->getProgressDialog() : NULL;
+    QProgressBar* Bar = aProgressWindow ? aProgressWindow->getProgressBar() : NULL;
+    QLabel* Lbl = aProgressWindow ? aProgressWindow->getProgressLabel() : NULL;
+    if (dlg)
+        dlg->setWindowTitle(QApplication::tr("PBF Export"));
+    if (Bar) {
+        Bar->setTextVisible(false);
+        Bar->setMaximum(nodes.size() + ways.size() + relations.size());
+        Bar->setValue(0);
+    }
+    if (Lbl)
+        Lbl->setText(QApplication::tr("Exporting PBF..."));
+    if (dlg)
+        dlg->show();
+
+    // Blocks are encoded and compressed on the thread pool; the GUI thread
+    // snapshots the features and writes the results back in file order.
+    const int maxPending = qMax(2, QThread::idealThreadCount() * 2);
+    QQueue< QFuture<QByteArray> > pending;
+    QQueue<int> pendingSizes;
+    bool OK = writeHeader(bbox);
+
+    const QList<Feature*>* lists[3] = { &nodes, &ways, &relations };
+    const Mode modes[3] = { ModeDense, ModeWay, ModeRelation };
+    for (int l=0; l<3 && OK; ++l) {
+        const QList<Feature*>& list = *lists[l];
+        for (int start=0; start<list.size() && OK; start += EXPORT_BLOCK_SIZE) {
+            ExportBlock block;
+            block.mode = modes[l];
+            int end = qMin(start + EXPORT_BLOCK_SIZE, list.size());
+            block.entities.resize(end - start);
+            for (int i=start; i<end; ++i) {
+                ExportEntity& E = block.entities[i - start];
+                switch (block.mode) {
+                case ModeDense:
+                    snapshotNode(STATIC_CAST_NODE(list[i]), E);
+                    break;
+                case ModeWay:
+                    snapshotWay(STATIC_CAST_WAY(list[i]), E);
+                    break;
+                default:
+                    snapshotRelation(STATIC_CAST_RELATION(list[i]), E);
+                    break;
+                }
+            }
+            pending.enqueue(QtConcurrent::run(&ImportExportPBF::encodeBlock, block));
+            pendingSizes.enqueue(end - start);
+
+            while (pending.size() >= maxPending && OK) {
+                QByteArray out = pending.dequeue().result();
+                OK = (Device->write(out) == out.size());
+                if (Bar)
+                    Bar->setValue(Bar->value() + pendingSizes.dequeue());
+                else
+                    pendingSizes.dequeue();
+                qApp->processEvents();
+                if (dlg && dlg->wasCanceled())
+                    OK = false;
+            }
+        }
+    }
+
+    while (!pending.isEmpty()) {
+        QByteArray out = pending.dequeue().result();
+        if (OK)
+            OK = (Device->write(out) == out.size());
+        if (Bar)
+            Bar->setValue(Bar->value() + pendingSizes.dequeue());
+        else
+            pendingSizes.dequeue();
+    }
+
+    // Do not leave a truncated file behind
+    QFile* File = qobject_cast<QFile*>(Device);
+    if (!OK && ownDevice && File) {
+        File->close();
+        File->remove();
+    }
+
+    return OK;
 }
 
 /***************************************************/
@@ -51,7 +450,8 @@ This ripped code is part of MoNav.
 
 int convertNetworkByteOrder( char data[4] )
 {
-    return ( ( ( unsigned ) data[0] ) << 24 ) | ( ( ( unsigned ) data[1] ) << 16 ) | ( ( ( unsigned ) data[2] ) << 8 ) | ( unsigned ) data[3];
+    const unsigned char* u = ( const unsigned char* ) data;
+    return ( ( ( unsigned ) u[0] ) << 24 ) | ( ( ( unsigned ) u[1] ) << 16 ) | ( ( ( unsigned ) u[2] ) << 8 ) | ( unsigned ) u[3];
 }
 
 static void *SzAlloc( void *p, size_t size)
@@ -76,6 +76,17 @@ protected:
     QByteArray m_bzip2Buffer;
 
 protected:
+    struct ExportEntity;
+    struct ExportBlock;
+
+    static void snapshotFeature(const Feature* F, ExportEntity& E);
+    static void snapshotNode(const Node* N, ExportEntity& E);
+    static void snapshotWay(const Way* W, ExportEntity& E);
+    static void snapshotRelation(const Relation* R, ExportEntity& E);
+    static QByteArray encodeBlock(const ExportBlock& block);
+    static QByteArray packBlob(const std::string& type, const std::string& data);
+    bool writeHeader(const CoordBox& bbox);
+
     void loadGroup();
     void loadBlock();
     bool readNextBlock();
@@ -16,9 +16,159 @@
 #include "../ImportExport/ImportNMEA.h"
 #include "Global.h"
 
+#include <string.h>
+
+#define NMEA_MAX_FIELDS 32
+#define NMEA_BATCH 1024
+
+static const double Pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+    1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+/* One sentence, split into fields that point into the file buffer.
+   Field 0 is the address (talker and sentence type, e.g. "GPRMC"). */
+struct NmeaSentence
+{
+    const char* Field[NMEA_MAX_FIELDS];
+    int Length[NMEA_MAX_FIELDS];
+    int Count;
+
+    bool is(int i, char c) const
+    {
+        return i < Count && Length[i] == 1 && *Field[i] == c;
+    }
+};
+
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/* Split the next sentence starting at or after Cur. Sentences with a wrong
+   checksum, too many fields, or another '$' before their end (two receivers
+   writing to the same log) are skipped. */
+static bool nextSentence(const char*& Cur, const char* End, NmeaSentence& S)
+{
+    while (Cur < End) {
+        const char* c = (const char*)memchr(Cur, '$', End - Cur);
+        if (!c) {
+            Cur = End;
+            return false;
+        }
+        ++c;
+
+        quint8 Sum = 0;
+        bool Ok = true;
+        S.Count = 0;
+        S.Field[0] = c;
+        for (; c < End && *c != '*' && *c != '\r' && *c != '\n' && *c != '$'; ++c) {
+            Sum ^= quint8(*c);
+            if (*c != ',')
+                continue;
+            if (S.Count == NMEA_MAX_FIELDS-1) {
+                Ok = false;
+                break;
+            }
+            S.Length[S.Count] = c - S.Field[S.Count];
+            ++S.Count;
+            S.Field[S.Count] = c + 1;
+        }
+        if (!Ok || (c < End && *c == '$')) {
+            Cur = c;
+            continue;
+        }
+        S.Length[S.Count] = c - S.Field[S.Count];
+        ++S.Count;
+
+        if (c < End && *c == '*') {
+            if (End - c < 3 || hexValue(c[1]) < 0 || hexValue(c[2]) < 0
+                    || ((hexValue(c[1]) << 4) | hexValue(c[2])) != Sum) {
+                Cur = c + 1;
+                continue;
+            }
+            c += 3;
+        }
+        Cur = c;
+        return true;
+    }
+    return false;
+}
+
+/* Plain decimals only; false on an empty or malformed field */
+static bool toReal(const char* s, int n, qreal& v)
+{
+    const char* e = s + n;
+    bool neg = false;
+    if (s < e && (*s == '-' || *s == '+')) {
+        neg = (*s == '-');
+        ++s;
+    }
+    qint64 mantissa = 0;
+    int digits = 0;
+    int decimals = 0;
+    for (; s < e && isDigit(*s); ++s, ++digits)
+        mantissa = mantissa*10 + (*s - '0');
+    if (s < e && *s == '.') {
+        for (++s; s < e && isDigit(*s); ++s, ++digits, ++decimals)
+            mantissa = mantissa*10 + (*s - '0');
+    }
+    if (s != e || digits == 0 || digits > 15)
+        return false;
+
+    v = qreal(mantissa) / Pow10[decimals];
+    if (neg)
+        v = -v;
+    return true;
+}
+
+/* Like QString::toDouble(): 0 if the field is empty or malformed */
+static inline qreal realOrZero(const NmeaSentence& S, int i)
+{
+    qreal v = 0.;
+    if (i < S.Count)
+        toReal(S.Field[i], S.Length[i], v);
+    return v;
+}
+
+static inline int toInt(const char* s, int n)
+{
+    int v = 0;
+    for (int i=0; i<n; ++i) {
+        if (!isDigit(s[i]))
+            return -1;
+        v = v*10 + (s[i] - '0');
+    }
+    return v;
+}
+
+/* "ddmm.mmmm" (or "dddmm.mmmm" with \a DegDigits 3) to decimal degrees */
+static bool toDegrees(const char* s, int n, int DegDigits, qreal& v)
+{
+    if (n <= DegDigits)
+        return false;
+    int Deg = toInt(s, DegDigits);
+    qreal Min;
+    if (Deg < 0 || !toReal(s + DegDigits, n - DegDigits, Min))
+        return false;
+    v = Deg + Min / 60.0;
+    return true;
+}
+
 
 ImportNMEA::ImportNMEA(Document* doc)
- : IImportExport(doc), curAltitude(0.0)
+ : IImportExport(doc), curAltitude(0.0), CachedHour(-1), CachedHourTime(0)
 {
 }
 
@@ -35,72 +185,93 @@ bool ImportNMEA::export_(const QList<Feature *>& featList)
     return false;
 }
 
+void ImportNMEA::flushPoints(TrackSegment* TS)
+{
+    TS->add(Pending);
+    Pending.clear();
+}
+
+/* Store the current segment (if it got any point) and start a new one */
+TrackSegment* ImportNMEA::closeSegment(TrackSegment* TS)
+{
+    flushPoints(TS);
+    if (TS->size())
+        theLayer->add(TS);
+    else
+        g_backend.deallocFeature(theLayer, TS);
+    return g_backend.allocSegment(theLayer);
+}
+
 // import the  input
 bool ImportNMEA::import(Layer* aLayer)
 {
     bool goodFix = false;
     bool goodFix3D = true;
-    QTextStream in(Device);
 
     theLayer = dynamic_cast <TrackLayer *> (aLayer);
     theList = new CommandList(QApplication::tr("Import NMEA"), NULL);
 
-    TrackSegment* TS = g_backend.allocSegment(aLayer);
+    // Map the file when possible; the tokenizer only needs a contiguous buffer
+    QByteArray Content;
+    const char* Begin = NULL;
+    qint64 Size = 0;
+    QFile* File = qobject_cast<QFile*>(Device);
+    if (File && File->size() > 0) {
+        Begin = (const char*)File->map(0, File->size());
+        Size = File->size();
+    }
+    if (!Begin) {
+        Content = Device->readAll();
+        Begin = Content.constData();
+        Size = Content.size();
+    }
+    const char* Cur = Begin;
+    const char* End = Begin + Size;
 
-    while (!in.atEnd()) {
-        QString line = in.readLine();
+    TrackSegment* TS = g_backend.allocSegment(aLayer);
 
-        if (line.left(3) != "$GP")
+    NmeaSentence S;
+    while (nextSentence(Cur, End, S)) {
+        if (S.Length[0] != 5 || S.Field[0][0] != 'G' || S.Field[0][1] != 'P')
             continue;
 
-        QString command = line.mid(3, 3);
-        if (command == "GSA") {
+        const char* command = S.Field[0] + 2;
+        if (!memcmp(command, "GSA", 3)) {
             bool prevGoodFix = goodFix3D;
-            goodFix3D = importGSA(line);
-            if (!goodFix3D && prevGoodFix) {
-                if (TS->size())
-                    theLayer->add(TS);
-                else
-                    g_backend.deallocFeature(aLayer, TS);
-                TS = g_backend.allocSegment(aLayer);
-            }
+            goodFix3D = importGSA(S);
+            if (!goodFix3D && prevGoodFix)
+                TS = closeSegment(TS);
         } else
-        if (command == "GSV") {
+        if (!memcmp(command, "GSV", 3)) {
             if (goodFix && goodFix3D)
-                importGSV(line);
+                importGSV(S);
         } else
-        if (command == "GGA") {
+        if (!memcmp(command, "GGA", 3)) {
             bool prevGoodFix = goodFix;
-            goodFix = importGGA(line);
-            if (!goodFix && prevGoodFix) {
-                if (TS->size())
-                    theLayer->add(TS);
-                else
-                    g_backend.deallocFeature(aLayer, TS);
-                TS = g_backend.allocSegment(aLayer);
-            }
+            goodFix = importGGA(S);
+            if (!goodFix && prevGoodFix)
+                TS = closeSegment(TS);
         } else
-        if (command == "GLL") {
+        if (!memcmp(command, "GLL", 3)) {
             bool prevGoodFix = goodFix;
-            goodFix = importGLL(line);
-            if (!goodFix && prevGoodFix) {
-                if (TS->size())
-                    theLayer->add(TS);
-                else
-                    g_backend.deallocFeature(aLayer, TS);
-                TS = g_backend.allocSegment(aLayer);
-            }
+            goodFix = importGLL(S);
+            if (!goodFix && prevGoodFix)
+                TS = closeSegment(TS);
         } else
-        if (command == "RMC") {
+        if (!memcmp(command, "RMC", 3)) {
             if (goodFix && goodFix3D) {
-                TrackNode* p = importRMC(line);
-                if (p)
-                    TS->add(p);
+                TrackNode* p = importRMC(S);
+                if (p) {
+                    Pending << p;
+                    if (Pending.size() >= NMEA_BATCH)
+                        flushPoints(TS);
+                }
             }
         } else
         {/* Not handled */}
     }
 
+    flushPoints(TS);
     if (TS->size())
         theLayer->add(TS);
     else
@@ -110,121 +281,109 @@ bool ImportNMEA::import(Layer* aLayer)
     return true;
 }
 
-bool ImportNMEA::importGSA (QString line)
+bool ImportNMEA::importGSA (const NmeaSentence& S)
 {
-    if (line.count('$') > 1)
-        return false;
-
-    QStringList tokens = line.split(",");
-    if (tokens.size() < 3)
+    if (S.Count < 3)
         return false;
 
-    QString autoSelectFix = tokens[1];
-    int Fix3D = tokens[2].toInt();
+    int Fix3D = toInt(S.Field[2], S.Length[2]);
 
-    // qreal PDOP = tokens[15].toDouble();
-    // qreal HDOP = tokens[16].toDouble();
-    // qreal VDOP = tokens[17].toDouble();
+    // qreal PDOP = realOrZero(S, 15);
+    // qreal HDOP = realOrZero(S, 16);
+    // qreal VDOP = realOrZero(S, 17);
 
     return (Fix3D == 1 ? false: true);
 }
 
-bool ImportNMEA::importGSV (QString /* line */)
+bool ImportNMEA::importGSV (const NmeaSentence& /* S */)
 {
     return true;
 }
 
-bool ImportNMEA::importGGA (QString line)
+bool ImportNMEA::importGGA (const NmeaSentence& S)
 {
-    if (line.count('$') > 1)
+    if (S.Count < 10)
         return false;
 
-    QStringList tokens = line.split(",");
-
-    if (tokens.size() < 10)
+    int fix = toInt(S.Field[6], S.Length[6]);
+    if (fix <= 0)
         return false;
 
-    //qreal lat = tokens[2].left(2).toDouble();
-    //qreal lon = tokens[4].left(3).toDouble();
+    curAltitude = realOrZero(S, 9);
 
-    //qreal latmin = tokens[2].mid(2).toDouble();
-    //lat += latmin / 60.0;
-    //if (tokens[3] != "N")
-    //	lat = -lat;
-    //qreal lonmin = tokens[4].mid(3).toDouble();
-    //lon += lonmin / 60.0;
-    //if (tokens[5] != "E")
-    //	lon = -lon;
+    return true;
+}
 
-    int fix = tokens[6].toInt();
-    if (fix == 0)
+bool ImportNMEA::importGLL (const NmeaSentence& S)
+{
+    if (S.Count < 7)
         return false;
 
-    curAltitude = tokens[9].toDouble();
+    if (!S.is(6, 'A'))
+        return false;
 
     return true;
 }
 
-bool ImportNMEA::importGLL (QString line)
+/* NMEA times are UTC. QDateTime is only asked for the start of each hour
+   of track; the minutes and seconds are added rather than parsed per point. */
+bool ImportNMEA::utcTime(const char* Date, const char* Time, uint& t)
 {
-    if (line.count('$') > 1)
-        return false;
-
-    QStringList tokens = line.split(",");
-
-    if (tokens.size() < 7)
+    int day = toInt(Date, 2);
+    int month = toInt(Date+2, 2);
+    int year = toInt(Date+4, 2);
+    int hour = toInt(Time, 2);
+    int min = toInt(Time+2, 2);
+    int sec = toInt(Time+4, 2);
+    if (day < 0 || month < 0 || year < 0 || hour < 0 || min < 0 || sec < 0)
         return false;
-
-    if (tokens[6] != "A")
+    if (min > 59 || sec > 59)
         return false;
 
+    int Hour = ((year*100 + month)*100 + day)*100 + hour;
+    if (Hour != CachedHour) {
+        year += (year < 70 ? 2000 : 1900);
+        QDateTime date(QDate(year, month, day), QTime(hour, 0), Qt::UTC);
+        if (!date.isValid())
+            return false;
+        CachedHour = Hour;
+        CachedHourTime = date.toTime_t();
+    }
+    t = CachedHourTime + min*60 + sec;
     return true;
 }
 
-TrackNode* ImportNMEA::importRMC (QString line)
+TrackNode* ImportNMEA::importRMC (const NmeaSentence& S)
 {
-    if (line.count('$') > 1)
+    if (S.Count < 10)
         return NULL;
 
-    QStringList tokens = line.split(",");
-    if (tokens.size() < 10)
+    if (!S.is(2, 'A'))
         return NULL;
 
-    //int time = tokens[1];
-    if (tokens[2] != "A")
+    qreal lat, lon;
+    if (!toDegrees(S.Field[3], S.Length[3], 2, lat) || !toDegrees(S.Field[5], S.Length[5], 3, lon))
         return NULL;
-
-    qreal lat = tokens[3].left(2).toDouble();
-    qreal latmin = tokens[3].mid(2).toDouble();
-    lat += latmin / 60.0;
-    if (tokens[4] != "N")
+    if (!S.is(4, 'N'))
         lat = -lat;
-    qreal lon = tokens[5].left(3).toDouble();
-    qreal lonmin = tokens[5].mid(3).toDouble();
-    lon += lonmin / 60.0;
-    if (tokens[6] != "E")
+    if (!S.is(6, 'E'))
         lon = -lon;
-    qreal speed = tokens[7].toDouble() * 1.852;
-    //int date = token[9];
-
-    QString strDate = tokens[9] + tokens[1];
-    QDateTime date = QDateTime::fromString(strDate, "ddMMyyHHmmss.zzz");
-    if (!date.isValid()) date = QDateTime::fromString(strDate, "ddMMyyHHmmss.z");
-    if (!date.isValid()) date = QDateTime::fromString(strDate, "ddMMyyHHmmss");
-    if (!date.isValid()) {
-        return NULL;
-    }
+    qreal speed = realOrZero(S, 7) * 1.852;
 
-    if (date.date().year() < 1970)
-        date = date.addYears(100);
-    //date.setTimeSpec(Qt::UTC);
+    // ddmmyy and hhmmss[.sss]; fractions of a second are dropped, as the
+    // node only keeps whole seconds anyway
+    uint time;
+    if (S.Length[9] != 6 || S.Length[1] < 6 || (S.Length[1] > 6 && S.Field[1][6] != '.'))
+        return NULL;
+    if (!utcTime(S.Field[9], S.Field[1], time))
+        return NULL;
 
     TrackNode* Pt = g_backend.allocTrackNode(theLayer, Coord(lon,lat));
     theLayer->add(Pt);
     Pt->setLastUpdated(Feature::Log);
     Pt->setElevation(curAltitude);
     Pt->setSpeed(speed);
-    Pt->setTime(date);
+    Pt->setTime(time);
 
     return Pt;
 }
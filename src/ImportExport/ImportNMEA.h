@@ -14,6 +14,8 @@
 
 #include "IImportExport.h"
 
+struct NmeaSentence;
+
 /**
     @author cbro <cbro@semperpax.com>
 */
@@ -32,13 +34,20 @@ public:
 private:
     TrackLayer* theLayer;
 
-    bool importGSA (QString line);
-    bool importGSV (QString line);
-    bool importGGA (QString line);
-    bool importGLL (QString line);
-    TrackNode* importRMC (QString line);
+    bool importGSA (const NmeaSentence& S);
+    bool importGSV (const NmeaSentence& S);
+    bool importGGA (const NmeaSentence& S);
+    bool importGLL (const NmeaSentence& S);
+    TrackNode* importRMC (const NmeaSentence& S);
+
+    void flushPoints(TrackSegment* TS);
+    TrackSegment* closeSegment(TrackSegment* TS);
+    bool utcTime(const char* Date, const char* Time, uint& t);
 
     qreal curAltitude;
+    QList<TrackNode*> Pending;
+    int CachedHour;
+    uint CachedHourTime;
 
 };
 
@@ -20,7 +20,6 @@
 #include <QProgressBar>
 #include <QProgressDialog>
 #include <QDomDocument>
-#include <QXmlAttributes>
 
 
 OSMHandler::OSMHandler(Document* aDoc, Layer* aLayer, Layer* aConflict)
@@ -28,42 +27,42 @@ OSMHandler::OSMHandler(Document* aDoc, Layer* aLayer, Layer* aConflict)
 {
 }
 
-void OSMHandler::parseTag(const QXmlAttributes &atts)
+void OSMHandler::parseTags(const OsmXmlPrimitive& P)
 {
     if (!Current) return;
 
-    Current->setTag(atts.value("k"),atts.value("v"));
+    for (int i=0; i<P.tags.size(); ++i)
+        Current->setTag(P.tags[i].first, P.tags[i].second);
 }
 
-void parseStandardAttributes(const QXmlAttributes& atts, Feature* F)
+static void parseStandardAttributes(const OsmXmlPrimitive& P, Feature* F)
 {
 #ifndef FRISIUS_BUILD
-    QString ts = atts.value("timestamp");
-    QDateTime time = QDateTime::fromString(ts.left(19), Qt::ISODate);
-    if (!time.isValid())
-        time = QDateTime::currentDateTime();
-    QString user = atts.value("user");
-    F->setTime(time);
-    F->setUser(user);
-    QString version = atts.value("version");
-    if (!version.isEmpty())
-        F->setVersionNumber(version.toInt());
+    if (P.hasTime)
+        F->setTime(P.time);
+    else
+        F->setTime(QDateTime::currentDateTime());
+    F->setUser(P.user);
+    if (P.version != -1)
+        F->setVersionNumber(P.version);
+#else
+    Q_UNUSED(P);
+    Q_UNUSED(F);
 #endif
 }
 
-void OSMHandler::parseNode(const QXmlAttributes& atts)
+void OSMHandler::parseNode(const OsmXmlPrimitive& P)
 {
-    qreal Lat = atts.value("lat").toDouble();
-    qreal Lon = atts.value("lon").toDouble();
-    QString id = atts.value("id");
-    Node* Pt = CAST_NODE(theDocument->getFeature(IFeature::FId(IFeature::Point, id.toLongLong())));
+    qreal Lat = P.lat;
+    qreal Lon = P.lon;
+    Node* Pt = CAST_NODE(theDocument->getFeature(IFeature::FId(IFeature::Point, P.id)));
     if (Pt)
     {
         Node* userPt = Pt;
         Pt = g_backend.allocNode(theLayer, Coord(Lon,Lat));
-        Pt->setId(IFeature::FId(IFeature::Point | IFeature::Conflict, id.toLongLong()));
+        Pt->setId(IFeature::FId(IFeature::Point | IFeature::Conflict, P.id));
         Pt->setLastUpdated(Feature::OSMServerConflict);
-        parseStandardAttributes(atts,Pt);
+        parseStandardAttributes(P,Pt);
 
         if (userPt->lastUpdated() == Feature::User)
         {
@@ -115,45 +114,35 @@ void OSMHandler::parseNode(const QXmlAttributes& atts)
     else
     {
         Pt = g_backend.allocNode(theLayer, Coord(Lon,Lat));
-        Pt->setId(IFeature::FId(IFeature::Point, id.toLongLong()));
+        Pt->setId(IFeature::FId(IFeature::Point, P.id));
         Pt->setLastUpdated(Feature::OSMServer);
         theLayer->add(Pt);
         NewFeature = true;
     }
 
     if (NewFeature) {
-        parseStandardAttributes(atts,Pt);
+        parseStandardAttributes(P,Pt);
         Current = Pt;
+        parseTags(P);
         for (int i=0; i<Pt->sizeParents(); ++i) {
             if (Pt->getParent(i)->isDeleted()) continue;
             if (Way* w = CAST_WAY(Pt->getParent(i)))
                 touchedWays << w;
         }
-    } else
-        Current = NULL;
-}
-
-void OSMHandler::parseNd(const QXmlAttributes& atts)
-{
-    Way* R = dynamic_cast<Way*>(Current);
-    if (!R) return;
-    Node *Part = Feature::getNodeOrCreatePlaceHolder(theDocument, theLayer, IFeature::FId(IFeature::Point, atts.value("ref").toLongLong()));
-    if (NewFeature)
-        R->add(Part);
+    }
+    Current = NULL;
 }
 
-void OSMHandler::parseWay(const QXmlAttributes& atts)
+void OSMHandler::parseWay(const OsmXmlPrimitive& P)
 {
-    QString id = atts.value("id");
-    QString ts = atts.value("timestamp"); ts.truncate(19);
-    Way* R = CAST_WAY(theDocument->getFeature(IFeature::FId(IFeature::LineString, id.toLongLong())));
+    Way* R = CAST_WAY(theDocument->getFeature(IFeature::FId(IFeature::LineString, P.id)));
     if (R)
     {
         Way* userRd = R;
         R = g_backend.allocWay(theLayer);
-        R->setId(IFeature::FId(IFeature::LineString | IFeature::Conflict, id.toLongLong()));
+        R->setId(IFeature::FId(IFeature::LineString | IFeature::Conflict, P.id));
         R->setLastUpdated(Feature::OSMServerConflict);
-        parseStandardAttributes(atts,R);
+        parseStandardAttributes(P,R);
 
         if (userRd->lastUpdated() == Feature::User)
         {
@@ -201,50 +190,33 @@ void OSMHandler::parseWay(const QXmlAttributes& atts)
     else
     {
         R = g_backend.allocWay(theLayer);
-        R->setId(IFeature::FId(IFeature::LineString, id.toLongLong()));
+        R->setId(IFeature::FId(IFeature::LineString, P.id));
         R->setLastUpdated(Feature::OSMServer);
         theLayer->add(R);
         NewFeature = true;
     }
 
     if (NewFeature) {
-        parseStandardAttributes(atts,R);
+        parseStandardAttributes(P,R);
         Current = R;
+        parseTags(P);
         touchedWays << R;
-    } else
-        Current = NULL;
-}
-
-void OSMHandler::parseMember(const QXmlAttributes& atts)
-{
-    Relation* R = dynamic_cast<Relation*>(Current);
-    if (!R)
-        return;
-    QString Type = atts.value("type");
-    Feature* F = 0;
-    if (Type == "node")
-        F = Feature::getNodeOrCreatePlaceHolder(theDocument, theLayer, IFeature::FId(IFeature::Point, atts.value("ref").toLongLong()));
-    else if (Type == "way")
-        F = Feature::getWayOrCreatePlaceHolder(theDocument, theLayer, IFeature::FId(IFeature::LineString, atts.value("ref").toLongLong()));
-    else if (Type == "relation")
-        F = Feature::getRelationOrCreatePlaceHolder(theDocument, theLayer, IFeature::FId(IFeature::OsmRelation, atts.value("ref").toLongLong()));
-
-    if (F && F != R)
-        R->add(atts.value("role"),F);
+        for (int i=0; i<P.refs.size(); ++i)
+            R->add(Feature::getNodeOrCreatePlaceHolder(theDocument, theLayer, IFeature::FId(IFeature::Point, P.refs[i])));
+    }
+    Current = NULL;
 }
 
-void OSMHandler::parseRelation(const QXmlAttributes& atts)
+void OSMHandler::parseRelation(const OsmXmlPrimitive& P)
 {
-    QString id = atts.value("id");
-    QString ts = atts.value("timestamp"); ts.truncate(19);
-    Relation* R = CAST_RELATION(theDocument->getFeature(IFeature::FId(IFeature::OsmRelation, id.toLongLong())));
+    Relation* R = CAST_RELATION(theDocument->getFeature(IFeature::FId(IFeature::OsmRelation, P.id)));
     if (R)
     {
         Relation* userR = R;
         R = g_backend.allocRelation(theLayer);
-        R->setId(IFeature::FId(IFeature::OsmRelation | IFeature::Conflict, id.toLongLong()));
+        R->setId(IFeature::FId(IFeature::OsmRelation | IFeature::Conflict, P.id));
         R->setLastUpdated(Feature::OSMServerConflict);
-        parseStandardAttributes(atts,R);
+        parseStandardAttributes(P,R);
 
         if (R->lastUpdated() == Feature::User)
         {
@@ -292,42 +264,100 @@ void OSMHandler::parseRelation(const QXmlAttributes& atts)
     else
     {
         R = g_backend.allocRelation(theLayer);
-        R->setId(IFeature::FId(IFeature::OsmRelation, id.toLongLong()));
+        R->setId(IFeature::FId(IFeature::OsmRelation, P.id));
         R->setLastUpdated(Feature::OSMServer);
         NewFeature = true;
         theLayer->add(R);
     }
 
     if (NewFeature) {
-        parseStandardAttributes(atts,R);
+        parseStandardAttributes(P,R);
         Current = R;
+        parseTags(P);
         touchedRelations << R;
-    } else
-        Current = NULL;
+
+        for (int i=0; i<P.members.size(); ++i) {
+            const OsmXmlMember& M = P.members[i];
+            Feature* F = 0;
+            if (M.type == IFeature::Point)
+                F = Feature::getNodeOrCreatePlaceHolder(theDocument, theLayer, IFeature::FId(IFeature::Point, M.ref));
+            else if (M.type == IFeature::LineString)
+                F = Feature::getWayOrCreatePlaceHolder(theDocument, theLayer, IFeature::FId(IFeature::LineString, M.ref));
+            else if (M.type == IFeature::OsmRelation)
+                F = Feature::getRelationOrCreatePlaceHolder(theDocument, theLayer, IFeature::FId(IFeature::OsmRelation, M.ref));
+
+            if (F && F != R)
+                R->add(M.role,F);
+        }
+    }
+    Current = NULL;
 }
 
-bool OSMHandler::startElement ( const QString &, const QString & /* localName */, const QString & qName, const QXmlAttributes & atts )
+void OSMHandler::apply(const OsmXmlPrimitive& P)
 {
-    if (qName == "tag")
-        parseTag(atts);
-    else if (qName == "node")
-        parseNode(atts);
-    else if (qName == "nd")
-        parseNd(atts);
-    else if (qName == "way")
-        parseWay(atts);
-    else if (qName == "member")
-        parseMember(atts);
-    else if (qName == "relation")
-        parseRelation(atts);
-    return true;
+    switch (P.type) {
+    case IFeature::Point:
+        parseNode(P);
+        break;
+    case IFeature::LineString:
+        parseWay(P);
+        break;
+    case IFeature::OsmRelation:
+        parseRelation(P);
+        break;
+    }
 }
 
-bool OSMHandler::endElement ( const QString &, const QString & /* localName */, const QString & qName )
+void OSMHandler::apply(const OsmXmlBatch& B)
 {
-    if (qName == "node")
-        Current = 0;
-    return true;
+    for (int i=0; i<B.size(); ++i)
+        apply(B[i]);
+}
+
+// Ids per multi-fetch request; keeps the URL well under common length limits
+#define RESOLVE_BATCH_SIZE 250
+// Multi-fetch requests in flight at once
+#define RESOLVE_CONCURRENT_REQUESTS 4
+
+// Adds the placeholders below F: direct members, and the nodes of downloaded
+// member ways. Member relations are expanded in the next round.
+static void queueMissing(Feature* F, QSet<Feature*>& Missing)
+{
+    if (F->lastUpdated() == Feature::NotYetDownloaded) {
+        Missing << F;
+        return;
+    }
+    for (int i=0; i<F->size(); ++i) {
+        Feature* C = F->get(i);
+        if (!C)
+            continue;
+        if (C->lastUpdated() == Feature::NotYetDownloaded)
+            Missing << C;
+        else if (CAST_WAY(C))
+            queueMissing(C, Missing);
+    }
+}
+
+struct ResolveRequest
+{
+    char type;
+    QList<qint64> ids;
+};
+
+static void queueRequest(TiledDownloader& Rcv, QList<ResolveRequest>& Requests, Downloader* theDownloader, const ResolveRequest& Req)
+{
+    QString What;
+    switch (Req.type) {
+    case IFeature::Point: What = "nodes"; break;
+    case IFeature::LineString: What = "ways"; break;
+    default: What = "relations"; break;
+    }
+
+    QStringList Ids;
+    foreach (qint64 id, Req.ids)
+        Ids << QString::number(id);
+    Rcv.add(QUrl(M_PREFS->getOsmApiUrl()+theDownloader->getURLToFetch(What)+Ids.join(",")));
+    Requests << Req;
 }
 
 static bool downloadToResolve(const QList<Feature*>& Resolution, QWidget* aParent, Document* theDocument, Layer* theLayer, Downloader* theDownloader)
@@ -341,48 +371,117 @@ static bool downloadToResolve(const QList<Feature*>& Resolution, QWidget* aParen
     QProgressBar* Bar = aProgressWindow->getProgressBar();
     QLabel* Lbl = aProgressWindow->getProgressLabel();
 
-    for (int i=0; i<Resolution.size(); i++ )
+    TiledDownloader Rcv(M_PREFS->getOsmUser(), M_PREFS->getOsmPassword(), RESOLVE_CONCURRENT_REQUESTS);
+    QObject::connect(dlg, SIGNAL(canceled()), &Rcv, SLOT(cancel()));
+    QList<ResolveRequest> Requests;
+
+    OSMHandler theHandler(theDocument,theLayer,NULL);
+    QSet<Feature*> Requested;
+    QList<Feature*> Frontier = Resolution;
+    QSet<Feature*> Gone;
+
+    // Resolve level by level: each round fetches, in batched multi-fetch
+    // requests, the placeholders found below the previous round's features,
+    // until no relation has unresolved members left
+    for (int Level=1; !Frontier.isEmpty(); ++Level)
     {
-        QUrl URL = M_PREFS->getOsmApiUrl()+theDownloader->getURLToFetchFull(Resolution[i]);
-        Lbl->setText(QApplication::translate("Downloader","Downloading unresolved %1 of %2").arg(i+1).arg(Resolution.size()));
-        if (theDownloader->go(URL))
+        QSet<Feature*> Missing;
+        foreach (Feature* F, Frontier)
+            queueMissing(F, Missing);
+        Missing.subtract(Requested);
+        if (Missing.isEmpty())
+            break;
+        Requested.unite(Missing);
+
+        QHash<char, QList<qint64> > ByType;
+        foreach (Feature* F, Missing) {
+            char type = (char)(F->id().type & (IFeature::Point | IFeature::LineString | IFeature::OsmRelation));
+            ByType[type] << F->id().numId;
+        }
+        QHashIterator<char, QList<qint64> > it(ByType);
+        while (it.hasNext()) {
+            it.next();
+            for (int i=0; i<it.value().size(); i+=RESOLVE_BATCH_SIZE) {
+                ResolveRequest Req;
+                Req.type = it.key();
+                Req.ids = it.value().mid(i, RESOLVE_BATCH_SIZE);
+                queueRequest(Rcv, Requests, theDownloader, Req);
+            }
+        }
+
+        int Index, Result;
+        QByteArray Content;
+        QString ResultText, ErrorText;
+        while (Rcv.next(Index, Content, Result, ResultText, ErrorText))
         {
-            if (theDownloader->resultCode() == 410) {
-                theLayer->remove(Resolution[i]);
-                delete Resolution[i];
+            Bar->setMaximum(Rcv.size());
+            Bar->setValue(Rcv.taken());
+            Lbl->setText(QApplication::translate("Downloader","Downloading unresolved %1 of %2 (level %3)").arg(Rcv.taken()).arg(Rcv.size()).arg(Level));
+
+            const ResolveRequest Req = Requests[Index];
+            if (Result == 404 || Result == 410) {
+                // One deleted or unknown id fails the whole request; bisect to find it
+                if (Req.ids.size() > 1) {
+                    ResolveRequest Half;
+                    Half.type = Req.type;
+                    Half.ids = Req.ids.mid(0, Req.ids.size()/2);
+                    queueRequest(Rcv, Requests, theDownloader, Half);
+                    Half.ids = Req.ids.mid(Req.ids.size()/2);
+                    queueRequest(Rcv, Requests, theDownloader, Half);
+                } else if (Result == 410) {
+                    Feature* F = theDocument->getFeature(IFeature::FId(Req.type, Req.ids.first()));
+                    if (F)
+                        Gone << F;
+                }
+                continue;
             }
-            else
-            {
-                Lbl->setText(QApplication::translate("Downloader","Parsing unresolved %1 of %2").arg(i+1).arg(Resolution.size()));
-
-                QByteArray ba(theDownloader->content());
-                QBuffer  File(&ba);
-                File.open(QIODevice::ReadOnly);
-
-                OSMHandler theHandler(theDocument,theLayer,NULL);
-
-                QXmlSimpleReader xmlReader;
-                xmlReader.setContentHandler(&theHandler);
-                QXmlInputSource source;
-                QByteArray buf(File.read(10240));
-                source.setData(buf);
-                xmlReader.parse(&source,true);
-                while (!File.atEnd())
-                {
-                    QByteArray buf(File.read(20480));
-                    source.setData(buf);
-                    xmlReader.parseContinue();
-                    qApp->processEvents();
-                    if (dlg && dlg->wasCanceled())
-                        break;
+            if (Result != 200) {
+                qDebug() << "downloadToResolve: unexpected http status code" << Result << ResultText << ErrorText;
+                if (!Result)
+                    return false;
+                continue;
+            }
+
+            OsmXmlBatch batch;
+            OsmXmlParser parser(Content.constData(), Content.size());
+            parser.parseAll(batch);
+            // Multi-fetch answers deleted elements with visible="false"
+            for (int i=0; i<batch.size(); ++i) {
+                if (batch[i].visible) {
+                    theHandler.apply(batch[i]);
+                } else if (Feature* F = theDocument->getFeature(IFeature::FId(batch[i].type, batch[i].id))) {
+                    Gone << F;
                 }
             }
-            Resolution[i]->setLastUpdated(Feature::OSMServer);
+            qApp->processEvents();
         }
-        else
+        if (Rcv.isCanceled())
             return false;
-        Bar->setValue(i);
+
+        // Next round: fetched ways for their nodes, fetched relations for
+        // their members
+        Frontier.clear();
+        foreach (Feature* F, Missing) {
+            if (F->lastUpdated() == Feature::NotYetDownloaded || Gone.contains(F))
+                continue;
+            if (CAST_WAY(F) || CAST_RELATION(F))
+                Frontier << F;
+        }
+    }
+
+    // Deleted on the server: drop their references first, as they may be
+    // members of each other, then drop them
+    foreach (Feature* F, Gone)
+        while (F->sizeParents())
+            CAST_FEATURE(F->getParent(0))->remove(F);
+    foreach (Feature* F, Gone) {
+        if (F->layer())
+            F->layer()->remove(F);
+        delete F;
     }
+    foreach (Feature* F, Resolution)
+        if (!Gone.contains(F))
+            F->setLastUpdated(Feature::OSMServer);
     return true;
 }
 
@@ -418,7 +517,7 @@ static bool resolveNotYetDownloaded(QWidget* aParent, Document* theDocument, Lay
         }
         if (MustResolve.size())
         {
-            Bar->setMaximum(MustResolve.size());
+            Bar->setMaximum(1);
             Bar->setValue(0);
             if (!downloadToResolve(MustResolve,aParent,theDocument,theLayer, theDownloader))
                 return false;
@@ -443,74 +542,85 @@ static bool deleteIncompleteRelations(QWidget* /*aParent*/, Document* /*theDocum
     return true;
 }
 
-bool importOSM(QWidget* aParent, QIODevice& File, Document* theDocument, Layer* theLayer, Downloader* theDownloader)
+OSMImport::OSMImport(QWidget* aParent, Document* aDoc, Layer* aLayer, Downloader* aDownloader)
+    : theParent(aParent), theDocument(aDoc), theLayer(aLayer), theDownloader(aDownloader)
+    , conflictLayer(0), theHandler(0), dlg(0), Finished(false)
 {
-    QDomDocument DomDoc;
-    QString ErrorStr;
-    /* int ErrorLine; */
-    /* int ErrorColumn; */
-
-    QProgressDialog* dlg = NULL;
     QProgressBar* Bar = NULL;
     QLabel* Lbl = NULL;
-    IProgressWindow* aProgressWindow = dynamic_cast<IProgressWindow*>(aParent);
+    IProgressWindow* aProgressWindow = dynamic_cast<IProgressWindow*>(theParent);
     if (aProgressWindow) {
         dlg = aProgressWindow->getProgressDialog();
         if (dlg) {
-            dlg->setWindowTitle(QApplication::translate("Downloader", "Parsing..."));
-
             Bar = aProgressWindow->getProgressBar();
-            Bar->setTextVisible(false);
-
             Lbl = aProgressWindow->getProgressLabel();
-            Lbl->setText(QApplication::translate("Downloader","Parsing XML"));
-
-            dlg->show();
         }
     }
 
     if (theDownloader)
         theDownloader->setAnimator(dlg,Lbl,Bar,false);
-    Layer* conflictLayer = new DrawingLayer(QApplication::translate("Downloader","Conflicts from %1").arg(theLayer->name()));
+    conflictLayer = new DrawingLayer(QApplication::translate("Downloader","Conflicts from %1").arg(theLayer->name()));
     theDocument->add(conflictLayer);
 
-    OSMHandler theHandler(theDocument,theLayer,conflictLayer);
+    theHandler = new OSMHandler(theDocument,theLayer,conflictLayer);
+}
 
-    QXmlSimpleReader xmlReader;
-    xmlReader.setContentHandler(&theHandler);
-    QXmlInputSource source;
-    QByteArray buf(File.read(10240));
-    source.setData(buf);
-    xmlReader.parse(&source,true);
+OSMImport::~OSMImport()
+{
+    if (!Finished)
+        finish(true);
+    delete theHandler;
+}
+
+bool OSMImport::add(const char* data, qint64 size, QProgressBar* Bar)
+{
+    // Progress in kB, so that files over 2GB don't overflow the bar
     if (Bar) {
-        Bar->setMaximum(File.size());
-        Bar->setValue(Bar->value()+buf.size());
+        Bar->setMaximum(int(size / 1024) + 1);
+        Bar->setValue(0);
     }
 
-    while (!File.atEnd())
+    // The XML is parsed on a worker thread; the document is only touched here
+    OsmXmlParser parser(data, size);
+    parser.start();
+    OsmXmlBatch batch;
+    bool WasCanceled = false;
+    while (parser.takeBatch(batch))
     {
-        QByteArray buf(File.read(20480));
-        source.setData(buf);
-        xmlReader.parseContinue();
+        theHandler->apply(batch);
         if (Bar)
-            Bar->setValue(Bar->value()+buf.size());
+            Bar->setValue(int(parser.bytesParsed() / 1024));
         qApp->processEvents();
-        if (dlg && dlg->wasCanceled())
+        if (dlg && dlg->wasCanceled()) {
+            parser.cancel();
+            WasCanceled = true;
             break;
+        }
     }
+    parser.wait();
+    if (parser.hasError())
+        qDebug() << "importOSM:" << parser.errorString();
 
-    bool WasCanceled = false;
-    if (dlg)
-        WasCanceled = dlg->wasCanceled();
+    return !WasCanceled;
+}
+
+bool OSMImport::finish(bool WasCanceled)
+{
+    if (Finished)
+        return false;
+    Finished = true;
+
+    if (dlg && dlg->wasCanceled())
+        WasCanceled = true;
     if (!WasCanceled && M_PREFS->getResolveRelations())
-        WasCanceled = !resolveNotYetDownloaded(aParent,theDocument,theLayer,theDownloader);
+        WasCanceled = !resolveNotYetDownloaded(theParent,theDocument,theLayer,theDownloader);
     if (!WasCanceled && M_PREFS->getDeleteIncompleteRelations())
-        WasCanceled = !deleteIncompleteRelations(aParent,theDocument,theLayer,theDownloader);
+        WasCanceled = !deleteIncompleteRelations(theParent,theDocument,theLayer,theDownloader);
 
     if (WasCanceled)
     {
         theDocument->remove(conflictLayer);
-        delete conflictLayer;
+        SAFE_DELETE(conflictLayer);
         return false;
     }
     else
@@ -531,17 +641,17 @@ bool importOSM(QWidget* aParent, QIODevice& File, Document* theDocument, Layer*
 
         // Check for empty Roads/Relations and update virtual nodes
         QList<Feature*> EmptyFeature;
-        foreach (Way* w, theHandler.touchedWays) {
+        foreach (Way* w, theHandler->touchedWays) {
             if (!w->size())
                 EmptyFeature.push_back(w);
         }
-        foreach (Relation* r, theHandler.touchedRelations) {
+        foreach (Relation* r, theHandler->touchedRelations) {
             if (!r->size())
                 EmptyFeature.push_back(r);
         }
 
         if (EmptyFeature.size()) {
-            if (QMessageBox::warning(aParent,QApplication::translate("Downloader","Empty roads/relations detected"),
+            if (QMessageBox::warning(theParent,QApplication::translate("Downloader","Empty roads/relations detected"),
                     QApplication::translate("Downloader",
                     "Empty roads/relations are probably errors.\n"
                     "Do you want to mark them for deletion?"),
@@ -560,9 +670,9 @@ bool importOSM(QWidget* aParent, QIODevice& File, Document* theDocument, Layer*
 
         if (!conflictLayer->size()) {
             theDocument->remove(conflictLayer);
-            delete conflictLayer;
+            SAFE_DELETE(conflictLayer);
         } else {
-            QMessageBox::warning(aParent,QApplication::translate("Downloader","Conflicts have been detected"),
+            QMessageBox::warning(theParent,QApplication::translate("Downloader","Conflicts have been detected"),
                 QApplication::translate("Downloader",
                 "This means that some of the feature you modified"
                 " since your last download have since been modified by someone else on the server.\n"
@@ -576,20 +686,45 @@ bool importOSM(QWidget* aParent, QIODevice& File, Document* theDocument, Layer*
     return true;
 }
 
+static bool importOSM(QWidget* aParent, const char* data, qint64 size, Document* theDocument, Layer* theLayer, Downloader* theDownloader)
+{
+    QProgressBar* Bar = NULL;
+    IProgressWindow* aProgressWindow = dynamic_cast<IProgressWindow*>(aParent);
+    if (aProgressWindow) {
+        QProgressDialog* dlg = aProgressWindow->getProgressDialog();
+        if (dlg) {
+            dlg->setWindowTitle(QApplication::translate("Downloader", "Parsing..."));
+
+            Bar = aProgressWindow->getProgressBar();
+            Bar->setTextVisible(false);
+
+            QLabel* Lbl = aProgressWindow->getProgressLabel();
+            Lbl->setText(QApplication::translate("Downloader","Parsing XML"));
+
+            dlg->show();
+        }
+    }
+
+    OSMImport theImport(aParent, theDocument, theLayer, theDownloader);
+    bool WasCanceled = !theImport.add(data, size, Bar);
+    return theImport.finish(WasCanceled);
+}
+
 bool importOSM(QWidget* aParent, const QString& aFilename, Document* theDocument, Layer* theLayer)
 {
     QFile File(aFilename);
     if (!File.open(QIODevice::ReadOnly))
          return false;
-    return importOSM(aParent, File, theDocument, theLayer, 0 );
+
+    const uchar* data = File.map(0, File.size());
+    if (data)
+        return importOSM(aParent, (const char*)data, File.size(), theDocument, theLayer, 0);
+
+    QByteArray Content = File.readAll();
+    return importOSM(aParent, Content.constData(), Content.size(), theDocument, theLayer, 0);
 }
 
 bool importOSM(QWidget* aParent, QByteArray& Content, Document* theDocument, Layer* theLayer, Downloader* theDownloader)
 {
-    QBuffer File(&Content);
-    File.open(QIODevice::ReadOnly);
-    return importOSM(aParent, File, theDocument, theLayer, theDownloader);
+    return importOSM(aParent, Content.constData(), Content.size(), theDocument, theLayer, theDownloader);
 }
-
-
-
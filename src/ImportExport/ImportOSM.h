@@ -10,27 +10,29 @@ class Way;
 class Relation;
 
 class QByteArray;
+class QProgressBar;
+class QProgressDialog;
 class QString;
 class QWidget;
 
-#include <QXmlDefaultHandler>
 #include <QSet>
 
-class OSMHandler : public QXmlDefaultHandler
+#include "OsmXmlParser.h"
+
+/// Applies parsed OSM primitives to a layer, resolving conflicts with existing features
+class OSMHandler
 {
 public:
     OSMHandler(Document* aDoc, Layer* aLayer, Layer* aConflict);
 
-    virtual bool startElement ( const QString & namespaceURI, const QString & localName, const QString & qName, const QXmlAttributes & atts );
-    virtual bool endElement ( const QString & namespaceURI, const QString & localName, const QString & qName );
+    void apply(const OsmXmlPrimitive& P);
+    void apply(const OsmXmlBatch& B);
 
 private:
-    void parseNode(const QXmlAttributes & atts);
-    void parseTag(const QXmlAttributes & atts);
-    void parseWay(const QXmlAttributes & atts);
-    void parseNd(const QXmlAttributes & atts);
-    void parseMember(const QXmlAttributes & atts);
-    void parseRelation(const QXmlAttributes& atts);
+    void parseNode(const OsmXmlPrimitive& P);
+    void parseWay(const OsmXmlPrimitive& P);
+    void parseRelation(const OsmXmlPrimitive& P);
+    void parseTags(const OsmXmlPrimitive& P);
 
     Document* theDocument;
     Layer* theLayer;
@@ -43,6 +45,34 @@ public:
         QSet<Relation*> touchedRelations;
 };
 
+/**
+  One import into a layer, possibly fed from several OSM XML buffers (e.g. the
+  tiles of a large download). Features already present from an earlier buffer
+  are merged by OSMHandler like any other known feature; the conflict layer,
+  relation resolution and the clean-up questions are done once, in finish().
+*/
+class OSMImport
+{
+public:
+    OSMImport(QWidget* aParent, Document* aDoc, Layer* aLayer, Downloader* aDownloader);
+    ~OSMImport();
+
+    /// Parse \a data and apply it to the layer; returns false if canceled
+    bool add(const char* data, qint64 size, QProgressBar* Bar = 0);
+    /// Complete the import, or roll back the conflict layer if \a WasCanceled
+    bool finish(bool WasCanceled);
+
+private:
+    QWidget* theParent;
+    Document* theDocument;
+    Layer* theLayer;
+    Downloader* theDownloader;
+    Layer* conflictLayer;
+    OSMHandler* theHandler;
+    QProgressDialog* dlg;
+    bool Finished;
+};
+
 bool importOSM(QWidget* aParent, const QString& aFilename, Document* theDocument, Layer* theLayer);
 bool importOSM(QWidget* aParent, QByteArray& Content, Document* theDocument, Layer* theLayer, Downloader* theDownloader);
 
@@ -0,0 +1,511 @@
+#include "OsmXmlParser.h"
+
+#include "IFeature.h"
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QtDebug>
+
+#include <string.h>
+
+#define BATCH_SIZE 4096
+#define MAX_QUEUED_BATCHES 8
+#define MAX_INTERNED_LENGTH 32
+#define MAX_INTERNED_STRINGS 200000
+
+static const double Pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+    1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline bool equals(const char* s, int len, const char* lit)
+{
+    return (int)strlen(lit) == len && memcmp(s, lit, len) == 0;
+}
+
+static const char* findSequence(const char* s, const char* e, const char* seq)
+{
+    int n = strlen(seq);
+    while (s + n <= e) {
+        const char* c = (const char*)memchr(s, seq[0], e - s);
+        if (!c || c + n > e)
+            return NULL;
+        if (memcmp(c, seq, n) == 0)
+            return c;
+        s = c + 1;
+    }
+    return NULL;
+}
+
+static qint64 toInt64(const char* s, const char* e)
+{
+    bool neg = false;
+    if (s < e && (*s == '-' || *s == '+')) {
+        neg = (*s == '-');
+        ++s;
+    }
+    qint64 v = 0;
+    for (; s < e && isDigit(*s); ++s)
+        v = v*10 + (*s - '0');
+    return neg ? -v : v;
+}
+
+/* Plain decimals with up to 15 significant digits (which covers every
+   coordinate the API emits) are exact in a double, so a single division
+   gives the correctly rounded result. Anything else goes through the
+   library conversion. */
+static qreal toReal(const char* s, const char* e)
+{
+    const char* start = s;
+    bool neg = false;
+    if (s < e && (*s == '-' || *s == '+')) {
+        neg = (*s == '-');
+        ++s;
+    }
+    qint64 mantissa = 0;
+    int digits = 0;
+    int decimals = 0;
+    for (; s < e && isDigit(*s); ++s, ++digits)
+        mantissa = mantissa*10 + (*s - '0');
+    if (s < e && *s == '.') {
+        for (++s; s < e && isDigit(*s); ++s, ++digits, ++decimals)
+            mantissa = mantissa*10 + (*s - '0');
+    }
+    if (s != e || digits == 0 || digits > 15)
+        return QByteArray(start, e - start).toDouble();
+
+    qreal v = qreal(mantissa) / Pow10[decimals];
+    return neg ? -v : v;
+}
+
+static inline int toInt(const char* s, int n)
+{
+    int v = 0;
+    for (int i=0; i<n; ++i) {
+        if (!isDigit(s[i]))
+            return -1;
+        v = v*10 + (s[i] - '0');
+    }
+    return v;
+}
+
+/* "YYYY-MM-DDTHH:MM:SS", anything after the seconds is ignored (as the
+   previous QDateTime::fromString(ts.left(19)) did). */
+static bool toTime(const char* s, const char* e, uint& t)
+{
+    if (e - s < 19 || s[4] != '-' || s[7] != '-' || s[10] != 'T' || s[13] != ':' || s[16] != ':')
+        return false;
+    QDateTime dt(QDate(toInt(s, 4), toInt(s+5, 2), toInt(s+8, 2)),
+                 QTime(toInt(s+11, 2), toInt(s+14, 2), toInt(s+17, 2)));
+    if (!dt.isValid())
+        return false;
+    t = dt.toTime_t();
+    return true;
+}
+
+static QByteArray unescape(const char* s, int len)
+{
+    QByteArray out;
+    out.reserve(len);
+    const char* e = s + len;
+    while (s < e) {
+        if (*s != '&') {
+            out.append(*s++);
+            continue;
+        }
+        const char* semi = (const char*)memchr(s, ';', e - s);
+        if (!semi) {
+            out.append(s, e - s);
+            break;
+        }
+        const char* ent = s + 1;
+        int n = semi - ent;
+        if (equals(ent, n, "amp"))
+            out.append('&');
+        else if (equals(ent, n, "lt"))
+            out.append('<');
+        else if (equals(ent, n, "gt"))
+            out.append('>');
+        else if (equals(ent, n, "quot"))
+            out.append('"');
+        else if (equals(ent, n, "apos"))
+            out.append('\'');
+        else if (n > 1 && ent[0] == '#') {
+            bool ok;
+            uint code = (ent[1] == 'x' || ent[1] == 'X') ? QByteArray(ent+2, n-2).toUInt(&ok, 16) : QByteArray(ent+1, n-1).toUInt(&ok, 10);
+            if (ok && QChar::requiresSurrogates(code)) {
+                QChar pair[2] = { QChar(QChar::highSurrogate(code)), QChar(QChar::lowSurrogate(code)) };
+                out.append(QString(pair, 2).toUtf8());
+            } else if (ok)
+                out.append(QString(QChar(code)).toUtf8());
+        } else
+            out.append(s, semi + 1 - s);
+        s = semi + 1;
+    }
+    return out;
+}
+
+OsmXmlParser::OsmXmlParser(const char* data, qint64 size, QObject* parent)
+    : QThread(parent)
+    , Begin(data), End(data + size), Cur(data)
+    , InPrimitive(false), Sink(0)
+    , Parsed(0), Finished(false), Cancelled(false)
+{
+}
+
+OsmXmlParser::~OsmXmlParser()
+{
+    cancel();
+    wait();
+}
+
+bool OsmXmlParser::parseAll(OsmXmlBatch& out)
+{
+    Sink = &out;
+    bool ok = parse();
+    Sink = 0;
+    return ok;
+}
+
+bool OsmXmlParser::takeBatch(OsmXmlBatch& batch, int timeout)
+{
+    batch.clear();
+
+    QMutexLocker lock(&Mutex);
+    if (Queue.isEmpty() && !Finished)
+        NotEmpty.wait(&Mutex, timeout);
+    if (!Queue.isEmpty()) {
+        batch = Queue.dequeue();
+        NotFull.wakeAll();
+        return true;
+    }
+    return !Finished;
+}
+
+void OsmXmlParser::cancel()
+{
+    QMutexLocker lock(&Mutex);
+    Cancelled = true;
+    NotFull.wakeAll();
+}
+
+qint64 OsmXmlParser::bytesParsed() const
+{
+    QMutexLocker lock(&Mutex);
+    return Parsed;
+}
+
+bool OsmXmlParser::hasError() const
+{
+    QMutexLocker lock(&Mutex);
+    return !Error.isEmpty();
+}
+
+QString OsmXmlParser::errorString() const
+{
+    QMutexLocker lock(&Mutex);
+    return Error;
+}
+
+void OsmXmlParser::run()
+{
+    parse();
+
+    QMutexLocker lock(&Mutex);
+    Finished = true;
+    NotEmpty.wakeAll();
+}
+
+void OsmXmlParser::setError(const QString& msg)
+{
+    QMutexLocker lock(&Mutex);
+    Error = QString("%1 at offset %2").arg(msg).arg(Cur - Begin);
+}
+
+bool OsmXmlParser::parse()
+{
+    Cur = Begin;
+    while (Cur < End) {
+        const char* lt = (const char*)memchr(Cur, '<', End - Cur);
+        if (!lt)
+            break;
+        Cur = lt + 1;
+        if (!parseElement())
+            break;
+    }
+    if (InPrimitive)
+        finishPrimitive();
+    return flush(true) && Error.isEmpty();
+}
+
+bool OsmXmlParser::flush(bool force)
+{
+    if (!force && Pending.size() < BATCH_SIZE)
+        return true;
+
+    if (Sink) {
+        *Sink += Pending;
+        Pending.clear();
+        return true;
+    }
+
+    QMutexLocker lock(&Mutex);
+    while (Queue.size() >= MAX_QUEUED_BATCHES && !Cancelled)
+        NotFull.wait(&Mutex);
+    if (Cancelled)
+        return false;
+    if (!Pending.isEmpty())
+        Queue.enqueue(Pending);
+    Parsed = (force && Cur >= End) ? End - Begin : Cur - Begin;
+    Pending = OsmXmlBatch();
+    Pending.reserve(BATCH_SIZE);
+    NotEmpty.wakeAll();
+    return true;
+}
+
+bool OsmXmlParser::parseElement()
+{
+    if (Cur >= End)
+        return false;
+
+    const char* close;
+    switch (*Cur) {
+    case '?':
+        close = findSequence(Cur, End, "?>");
+        Cur = close ? close + 2 : End;
+        return true;
+    case '!':
+        if (End - Cur >= 3 && Cur[1] == '-' && Cur[2] == '-')
+            close = findSequence(Cur, End, "-->");
+        else if (End - Cur >= 8 && memcmp(Cur, "![CDATA[", 8) == 0)
+            close = findSequence(Cur, End, "]]>");
+        else
+            close = (const char*)memchr(Cur, '>', End - Cur);
+        if (!close) {
+            setError("Unterminated markup");
+            return false;
+        }
+        Cur = (const char*)memchr(close, '>', End - close) + 1;
+        return true;
+    case '/': {
+        const char* name = ++Cur;
+        while (Cur < End && *Cur != '>' && !isSpace(*Cur))
+            ++Cur;
+        int len = Cur - name;
+        close = (const char*)memchr(Cur, '>', End - Cur);
+        if (!close) {
+            setError("Unterminated end tag");
+            return false;
+        }
+        Cur = close + 1;
+        if (InPrimitive && (equals(name, len, "node") || equals(name, len, "way") || equals(name, len, "relation")))
+            return finishPrimitive();
+        return true;
+    }
+    default:
+        return startElement();
+    }
+}
+
+bool OsmXmlParser::startElement()
+{
+    enum { Other, ENode, EWay, ERelation, ETag, ENd, EMember } kind = Other;
+
+    const char* name = Cur;
+    while (Cur < End && *Cur != '>' && *Cur != '/' && !isSpace(*Cur))
+        ++Cur;
+    int nameLen = Cur - name;
+
+    if (equals(name, nameLen, "tag"))
+        kind = ETag;
+    else if (equals(name, nameLen, "nd"))
+        kind = ENd;
+    else if (equals(name, nameLen, "node"))
+        kind = ENode;
+    else if (equals(name, nameLen, "way"))
+        kind = EWay;
+    else if (equals(name, nameLen, "member"))
+        kind = EMember;
+    else if (equals(name, nameLen, "relation"))
+        kind = ERelation;
+
+    if (kind == ENode || kind == EWay || kind == ERelation) {
+        if (InPrimitive && !finishPrimitive())
+            return false;
+        Current = OsmXmlPrimitive();
+        Current.type = (kind == ENode) ? IFeature::Point : (kind == EWay) ? IFeature::LineString : IFeature::OsmRelation;
+        InPrimitive = true;
+    }
+
+    const char* key = 0;
+    int keyLen = 0;
+    const char* value = 0;
+    int valueLen = 0;
+    OsmXmlMember member;
+    member.type = 0;
+    member.ref = 0;
+    qint64 ref = 0;
+
+    bool selfClosing = false;
+    while (true) {
+        while (Cur < End && isSpace(*Cur))
+            ++Cur;
+        if (Cur >= End) {
+            setError("Unterminated start tag");
+            return false;
+        }
+        if (*Cur == '>') {
+            ++Cur;
+            break;
+        }
+        if (*Cur == '/') {
+            selfClosing = true;
+            ++Cur;
+            continue;
+        }
+
+        const char* an = Cur;
+        while (Cur < End && *Cur != '=' && *Cur != '>' && *Cur != '/' && !isSpace(*Cur))
+            ++Cur;
+        int anLen = Cur - an;
+        while (Cur < End && isSpace(*Cur))
+            ++Cur;
+        if (Cur >= End || *Cur != '=') {
+            setError("Malformed attribute");
+            return false;
+        }
+        ++Cur;
+        while (Cur < End && isSpace(*Cur))
+            ++Cur;
+        if (Cur >= End || (*Cur != '"' && *Cur != '\'')) {
+            setError("Unquoted attribute value");
+            return false;
+        }
+        char quote = *Cur++;
+        const char* av = Cur;
+        const char* ae = (const char*)memchr(Cur, quote, End - Cur);
+        if (!ae) {
+            setError("Unterminated attribute value");
+            return false;
+        }
+        Cur = ae + 1;
+
+        switch (kind) {
+        case ENode:
+        case EWay:
+        case ERelation:
+            if (equals(an, anLen, "id"))
+                Current.id = toInt64(av, ae);
+            else if (equals(an, anLen, "lat"))
+                Current.lat = toReal(av, ae);
+            else if (equals(an, anLen, "lon"))
+                Current.lon = toReal(av, ae);
+            else if (equals(an, anLen, "version"))
+                Current.version = (int)toInt64(av, ae);
+            else if (equals(an, anLen, "timestamp"))
+                Current.hasTime = toTime(av, ae, Current.time);
+            else if (equals(an, anLen, "user"))
+                Current.user = internedString(av, ae - av);
+            else if (equals(an, anLen, "visible"))
+                Current.visible = !equals(av, ae - av, "false");
+            break;
+        case ETag:
+            if (equals(an, anLen, "k")) {
+                key = av;
+                keyLen = ae - av;
+            } else if (equals(an, anLen, "v")) {
+                value = av;
+                valueLen = ae - av;
+            }
+            break;
+        case ENd:
+            if (equals(an, anLen, "ref"))
+                ref = toInt64(av, ae);
+            break;
+        case EMember:
+            if (equals(an, anLen, "type")) {
+                if (equals(av, ae - av, "node"))
+                    member.type = IFeature::Point;
+                else if (equals(av, ae - av, "way"))
+                    member.type = IFeature::LineString;
+                else if (equals(av, ae - av, "relation"))
+                    member.type = IFeature::OsmRelation;
+            } else if (equals(an, anLen, "ref"))
+                member.ref = toInt64(av, ae);
+            else if (equals(an, anLen, "role"))
+                member.role = internedString(av, ae - av);
+            break;
+        case Other:
+            break;
+        }
+    }
+
+    switch (kind) {
+    case ENode:
+    case EWay:
+    case ERelation:
+        if (selfClosing)
+            return finishPrimitive();
+        break;
+    case ETag:
+        if (InPrimitive && key)
+            Current.tags.append(qMakePair(internedString(key, keyLen),
+                                          valueLen <= MAX_INTERNED_LENGTH ? internedString(value, valueLen) : decodedString(value, valueLen)));
+        break;
+    case ENd:
+        if (InPrimitive && Current.type == IFeature::LineString)
+            Current.refs.append(ref);
+        break;
+    case EMember:
+        if (InPrimitive && Current.type == IFeature::OsmRelation && member.type)
+            Current.members.append(member);
+        break;
+    case Other:
+        break;
+    }
+    return true;
+}
+
+bool OsmXmlParser::finishPrimitive()
+{
+    InPrimitive = false;
+    Pending.append(Current);
+    return flush(false);
+}
+
+QString OsmXmlParser::decodedString(const char* s, int len)
+{
+    if (!len)
+        return QString();
+    if (memchr(s, '&', len))
+        return QString::fromUtf8(unescape(s, len));
+    return QString::fromUtf8(s, len);
+}
+
+QString OsmXmlParser::internedString(const char* s, int len)
+{
+    if (!len)
+        return QString();
+
+    const QByteArray raw = QByteArray::fromRawData(s, len);
+    QHash<QByteArray, QString>::const_iterator it = Strings.constFind(raw);
+    if (it != Strings.constEnd())
+        return it.value();
+
+    if (Strings.size() >= MAX_INTERNED_STRINGS)
+        Strings.clear();
+    QString str = decodedString(s, len);
+    Strings.insert(QByteArray(s, len), str);
+    return str;
+}
@@ -0,0 +1,110 @@
+#ifndef MERKAARTOR_OSMXMLPARSER_H_
+#define MERKAARTOR_OSMXMLPARSER_H_
+
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QQueue>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+/// A <member> of a relation, as read from the XML
+struct OsmXmlMember
+{
+    char type;          // IFeature::Point, LineString or OsmRelation
+    qint64 ref;
+    QString role;
+};
+
+/// One <node>, <way> or <relation> with its children, as read from the XML
+struct OsmXmlPrimitive
+{
+    OsmXmlPrimitive()
+        : type(0), id(0), lat(0.), lon(0.), version(-1), time(0), hasTime(false), visible(true) {}
+
+    char type;          // IFeature::Point, LineString or OsmRelation
+    qint64 id;
+    qreal lat;
+    qreal lon;
+    int version;        // -1 if absent
+    uint time;
+    bool hasTime;
+    bool visible;       // false for deleted elements, e.g. from multi-fetch calls
+    QString user;
+    QVector< QPair<QString, QString> > tags;
+    QVector<qint64> refs;
+    QVector<OsmXmlMember> members;
+};
+
+typedef QVector<OsmXmlPrimitive> OsmXmlBatch;
+
+/**
+  Pull parser for OSM XML.
+
+  Scans a contiguous buffer (usually a memory-mapped file) without building
+  any intermediate DOM or attribute lists; numbers are parsed straight from
+  the bytes and repeated strings (keys, common values, users, roles) are
+  interned. Parsing runs on its own thread and hands primitives over in
+  batches through a bounded queue, so that the GUI thread only has to apply
+  them to the document.
+*/
+class OsmXmlParser : public QThread
+{
+    Q_OBJECT
+
+public:
+    /// \a data must stay valid until the thread has finished
+    OsmXmlParser(const char* data, qint64 size, QObject* parent = 0);
+    ~OsmXmlParser();
+
+    /// Parse on the calling thread, appending everything to \a out
+    bool parseAll(OsmXmlBatch& out);
+
+    /// Get the next batch. Returns false once the parser is finished and the
+    /// queue is drained; may return true with an empty batch on timeout.
+    bool takeBatch(OsmXmlBatch& batch, int timeout = 100);
+    void cancel();
+
+    qint64 size() const { return End - Begin; }
+    qint64 bytesParsed() const;
+    bool hasError() const;
+    QString errorString() const;
+
+protected:
+    virtual void run();
+
+private:
+    bool parse();
+    bool flush(bool force);
+    void setError(const QString& msg);
+
+    bool parseElement();
+    bool startElement();
+    bool finishPrimitive();
+
+    QString internedString(const char* s, int len);
+    QString decodedString(const char* s, int len);
+
+    const char* Begin;
+    const char* End;
+    const char* Cur;
+
+    OsmXmlPrimitive Current;
+    bool InPrimitive;
+    OsmXmlBatch Pending;
+    OsmXmlBatch* Sink;
+    QHash<QByteArray, QString> Strings;
+
+    mutable QMutex Mutex;
+    QWaitCondition NotEmpty;
+    QWaitCondition NotFull;
+    QQueue<OsmXmlBatch> Queue;
+    qint64 Parsed;
+    bool Finished;
+    bool Cancelled;
+    QString Error;
+};
+
+#endif
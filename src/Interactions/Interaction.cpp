@@ -227,6 +227,7 @@ void FeatureSnapInteraction::updateSnap(QMouseEvent* event)
     //QTime Start(QTime::currentTime());
     CoordBox HotZone(XY_TO_COORD(event->pos()-QPoint(M_PREFS->getMaxGeoPicWidth()+5,M_PREFS->getMaxGeoPicWidth()+5)),XY_TO_COORD(event->pos()+QPoint(M_PREFS->getMaxGeoPicWidth()+5,M_PREFS->getMaxGeoPicWidth()+5)));
     CoordBox HotZoneSnap(XY_TO_COORD(event->pos()-QPoint(15,15)),XY_TO_COORD(event->pos()+QPoint(15,15)));
+    QRectF HotZoneSnapProjected(view()->invertedTransform().mapRect(QRectF(event->pos()-QPoint(15,15), QSizeF(30,30))));
     SnapList.clear();
     qreal BestDistance = 5;
     qreal BestReadonlyDistance = 5;
@@ -252,17 +253,15 @@ void FeatureSnapInteraction::updateSnap(QMouseEvent* event)
                     if (HotZoneSnap.contains(R->boundingBox()))
                         SnapList.push_back(F);
                     else {
-                        QPointF lastPoint = R->getNode(0)->position();
-                        QPointF aP;
-                        for (int j=1; j<R->size(); ++j) {
-                            aP = R->getNode(j)->position();
-                            QLineF l(lastPoint, aP);
+                        QList<int> Segments;
+                        R->segmentsIn(HotZoneSnapProjected, view()->projection(), Segments);
+                        foreach (int j, Segments) {
+                            QLineF l(R->getNode(j)->position(), R->getNode(j+1)->position());
                             QPointF a, b;
                             if (Utils::QRectInterstects(HotZoneSnap, l, a, b)) {
                                 SnapList.push_back(F);
                                 break;
                             }
-                            lastPoint = aP;
                         }
                     }
                 }
@@ -434,12 +433,13 @@ void FeatureSnapInteraction::activateSnap(bool b)
 
 void FeatureSnapInteraction::addToNoSnap(Feature* F)
 {
-    NoSnap.append(F);
+    NoSnap.insert(F);
 }
 
 void FeatureSnapInteraction::addToNoSnap(QList<Feature*> Fl)
 {
-    NoSnap.append(Fl);
+    foreach (Feature* F, Fl)
+        NoSnap.insert(F);
 }
 
 void FeatureSnapInteraction::clearNoSnap()
@@ -23,6 +23,7 @@ class QPainter;
 #include <QtGui/QCursor>
 #include <QtGui/QMouseEvent>
 #include <QList>
+#include <QSet>
 
 #include <algorithm>
 
@@ -57,7 +58,7 @@ protected:
     QPoint FirstPan;
     QPoint LastPan;
 
-    QList<Feature*> NoSnap;
+    QSet<Feature*> NoSnap;
     bool SnapActive;
     bool NoSelectPoints;
     bool NoSelectWays;
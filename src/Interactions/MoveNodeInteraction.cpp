@@ -159,7 +159,8 @@ void MoveNodeInteraction::snapMouseReleaseEvent(QMouseEvent * event, Feature* Cl
                 theList->setFeature(Moving[0]);
             }
         }
-        QSet<Way*> WaysToUpdate;
+        // Parents are updated and re-indexed once, by endChanges()
+        g_backend.beginChanges();
         for (int i=0; i<Moving.size(); ++i)
         {
             Moving[i]->setPosition(OriginalPosition[i]);
@@ -167,29 +168,17 @@ void MoveNodeInteraction::snapMouseReleaseEvent(QMouseEvent * event, Feature* Cl
                 theList->add(new MoveNodeCommand(Moving[i],OriginalPosition[i]+Diff, Moving[i]->layer()));
             else
                 theList->add(new MoveNodeCommand(Moving[i],OriginalPosition[i]+Diff, document()->getDirtyOrOriginLayer(Moving[i]->layer())));
-            for (int j=0; j<Moving[i]->sizeParents(); ++j) {
-                if (Way* aRoad = CAST_WAY(Moving[i]->getParent(j)))
-                    WaysToUpdate << aRoad;
-                else {
-                    Feature* f = CAST_FEATURE(Moving[i]->getParent(j));
-                    if (f)
-                        g_backend.sync(f);
-                }
-            }
-        }
-        foreach (Way* w, WaysToUpdate) {
-            g_backend.sync(w);
         }
+        g_backend.endChanges();
 
         // If moving a single node (not a track node), see if it got dropped onto another node
         if (Moving.size() == 1 && !Moving[0]->layer()->isTrack())
         {
             Coord newPos = OriginalPosition[0] + Diff;
             QList<Node*> samePosPts;
-            for (VisibleFeatureIterator it(document()); !it.isEnd(); ++it)
+            foreach (Node* visPt, document()->getNodes(CoordBox(newPos, newPos)))
             {
-                Node* visPt = CAST_NODE(it.get());
-                if (visPt && visPt->layer()->classType() != Layer::TrackLayerType)
+                if (visPt->layer()->classType() != Layer::TrackLayerType)
                 {
                     if (visPt == Moving[0])
                         continue;
@@ -253,6 +242,7 @@ void MoveNodeInteraction::snapMouseMoveEvent(QMouseEvent* event, Feature* Closer
         HasMoved = true;
         view()->setInteracting(true);
         Coord Diff = calculateNewPosition(event,Closer,NULL)-StartDragPosition;
+        g_backend.beginChanges();
         for (int i=0; i<Moving.size(); ++i) {
             if (Moving[i]->isVirtual()) {
                 Virtual = true;
@@ -278,6 +268,7 @@ void MoveNodeInteraction::snapMouseMoveEvent(QMouseEvent* event, Feature* Closer
                 Moving[i]->setPosition(OriginalPosition[i]+Diff);
             }
         }
+        g_backend.endChanges();
         view()->invalidate(true, true, false);
     }
 }
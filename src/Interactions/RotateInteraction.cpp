@@ -137,6 +137,7 @@ void RotateInteraction::snapMouseReleaseEvent(QMouseEvent * anEvent, Feature* /*
     {
         CommandList* theList;
         theList = new CommandList(MainWindow::tr("Rotate Feature").arg(Rotating[0]->id().numId), Rotating[0]);
+        g_backend.beginChanges();
         for (int i=0; i<Rotating.size(); ++i)
         {
             if (NodeOrigin && Rotating[i] == OriginNode)
@@ -147,6 +148,7 @@ void RotateInteraction::snapMouseReleaseEvent(QMouseEvent * anEvent, Feature* /*
             else
                 theList->add(new MoveNodeCommand(Rotating[i],rotatePosition(OriginalPosition[i], Angle), document()->getDirtyOrOriginLayer(Rotating[i]->layer())));
         }
+        g_backend.endChanges();
 
 
         document()->addHistory(theList);
@@ -164,11 +166,13 @@ void RotateInteraction::snapMouseMoveEvent(QMouseEvent* anEvent, Feature* /*Clos
     if (Rotating.size() && !panning())
     {
         Angle = calculateNewAngle(anEvent);
+        g_backend.beginChanges();
         for (int i=0; i<Rotating.size(); ++i) {
             if (NodeOrigin && Rotating[i] == OriginNode)
                 continue;
             Rotating[i]->setPosition(rotatePosition(OriginalPosition[i], Angle));
         }
+        g_backend.endChanges();
         view()->invalidate(true, true, false);
     }
 }
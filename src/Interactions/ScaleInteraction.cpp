@@ -137,6 +137,7 @@ void ScaleInteraction::snapMouseReleaseEvent(QMouseEvent * anEvent, Feature* /*C
     {
         CommandList* theList;
         theList = new CommandList(MainWindow::tr("Scale Feature").arg(Scaling[0]->id().numId), Scaling[0]);
+        g_backend.beginChanges();
         for (int i=0; i<Scaling.size(); ++i)
         {
             if (NodeOrigin && Scaling[i] == OriginNode)
@@ -147,6 +148,7 @@ void ScaleInteraction::snapMouseReleaseEvent(QMouseEvent * anEvent, Feature* /*C
             else
                 theList->add(new MoveNodeCommand(Scaling[i],scalePosition(OriginalPosition[i], Radius), document()->getDirtyOrOriginLayer(Scaling[i]->layer())));
         }
+        g_backend.endChanges();
 
 
         document()->addHistory(theList);
@@ -164,11 +166,13 @@ void ScaleInteraction::snapMouseMoveEvent(QMouseEvent* anEvent, Feature* /*Close
     if (Scaling.size() && !panning())
     {
         Radius = distance(ScaleCenter,anEvent->pos()) / distance(ScaleCenter, COORD_TO_XY(StartDragPosition));
+        g_backend.beginChanges();
         for (int i=0; i<Scaling.size(); ++i) {
             if (NodeOrigin && Scaling[i] == OriginNode)
                 continue;
             Scaling[i]->setPosition(scalePosition(OriginalPosition[i], Radius));
         }
+        g_backend.endChanges();
         view()->invalidate(true, true, false);
     }
 }
@@ -508,8 +508,8 @@ void ImageMapLayer::zoom(qreal zoom, const QPoint& pos, const QRect& rect)
 {
     if (!p->theMapAdapter)
         return;
-    if (p->theMapAdapter->getImageManager())
-        p->theMapAdapter->getImageManager()->abortLoading();
+    // Pending tiles are not aborted here: the next draw re-prioritises them
+    // and only drops those that left the view
     if (p->curPix.isNull())
         return;
 
@@ -525,8 +525,6 @@ void ImageMapLayer::pan(QPoint delta)
 {
     if (!p->theMapAdapter)
         return;
-    if (p->theMapAdapter->getImageManager())
-        p->theMapAdapter->getImageManager()->abortLoading();
     if (p->curPix.isNull())
         return;
 
@@ -823,7 +821,10 @@ QRect ImageMapLayer::drawFull(MapView& theView, QRect& rect)
             QString url (p->theMapAdapter->getQuery(wgs84vp, vp, rect));
             if (!url.isEmpty()) {
                 //qDebug() << "ImageMapLayer::drawFull: getting:" << url;
-                QPixmap pm = QPixmap::fromImage(p->theMapAdapter->getImageManager()->getImage(p->theMapAdapter,url));
+                IImageManager* theImageManager = p->theMapAdapter->getImageManager();
+                theImageManager->beginTileRequests();
+                QPixmap pm = QPixmap::fromImage(theImageManager->getImage(p->theMapAdapter,url));
+                theImageManager->endTileRequests();
                 if (!pm.isNull()) {
                     p->curPix = QPixmap();
                     p->newPix = pm.scaled(rect.size(), Qt::IgnoreAspectRatio);
@@ -973,10 +974,14 @@ QRect ImageMapLayer::drawTiled(MapView& theView, QRect& rect)
 
     qSort(tiles);
 
+    // Tiles are requested centre first, with their distance from the centre
+    // as priority; pending tiles no longer in view are dropped at the end
+    IImageManager* theImageManager = p->theMapAdapter->getImageManager();
+    theImageManager->beginTileRequests();
     int n=0; // Arbitrarily limit the number of tiles to 100
     for (QList<Tile>::const_iterator tile = tiles.begin(); tile != tiles.end() && n<100; ++tile)
     {
-        QImage pm = p->theMapAdapter->getImageManager()->getImage(p->theMapAdapter, p->theMapAdapter->getQuery(mapmiddle_tile_x+tile->i, mapmiddle_tile_y+tile->j, p->theMapAdapter->getZoom()));
+        QImage pm = theImageManager->getImage(p->theMapAdapter, p->theMapAdapter->getQuery(mapmiddle_tile_x+tile->i, mapmiddle_tile_y+tile->j, p->theMapAdapter->getZoom()), tile->priority);
         int x = (tile->i*tilesizeW)+pmSize.width()/2 -cross_scr_x;
         int y = (tile->j*tilesizeH)+pmSize.height()/2-cross_scr_y;
         if (!pm.isNull())
@@ -987,6 +992,7 @@ QRect ImageMapLayer::drawTiled(MapView& theView, QRect& rect)
 
         ++n;
     }
+    theImageManager->endTileRequests();
     painter.end();
 
 //    qDebug() << "tl:" << tl << "; br:" << br;
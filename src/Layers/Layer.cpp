@@ -18,9 +18,11 @@
 #include <QMultiMap>
 #include <QProgressDialog>
 #include <QUuid>
+#include <QBitArray>
 #include <QMap>
 #include <QList>
 #include <QMenu>
+#include <QtConcurrentMap>
 
 #include <algorithm>
 #include "LayerPrivate.h"
@@ -155,7 +157,8 @@ void Layer::add(Feature* aFeature)
 {
     if (aFeature) {
         aFeature->setLayer(this);
-        p->Features.push_back(aFeature);
+        if (!p->Slot.contains(aFeature))
+            p->append(aFeature);
         g_backend.sync(aFeature);
         aFeature->invalidateMeta();
         notifyIdUpdate(aFeature->id(),aFeature);
@@ -166,7 +169,7 @@ void Layer::add(Feature* aFeature)
 
 void Layer::remove(Feature* aFeature)
 {
-    if (p->Features.removeOne(aFeature))
+    if (p->take(aFeature))
     {
         g_backend.sync(aFeature);
         aFeature->setLayer(0);
@@ -176,7 +179,7 @@ void Layer::remove(Feature* aFeature)
 
 void Layer::deleteFeature(Feature* aFeature)
 {
-    if (p->Features.removeOne(aFeature))
+    if (p->take(aFeature))
     {
         g_backend.deallocFeature(this, aFeature);
         aFeature->setLayer(0);
@@ -188,14 +191,14 @@ void Layer::clear()
 {
     while (p->Features.count())
     {
-        remove(p->Features[0]);
+        remove(p->Features.last());
     }
 }
 
 void Layer::deleteAll() {
     while (p->Features.count())
     {
-        deleteFeature(p->Features[0]);
+        deleteFeature(p->Features.last());
     }
 }
 
@@ -206,27 +209,31 @@ void Layer::notifyIdUpdate(const IFeature::FId& id, Feature* aFeature)
     if (!aFeature) {
         i = p->IdMap.find(id.numId);
         while (i != p->IdMap.end() && i.key() == id.numId) {
-            if (i.value()->id().type & id.type)
+            if (i.value()->id().type & id.type) {
+                if (p->theDocument)
+                    p->theDocument->unindexFeatureId(id.numId, i.value());
                 i = p->IdMap.erase(i);
-            else
+            } else
                 ++i;
         }
     }
     else {
-        if (!aFeature->isVirtual())
+        if (!aFeature->isVirtual()) {
             p->IdMap.insertMulti(id.numId, aFeature);
+            if (p->theDocument)
+                p->theDocument->indexFeatureId(this, id.numId, aFeature);
+        }
     }
 }
 
 bool Layer::exists(Feature* F) const
 {
-    int i = p->Features.indexOf(F);
-    return (i != -1);
+    return p->Slot.contains(F);
 }
 
 int Layer::size() const
 {
-    return p->Features.size();
+    return p->Features.size() - p->Holes;
 }
 
 void Layer::setDocument(Document* aDocument)
@@ -241,26 +248,20 @@ Document* Layer::getDocument()
 
 int Layer::get(Feature* aFeature)
 {
-    for (int i=0; i<p->Features.size(); ++i)
-        if (p->Features[i] == aFeature)
-            return i;
-
-    return -1;
+    // Slots only match get(int) once the holes are gone
+    p->features();
+    return p->Slot.value(aFeature, -1);
 }
 
 QList<Feature *> Layer::get()
 {
-    QList<Feature *> theList;
-    for (int i=0; i<p->Features.size(); ++i)
-        if (p->Features[i])
-            theList.append(p->Features[i]);
-    return theList;
+    return p->features();
 }
 
 
 Feature* Layer::get(int i)
 {
-    return p->Features.at(i);
+    return p->features().at(i);
 }
 
 Feature* Layer::get(const IFeature::FId& id)
@@ -278,8 +279,8 @@ Feature* Layer::get(const IFeature::FId& id)
 
 const Feature* Layer::get(int i) const
 {
-    if((int)i>=p->Features.size()) return 0;
-    return p->Features[i];
+    if((int)i>=p->features().size()) return 0;
+    return p->features()[i];
 }
 
 LayerWidget* Layer::getWidget(void)
@@ -325,20 +326,20 @@ const QString& Layer::id() const
 
 CoordBox Layer::boundingBox()
 {
-    if(p->Features.size()==0) return CoordBox(Coord(0,0),Coord(0,0));
+    if(p->features().size()==0) return CoordBox(Coord(0,0),Coord(0,0));
     CoordBox Box;
     bool haveFirst = false;
-    for (int i=0; i<p->Features.size(); ++i) {
-        if (p->Features.at(i)->isDeleted())
+    for (int i=0; i<p->features().size(); ++i) {
+        if (p->features().at(i)->isDeleted())
             continue;
-        if (p->Features.at(i)->notEverythingDownloaded())
+        if (p->features().at(i)->notEverythingDownloaded())
             continue;
-        if (p->Features.at(i)->boundingBox().isNull())
+        if (p->features().at(i)->boundingBox().isNull())
             continue;
         if (haveFirst)
-            Box.merge(p->Features.at(i)->boundingBox());
+            Box.merge(p->features().at(i)->boundingBox());
         else {
-            Box = p->Features.at(i)->boundingBox();
+            Box = p->features().at(i)->boundingBox();
             haveFirst = true;
         }
     }
@@ -370,7 +371,7 @@ int Layer::getDisplaySize() const
     int objects = 0;
 
     QList<MapFeaturePtr>::const_iterator i;
-    for (i = p->Features.constBegin(); i != p->Features.constEnd(); i++) {
+    for (i = p->features().constBegin(); i != p->features().constEnd(); i++) {
         if ((*i)->isVirtual())
             continue;
         ++objects;
@@ -384,7 +385,7 @@ int Layer::getDirtySize() const
     int dirtyObjects = 0;
 
     QList<MapFeaturePtr>::const_iterator i;
-    for (i = p->Features.constBegin(); i != p->Features.constEnd(); i++) {
+    for (i = p->features().constBegin(); i != p->features().constEnd(); i++) {
         Feature* F = (*i);
         if (F->isVirtual())
             continue;
@@ -506,7 +507,7 @@ bool DrawingLayer::toXML(QXmlStreamWriter& stream, bool asTemplate, QProgressDia
         stream.writeAttribute("version", "0.6");
         stream.writeAttribute("generator", QString("%1 %2").arg(STRINGIFY(PRODUCT)).arg(STRINGIFY(VERSION)));
 
-        if (p->Features.size()) {
+        if (p->features().size()) {
             stream.writeStartElement("bound");
             CoordBox layBB = boundingBox();
             QString S = QString().number(layBB.bottomLeft().y(),'f',6) + ",";
@@ -518,8 +519,8 @@ bool DrawingLayer::toXML(QXmlStreamWriter& stream, bool asTemplate, QProgressDia
             stream.writeEndElement();
         }
 
-        QList<MapFeaturePtr>::iterator it;
-        for(it = p->Features.begin(); it != p->Features.end(); it++)
+        QList<MapFeaturePtr>::const_iterator it;
+        for(it = p->features().constBegin(); it != p->features().constEnd(); it++)
             (*it)->toXML(stream, progress);
         stream.writeEndElement();
 
@@ -744,8 +745,8 @@ bool TrackLayer::toXML(QXmlStreamWriter& stream, bool asTemplate, QProgressDialo
 
     QList<Node*>	waypoints;
     QList<TrackSegment*>	segments;
-    QList<MapFeaturePtr>::iterator it;
-    for(it = p->Features.begin(); it != p->Features.end(); it++) {
+    QList<MapFeaturePtr>::const_iterator it;
+    for(it = p->features().constBegin(); it != p->features().constEnd(); it++) {
         if (TrackSegment* S = CAST_SEGMENT(*it))
             segments.push_back(S);
         if (Node* P = CAST_NODE(*it))
@@ -924,17 +925,31 @@ LayerWidget* DeletedLayer::newWidget(void)
 
 // FilterLayer
 
+/* Features are evaluated against a changed filter in batches of this many */
+#define FILTER_BATCH 4096
+
+/* Slots of the existing filter layers; freed slots are reused */
+static QBitArray UsedFilterSlots;
+
 FilterLayer::FilterLayer(const QString& aId, const QString & aName, const QString& aFilter)
     : Layer(aName)
     , theSelectorString(aFilter)
+    , theFilterSlot(0)
 {
     setId(aId);
     p->Visible = true;
     theSelector = TagSelector::parse(theSelectorString);
+
+    while (theFilterSlot < UsedFilterSlots.size() && UsedFilterSlots.testBit(theFilterSlot))
+        ++theFilterSlot;
+    if (theFilterSlot == UsedFilterSlots.size())
+        UsedFilterSlots.resize(theFilterSlot + 1);
+    UsedFilterSlots.setBit(theFilterSlot);
 }
 
 FilterLayer::~ FilterLayer()
 {
+    UsedFilterSlots.clearBit(theFilterSlot);
 }
 
 void FilterLayer::setFilter(const QString& aFilter)
@@ -943,10 +958,40 @@ void FilterLayer::setFilter(const QString& aFilter)
     delete theSelector;
     theSelector = TagSelector::parse(theSelectorString);
 
-    FeatureIterator it(p->theDocument);
-    for(;!it.isEnd(); ++it) {
-        it.get()->updateFilters();
+    evaluate();
+}
+
+void FilterLayer::evaluate()
+{
+    if (!p->theDocument)
+        return;
+
+    // Deleted and virtual features too, as they may come back
+    QVector<Feature*> Features;
+    for (int i=0; i<p->theDocument->layerSize(); ++i) {
+        Layer* L = p->theDocument->getLayer(i);
+        for (int j=0; j<L->size(); ++j)
+            Features.append(L->get(j));
     }
+
+    // Only the features from the tag index need to be tried, if it applies
+    QSet<Feature*> Candidates;
+    bool Indexed = theSelector && theSelector->candidates(Candidates);
+
+    QVector< QPair<int, int> > Batches;
+    for (int i=0; i<Features.size(); i+=FILTER_BATCH)
+        Batches.append(qMakePair(i, qMin(i+FILTER_BATCH, Features.size())));
+
+    // Each feature is only written to by the batch it is in
+    QtConcurrent::blockingMap(Batches, [&](const QPair<int, int>& B) {
+        for (int i=B.first; i<B.second; ++i) {
+            Feature* F = Features[i];
+            bool Match = false;
+            if (theSelector && (!Indexed || Candidates.contains(F)))
+                Match = theSelector->matches(F, 0) != TagSelect_NoMatch;
+            F->setFilterMatch(theFilterSlot, Match);
+        }
+    });
 }
 
 bool FilterLayer::toXML(QXmlStreamWriter& stream, bool asTemplate, QProgressDialog * progress)
@@ -971,6 +1016,7 @@ FilterLayer* FilterLayer::fromXML(Document* d, QXmlStreamReader& stream, QProgre
     stream.readNext();
 
     d->add(l);
+    l->evaluate();
     return l;
 }
 
@@ -281,9 +281,15 @@ public:
     virtual QString filter() { return theSelectorString; }
     virtual TagSelector* selector() { return theSelector; }
 
+    /// Index of this filter in the features' filter matches
+    int filterSlot() const { return theFilterSlot; }
+    /// Evaluate the filter over all the features of the document
+    void evaluate();
+
 protected:
     QString theSelectorString;
     TagSelector* theSelector;
+    int theFilterSlot;
 
 };
 
@@ -14,12 +14,60 @@ public:
 
         IndexingBlocked = false;
         VirtualsUpdatesBlocked = false;
+        Holes = 0;
     }
     ~LayerPrivate()
     {
     }
 
-    QList<Feature*> Features;
+    void append(Feature* F)
+    {
+        Slot.insert(F, Features.size());
+        Features.push_back(F);
+    }
+
+    // Removing only leaves a hole, so that the others keep their order; the
+    // holes are squeezed out at the next indexed read through features().
+    // Trailing holes are dropped right away, so Features never ends with one
+    // and draining a layer from the back never compacts.
+    bool take(Feature* F)
+    {
+        QHash<Feature*, int>::iterator it = Slot.find(F);
+        if (it == Slot.end())
+            return false;
+        Features[it.value()] = NULL;
+        Slot.erase(it);
+        ++Holes;
+        while (!Features.isEmpty() && !Features.last()) {
+            Features.removeLast();
+            --Holes;
+        }
+        return true;
+    }
+
+    const QList<Feature*>& features()
+    {
+        if (Holes) {
+            int j = 0;
+            for (int i=0; i<Features.size(); ++i) {
+                Feature* F = Features[i];
+                if (!F)
+                    continue;
+                if (i != j) {
+                    Features[j] = F;
+                    Slot[F] = j;
+                }
+                ++j;
+            }
+            Features.erase(Features.begin() + j, Features.end());
+            Holes = 0;
+        }
+        return Features;
+    }
+
+    QList<Feature*> Features;       // may have holes, read through features()
+    QHash<Feature*, int> Slot;      // index of each feature in Features
+    int Holes;
     QHash<qint64, MapFeaturePtr> IdMap;
 
     QString Name;
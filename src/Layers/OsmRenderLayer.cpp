@@ -3,8 +3,10 @@
 #include "OsmRenderLayer.h"
 
 #include "Document.h"
+#include "Features.h"
 #include "MapRenderer.h"
 #include "MerkaartorPreferences.h"
+#include "RenderProfiler.h"
 
 #if QT_VERSION >= 0x050000
 #include <QtConcurrent>
@@ -61,6 +63,22 @@ private:
     QHash<const TILE_TYPE, QImage*> m_container;
 };
 
+/* Feature and vertex counts of a tile, for the render profile */
+static void countFeatures(const QMap<RenderPriority, QSet <Feature*> >& theFeatures)
+{
+    int Features = 0, Vertices = 0;
+    foreach (const QSet<Feature*>& Set, theFeatures) {
+        Features += Set.size();
+        foreach (Feature* F, Set) {
+            if (CHECK_WAY(F))
+                Vertices += STATIC_CAST_WAY(F)->size();
+            else if (CHECK_NODE(F))
+                ++Vertices;
+        }
+    }
+    RenderProfiler::countTile(Features, Vertices);
+}
+
 /**
  * A helper class for QtConcurrent::map(). An instance is created and the
  * operator() is called for each element that needs processing.
@@ -82,6 +100,7 @@ public:
         p->theDocument->lockPainters();
 
         TILE_TYPE tile = theTile;
+        RenderProfiler::beginTile(tile);
 
         QPointF projTL((TILE_X(tile)*p->tileSizeCoordW)+p->tileOriginCoord.x(), (TILE_Y(tile)*p->tileSizeCoordH)+p->tileOriginCoord.y());
         QPointF projBR(((TILE_X(tile)+1)*p->tileSizeCoordW)+p->tileOriginCoord.x(), ((TILE_Y(tile)+1)*p->tileSizeCoordH)+p->tileOriginCoord.y());
@@ -103,8 +122,13 @@ public:
         QMap<RenderPriority, QSet <Feature*> > theFeatures;
 
         g_backend.delayDeletes();
-        for (int i=0; i<p->theDocument->layerSize(); ++i)
-            g_backend.getFeatureSet(p->theDocument->getLayer(i), theFeatures, invalidRect, p->theProjection);
+        {
+            RenderTimer T(RenderProfiler::Query);
+            for (int i=0; i<p->theDocument->layerSize(); ++i)
+                g_backend.getFeatureSet(p->theDocument->getLayer(i), theFeatures, invalidRect, p->theProjection);
+        }
+        if (RenderProfiler::isEnabled())
+            countFeatures(theFeatures);
 
         QImage* img = new QImage(TILE_SIZE, TILE_SIZE, QImage::Format_ARGB32);
         img->fill(Qt::transparent);
@@ -115,6 +139,7 @@ public:
         MapRenderer r;
         r.render(&P, theFeatures, projR, /*QRect(0, 0, TILE_SIZE, TILE_SIZE)*/QRect(-((TILE_SIZE*TILE_SURROUND)-TILE_SIZE)/2, -((TILE_SIZE*TILE_SURROUND)-TILE_SIZE)/2, TILE_SIZE*TILE_SURROUND, TILE_SIZE*TILE_SURROUND), p->PixelPerM, p->ROptions);
         P.end();
+        RenderProfiler::endTile();
         g_backend.resumeDeletes();
         p->theDocument->unlockPainters();
         p->renderLock.unlock();
@@ -201,6 +226,7 @@ void OsmRenderLayer::forceRedraw(const Projection& aProjection, const QTransform
     }
 
     if (tilesToRender.size()) {
+        RenderProfiler::beginFrame(tilesToRender.size());
         renderGathering = QtConcurrent::map(tilesToRender, RenderTile(this));
         renderGatheringWatcher.setFuture(renderGathering);
     }
@@ -237,6 +263,7 @@ void OsmRenderLayer::pan(QPoint delta)
     tileLock.unlock();
 
     if (tilesToRender.size()) {
+        RenderProfiler::beginFrame(tilesToRender.size());
         renderGathering = QtConcurrent::map(tilesToRender, RenderTile(this));
         renderGatheringWatcher.setFuture(renderGathering);
     }
@@ -244,6 +271,7 @@ void OsmRenderLayer::pan(QPoint delta)
 
 void OsmRenderLayer::drawImage(QPainter *P)
 {
+    RenderTimer T(RenderProfiler::Composite);
     tileLock.lockForRead();
     QPointF origin = theTransform.map(tileOriginCoord);
     for (int i=tileViewport.top(); i<=tileViewport.bottom(); ++i) {
@@ -98,6 +98,7 @@
 #include <QToolTip>
 
 #include "qttoolbardialog.h"
+#include "RenderProfiler.h"
 
 #include <locale.h>
 #include <limits.h>
@@ -118,6 +119,9 @@ const QString MIME_GOOGLE_EARTH_KML = "application/vnd.google-earth.kml+xml";
 const QString MIME_GPX = "application/gpx+xml";
 const QString MIME_MERKAARTOR_UNDO_XML = "application/x-merkaartor-undo+xml";
 
+// How often queued GPS fixes are recorded and drawn
+const int GPS_UPDATE_MS = 250;
+
 }  // namespace
 
 using namespace Merkaartor;
@@ -134,6 +138,7 @@ class MainWindowPrivate
             , dropTarget(0)
     #endif
             , numImages(0)
+            , gpsHasPosition(false)
         {
             title = QString("%1 v%2").arg(STRINGIFY(PRODUCT)).arg(STRINGIFY(REVISION));
         }
@@ -155,6 +160,11 @@ class MainWindowPrivate
         Node *dropTarget;
 #endif
         int numImages;
+        QTimer gpsTimer;
+        QRect gpsMarker;
+        // Last fix taken from the device queue; the marker is drawn there
+        Coord gpsPosition;
+        bool gpsHasPosition;
 };
 
 namespace {
@@ -285,6 +295,8 @@ MainWindow::MainWindow(QWidget *parent)
 
     theGPS = new QGPS(this);
     connect(theGPS, SIGNAL(visibilityChanged(bool)), this, SLOT(updateWindowMenu(bool)));
+    p->gpsTimer.setInterval(GPS_UPDATE_MS);
+    connect(&p->gpsTimer, SIGNAL(timeout()), this, SLOT(updateGpsPosition()));
 
 #ifdef GEOIMAGE
     theGeoImage = new GeoImageDock(this);
@@ -414,6 +426,10 @@ MainWindow::MainWindow(QWidget *parent)
     ui->renderSVGAction->setVisible(false);
 #endif
 
+#ifndef USE_PROTOBUF
+    ui->exportPBFAction->setVisible(false);
+#endif
+
 #ifndef GEOIMAGE
     ui->windowGeoimageAction->setVisible(false);
     ui->viewPhotosAction->setVisible(false);
@@ -709,10 +725,13 @@ bool MainWindow::eventFilter(QObject */* watched */, QEvent *event)
         QMouseEvent mE(QEvent::MouseMove, devent->pos(), Qt::LeftButton, Qt::LeftButton, qApp->keyboardModifiers());
         theView->mouseMoveEvent(&mE);
 
-        Node *tP;
-        for (VisibleFeatureIterator it(document()); !it.isEnd(); ++it) {
-            QList<Feature*> NoSnap;
-            if ((tP = CAST_NODE(it.get())) && tP->pixelDistance(devent->pos(), 5.01, NoSnap, theView) < 5.01) {
+        // Only look at the nodes around the cursor
+        CoordBox Around(theView->fromView(devent->pos() - QPoint(6, 6)), theView->fromView(devent->pos() + QPoint(6, 6)));
+        Around.merge(theView->fromView(devent->pos() + QPoint(6, -6)));
+        Around.merge(theView->fromView(devent->pos() + QPoint(-6, 6)));
+        foreach (Node* tP, document()->getNodes(Around)) {
+            QSet<Feature*> NoSnap;
+            if (tP->pixelDistance(devent->pos(), 5.01, NoSnap, theView) < 5.01) {
                 p->dropTarget = tP;
                 QRect acceptedRect(tP->projected().toPoint() - QPoint(3, 3), tP->projected().toPoint() + QPoint(3, 3));
                 devent->acceptProposedAction();
@@ -1927,6 +1946,7 @@ void MainWindow::loadUrl(const QUrl& theUrl)
             theView->setViewport(vp, theView->rect());
             on_fileDownloadMoreAction_triggered();
         }
+        properties()->beginSelectionChange();
         properties()->setSelection(0);
 
         Feature* F;
@@ -1953,6 +1973,7 @@ void MainWindow::loadUrl(const QUrl& theUrl)
                     properties()->addSelection(F);
             }
         }
+        properties()->endSelectionChange();
     } else {
         QMessageBox::critical(this, tr("Incoming Remote control request"), tr("Unknown action url: %1").arg(theUrl.toString()));
     }
@@ -2039,9 +2060,10 @@ void MainWindow::on_layersMapdustAction_triggered()
     for (int i=0; i<theDocument->layerSize(); ++i) {
         if (theDocument->getLayer(i)->classType() == Layer::MapDustLayer) {
             sl = dynamic_cast<SpecialLayer*>(theDocument->getLayer(i));
+            // From the back, so that no hole is left to squeeze out
             while (sl->size())
             {
-                sl->deleteFeature(sl->get(0));
+                sl->deleteFeature(sl->get(sl->size()-1));
             }
         }
     }
@@ -2203,6 +2225,14 @@ void MainWindow::on_viewShowLatLonGridAction_triggered()
     invalidateView();
 }
 
+void MainWindow::on_viewRenderProfileAction_triggered()
+{
+    RenderProfiler::setEnabled(ui->viewRenderProfileAction->isChecked());
+    if (RenderProfiler::isEnabled())
+        RenderProfiler::clear();
+    invalidateView();
+}
+
 void MainWindow::on_viewStyleBackgroundAction_triggered()
 {
     M_PREFS->setBackgroundVisible(!M_PREFS->getBackgroundVisible());
@@ -3015,6 +3045,17 @@ void MainWindow::on_toolsRebuildHistoryAction_triggered()
     }
 }
 
+void MainWindow::on_toolsExportRenderTraceAction_triggered()
+{
+    QString path;
+    if (!getPathToSave(tr("Export render trace"), "json", tr("Chrome trace files (*.json)") + "\n" + tr("All Files (*)"), &path))
+        return;
+
+    if (!RenderProfiler::exportTrace(path))
+        QMessageBox::critical(this, tr("Unable to export render trace"),
+                              tr("Cannot write to %1.").arg(path));
+}
+
 namespace {
 
 void CollectActions(QList<QAction*>& collectedActions, const QWidget* widget) {
@@ -3339,6 +3380,29 @@ void MainWindow::on_exportOSCAction_triggered()
 #endif
 }
 
+void MainWindow::on_exportPBFAction_triggered()
+{
+#ifdef USE_PROTOBUF
+    QList<Feature*> theFeatures;
+
+    createProgressDialog();
+    if (!selectExportedFeatures(theFeatures))
+        return;
+
+    QString path;
+    if (getPathToSave(tr("Export PBF"), "pbf", tr("OSM PBF Files (*.osm.pbf *.pbf)") + "\n" + tr("All Files (*)"), &path)) {
+        startBusyCursor();
+        ImportExportPBF pbf(document());
+        if (pbf.saveFile(path)) {
+            if (!pbf.export_(theFeatures))
+                QMessageBox::critical(this, tr("Export PBF"), tr("Error while writing %1").arg(path));
+        }
+        endBusyCursor();
+    }
+    deleteProgressDialog();
+#endif
+}
+
 
 void MainWindow::on_exportGPXAction_triggered()
 {
@@ -3530,15 +3594,7 @@ void MainWindow::on_editSelectAction_triggered()
 
         int selMaxResult = Sel->sbMaxResult->value();
 
-        QList <Feature *> selection;
-        int added = 0;
-        for (VisibleFeatureIterator i(theDocument); !i.isEnd() && (!selMaxResult || added < selMaxResult); ++i) {
-            Feature* F = i.get();
-            if (tsel->matches(F, theView->pixelPerM())) {
-                selection.push_back(F);
-                ++added;
-            }
-        }
+        QList <Feature *> selection = theDocument->findFeatures(tsel, theView->pixelPerM(), selMaxResult);
         p->theProperties->setMultiSelection(selection);
         p->theProperties->checkMenuStatus();
     }
@@ -3970,8 +4026,6 @@ void MainWindow::on_gpsConnectAction_triggered()
     QGPSS60Device* aGps = new QGPSS60Device();
 #endif
     if (aGps->openDevice()) {
-        connect(aGps, SIGNAL(updatePosition(qreal, qreal, QDateTime, qreal, qreal, qreal)),
-            this, SLOT(updateGpsPosition(qreal, qreal, QDateTime, qreal, qreal, qreal)));
 
         ui->gpsConnectAction->setEnabled(false);
         ui->gpsReplayAction->setEnabled(false);
@@ -3981,6 +4035,8 @@ void MainWindow::on_gpsConnectAction_triggered()
         theGPS->setGpsDevice(aGps);
         theGPS->resetGpsStatus();
         theGPS->startGps();
+        p->gpsHasPosition = false;
+        p->gpsTimer.start();
     } else {
         QMessageBox::critical(this, tr("GPS error"),
             tr("Unable to open GPS port."), QMessageBox::Ok);
@@ -4000,8 +4056,6 @@ void MainWindow::on_gpsReplayAction_triggered()
 
     QGPSFileDevice* aGps = new QGPSFileDevice(fileName);
     if (aGps->openDevice()) {
-        connect(aGps, SIGNAL(updatePosition(qreal, qreal, QDateTime, qreal, qreal, qreal)),
-            this, SLOT(updateGpsPosition(qreal, qreal, QDateTime, qreal, qreal, qreal)));
 
         ui->gpsConnectAction->setEnabled(false);
         ui->gpsReplayAction->setEnabled(false);
@@ -4012,11 +4066,15 @@ void MainWindow::on_gpsReplayAction_triggered()
         theGPS->setGpsDevice(aGps);
         theGPS->resetGpsStatus();
         theGPS->startGps();
+        p->gpsHasPosition = false;
+        p->gpsTimer.start();
     }
 }
 
 void MainWindow::on_gpsDisconnectAction_triggered()
 {
+    updateGpsPosition();
+
     ui->gpsConnectAction->setEnabled(true);
     ui->gpsReplayAction->setEnabled(true);
     ui->gpsDisconnectAction->setEnabled(false);
@@ -4025,38 +4083,73 @@ void MainWindow::on_gpsDisconnectAction_triggered()
     ui->gpsRecordAction->setChecked(false);
     ui->gpsPauseAction->setChecked(false);
 
-    disconnect(theGPS->getGpsDevice(), SIGNAL(updatePosition(qreal, qreal, QDateTime, qreal, qreal, qreal)),
-        this, SLOT(updateGpsPosition(qreal, qreal, QDateTime, qreal, qreal, qreal)));
+    p->gpsTimer.stop();
     theGPS->stopGps();
     theGPS->resetGpsStatus();
+    p->gpsHasPosition = false;
 }
 
-void MainWindow::updateGpsPosition(qreal latitude, qreal longitude, QDateTime time, qreal altitude, qreal speed, qreal heading)
+/* Called every GPS_UPDATE_MS: takes the fixes the device thread queued
+   since, records them as one batch and, unless the map had to be
+   re-centred on the last one, repaints only around them. */
+void MainWindow::updateGpsPosition()
 {
-    Q_UNUSED(heading)
-    if (theGPS->getGpsDevice()) {
-        Coord gpsCoord(longitude,latitude);
-        if (M_PREFS->getGpsMapCenter()) {
-            CoordBox vp = theView->viewport();
-            qreal lonDiff = vp.lonDiff();
-            qreal latDiff = vp.latDiff();
-            QRectF vpr = vp.adjusted(lonDiff / 4, -latDiff / 4, -lonDiff / 4, latDiff / 4);
-            if (!vpr.contains(gpsCoord)) {
-                theView->setCenter(gpsCoord, theView->rect());
-                theView->invalidate(false, false, true);
-            }
+    QGPSDevice* Dev = theGPS->getGpsDevice();
+    if (!Dev)
+        return;
+
+    QVector<GpsPosition> Fixes;
+    if (!Dev->takePositions(Fixes))
+        return;
+
+    const GpsPosition& Last = Fixes.last();
+    Coord gpsCoord(Last.longitude, Last.latitude);
+    p->gpsPosition = gpsCoord;
+    p->gpsHasPosition = true;
+    bool Recentred = false;
+    if (M_PREFS->getGpsMapCenter()) {
+        CoordBox vp = theView->viewport();
+        qreal lonDiff = vp.lonDiff();
+        qreal latDiff = vp.latDiff();
+        QRectF vpr = vp.adjusted(lonDiff / 4, -latDiff / 4, -lonDiff / 4, latDiff / 4);
+        if (!vpr.contains(gpsCoord)) {
+            theView->setCenter(gpsCoord, theView->rect());
+            Recentred = true;
         }
+    }
+
+    QRect Dirty = p->gpsMarker;
+    p->gpsMarker = QRect(theView->toView(gpsCoord) - QPoint(16, 16), QSize(32, 32));
+    Dirty |= p->gpsMarker;
 
-        if (ui->gpsRecordAction->isChecked() && !ui->gpsPauseAction->isChecked()) {
-            TrackNode* pt = g_backend.allocTrackNode(gpsRecLayer, gpsCoord);
-            pt->setTime(time);
-            pt->setElevation(altitude);
-            pt->setSpeed(speed);
+    if (ui->gpsRecordAction->isChecked() && !ui->gpsPauseAction->isChecked()) {
+        QPolygon Track;
+        if (curGpsTrackSegment->size())
+            Track << theView->toView(curGpsTrackSegment->getNode(curGpsTrackSegment->size()-1)->position());
+
+        QList<TrackNode*> Points;
+        foreach (const GpsPosition& Fix, Fixes) {
+            Coord C(Fix.longitude, Fix.latitude);
+            TrackNode* pt = g_backend.allocTrackNode(gpsRecLayer, C);
+            pt->setTime(Fix.time);
+            pt->setElevation(Fix.altitude);
+            pt->setSpeed(Fix.speed);
             gpsRecLayer->add(pt);
-            curGpsTrackSegment->add(pt);
+            Points << pt;
+            Track << theView->toView(C);
         }
+        curGpsTrackSegment->add(Points);
+
+        // Leave room for the pen width and the direction markers
+        Dirty |= Track.boundingRect().adjusted(-12, -12, 12, 12);
     }
-    theView->update();
+
+    // After a pan the whole view is redrawn anyway
+    if (Recentred) {
+        theView->invalidate(false, false, true);
+        theView->update();
+    } else
+        theView->update(Dirty);
 }
 
 QGPS* MainWindow::gps()
@@ -4064,6 +4157,14 @@ QGPS* MainWindow::gps()
     return theGPS;
 }
 
+bool MainWindow::gpsPosition(Coord& aCoord) const
+{
+    if (!p->gpsHasPosition)
+        return false;
+    aCoord = p->gpsPosition;
+    return true;
+}
+
 void MainWindow::on_gpsCenterAction_triggered()
 {
     M_PREFS->setGpsMapCenter(!M_PREFS->getGpsMapCenter());
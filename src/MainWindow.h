@@ -25,6 +25,7 @@ class InfoDock;
 class DirtyDock;
 class FeaturesDock;
 class QGPS;
+class Coord;
 class GlobalPainter;
 class Painter;
 class TrackLayer;
@@ -104,6 +105,7 @@ public slots:
     virtual void on_viewScaleAction_triggered();
     virtual void on_viewPhotosAction_triggered();
     virtual void on_viewShowLatLonGridAction_triggered();
+    virtual void on_viewRenderProfileAction_triggered();
     virtual void on_viewStyleBackgroundAction_triggered();
     virtual void on_viewStyleForegroundAction_triggered();
     virtual void on_viewStyleTouchupAction_triggered();
@@ -156,6 +158,7 @@ public slots:
     virtual void on_mapStyleLoadAction_triggered();
     virtual void on_exportOSMAction_triggered();
     virtual void on_exportOSCAction_triggered();
+    virtual void on_exportPBFAction_triggered();
     virtual void on_exportGPXAction_triggered();
     virtual void on_exportKMLAction_triggered();
     virtual void on_exportGDALAction_triggered();
@@ -173,6 +176,7 @@ public slots:
     virtual void toolsPreferencesAction_triggered(bool focusData=false);
     virtual void on_toolsResetDiscardableAction_triggered();
     virtual void on_toolsRebuildHistoryAction_triggered();
+    virtual void on_toolsExportRenderTraceAction_triggered();
 
     virtual void on_windowPropertiesAction_triggered();
     virtual void on_windowLayersAction_triggered();
@@ -225,6 +229,8 @@ public:
     FeaturesDock* features();
     InfoDock* info();
     QGPS* gps();
+    /// Position of the last GPS fix recorded by updateGpsPosition(), if any
+    bool gpsPosition(Coord& aCoord) const;
 #ifdef GEOIMAGE
     GeoImageDock* geoImage();
 #endif
@@ -252,7 +258,7 @@ public slots:
     void projectionTriggered(QAction* anAction);
 #endif
     void styleTriggered(QAction* anAction);
-    void updateGpsPosition(qreal latitude, qreal longitude, QDateTime time, qreal altitude, qreal speed, qreal heading);
+    void updateGpsPosition();
     void applyStyles(QString NewStyle);
     void applyPainters(GlobalPainter* theGlobalPainter, QList<Painter>* thePainters);
 
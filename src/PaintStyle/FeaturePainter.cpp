@@ -239,7 +239,7 @@ void FeaturePainter::drawBackground(Way* R, QPainter* thePainter, MapRenderer* t
                 thePainter->setPen(thePen);
 
                 R->getLock();
-                QPainterPath thePath = theRenderer->theTransform.map(R->getPath());
+                QPainterPath thePath = theRenderer->theTransform.map(R->getPath(theRenderer->theTransform));
                 R->releaseLock();
                 QPainterPath aPath;
 
@@ -298,7 +298,7 @@ void FeaturePainter::drawBackground(Way* R, QPainter* thePainter, MapRenderer* t
     }
 
     R->getLock();
-    thePainter->drawPath(theRenderer->theTransform.map(R->getPath()));
+    thePainter->drawPath(theRenderer->theTransform.map(R->getPath(theRenderer->theTransform)));
     R->releaseLock();
 }
 
@@ -323,7 +323,7 @@ void FeaturePainter::drawBackground(Relation* R, QPainter* thePainter, MapRender
                 thePainter->setPen(thePen);
 
                 R->getLock();
-                QPainterPath thePath = theRenderer->theTransform.map(R->getPath());
+                QPainterPath thePath = theRenderer->theTransform.map(R->getPath(theRenderer->theTransform));
                 R->releaseLock();
                 QPainterPath aPath;
 
@@ -380,7 +380,7 @@ void FeaturePainter::drawBackground(Relation* R, QPainter* thePainter, MapRender
     }
 
     R->getLock();
-    thePainter->drawPath(theRenderer->theTransform.map(R->getPath()));
+    thePainter->drawPath(theRenderer->theTransform.map(R->getPath(theRenderer->theTransform)));
     R->releaseLock();
 }
 
@@ -426,7 +426,7 @@ void FeaturePainter::drawForeground(Way* R, QPainter* thePainter, MapRenderer* t
     thePainter->setBrush(Qt::NoBrush);
 
     R->getLock();
-    thePainter->drawPath(theRenderer->theTransform.map(R->getPath()));
+    thePainter->drawPath(theRenderer->theTransform.map(R->getPath(theRenderer->theTransform)));
     R->releaseLock();
 }
 
@@ -457,7 +457,7 @@ void FeaturePainter::drawForeground(Relation* R, QPainter* thePainter, MapRender
     thePainter->setBrush(Qt::NoBrush);
 
     R->getLock();
-    thePainter->drawPath(theRenderer->theTransform.map(R->getPath()));
+    thePainter->drawPath(theRenderer->theTransform.map(R->getPath(theRenderer->theTransform)));
     R->releaseLock();
 }
 
@@ -525,7 +525,7 @@ void FeaturePainter::drawTouchup(Way* R, QPainter* thePainter, MapRenderer* theR
                 thePen.setDashPattern(Pattern);
             }
             R->getLock();
-            thePainter->strokePath(theRenderer->theTransform.map(R->getPath()),thePen);
+            thePainter->strokePath(theRenderer->theTransform.map(R->getPath(theRenderer->theTransform)),thePen);
             R->releaseLock();
         }
     }
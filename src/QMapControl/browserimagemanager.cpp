@@ -164,7 +164,7 @@ QByteArray BrowserImageManager::getData(IMapAdapter* anAdapter, const QString &u
     return buf.buffer();
 }
 
-QImage BrowserImageManager::getImage(IMapAdapter* anAdapter, const QString &url)
+QImage BrowserImageManager::getImage(IMapAdapter* anAdapter, const QString &url, qreal /*priority*/)
 {
 //	QPixmap pm(emptyPixmap);
     QPixmap pm;
@@ -73,7 +73,7 @@ class BrowserImageManager : public QObject, public IImageManager
          * @param path the path to the image
          * @return the pixmap of the asked image
          */
-        QImage getImage(IMapAdapter* anAdapter, const QString &url);
+        QImage getImage(IMapAdapter* anAdapter, const QString &url, qreal priority = 0.);
         QByteArray getData(IMapAdapter* anAdapter, const QString &url);
 
         //QPixmap prefetchImage(const QString& host, const QString& path);
@@ -72,7 +72,7 @@ QByteArray ImageManager::getData(IMapAdapter* anAdapter, const QString &url)
     return ba;
 }
 
-QImage ImageManager::getImage(IMapAdapter* anAdapter, const QString &url)
+QImage ImageManager::getImage(IMapAdapter* anAdapter, const QString &url, qreal priority)
 {
 // 	qDebug() << "ImageManager::getImage";
 
@@ -106,14 +106,9 @@ QImage ImageManager::getImage(IMapAdapter* anAdapter, const QString &url)
     if (M_PREFS->getOfflineMode())
         return pm;
 
-    // currently loading?
-    if (!net->isLoading(hash))
-    {
-        // load from net, add empty image
-        net->load(hash, host, url);
+    // load from net, add empty image; if already loading, this only updates its priority
+    if (net->load(hash, host, url, priority))
         emit(dataRequested());
-        return pm;
-    }
     return pm;
 }
 
@@ -172,6 +167,21 @@ void ImageManager::abortLoading()
     loadingQueueEmpty();
 }
 
+void ImageManager::beginTileRequests()
+{
+    net->beginRequests();
+}
+
+void ImageManager::endTileRequests()
+{
+    net->endRequests();
+}
+
+MapNetworkStats ImageManager::networkStats() const
+{
+    return net->stats();
+}
+
 void ImageManager::setCacheDir(const QDir& path)
 {
     cacheDir = path;
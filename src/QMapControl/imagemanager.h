@@ -52,7 +52,7 @@ class ImageManager : public QObject, public IImageManager
          * @param path the path to the image
          * @return the pixmap of the asked image
          */
-        QImage getImage(IMapAdapter* anAdapter, const QString &url);
+        QImage getImage(IMapAdapter* anAdapter, const QString &url, qreal priority = 0.);
         QByteArray getData(IMapAdapter* anAdapter, const QString &url);
 
         //QPixmap prefetchImage(const QString& host, const QString& path);
@@ -74,6 +74,10 @@ class ImageManager : public QObject, public IImageManager
          */
         void abortLoading();
 
+        void beginTileRequests();
+        void endTileRequests();
+        MapNetworkStats networkStats() const;
+
         void setCacheDir(const QDir& path);
         QDir getCacheDir();
         void setCacheMaxSize(int max);
@@ -23,56 +23,97 @@
 
 #include <QNetworkRequest>
 #include <QNetworkReply>
+#include <QTimer>
 
 #define MAX_REQ 8
+#define MAX_REQ_PER_HOST 4
+
+// Weight of the newest sample in the moving averages
+#define STATS_WEIGHT 0.1
+
+static void addSample(qreal& avg, qreal sample)
+{
+    avg = (avg == 0.) ? sample : avg + (sample - avg) * STATS_WEIGHT;
+}
 
 MapNetwork::MapNetwork(IImageManager* parent)
-        : parent(parent)
+        : parent(parent), generation(0), nextOrder(0)
 {
     m_networkManager = parent->getNetworkManager();
     m_networkManager->setProxy(M_PREFS->getProxy(QUrl("http://merkaartor.be")));
     connect(m_networkManager, SIGNAL(finished(QNetworkReply*)),
             this, SLOT(requestFinished(QNetworkReply*)));
+    clock.start();
 }
 
 MapNetwork::~MapNetwork()
 {
+    abortLoading();
 }
 
 
-void MapNetwork::load(const QString& hash, const QString& host, const QString& url)
+bool MapNetwork::load(const QString& hash, const QString& host, const QString& url, qreal priority)
 {
+    Request* R = requests.value(hash);
+    if (R) {
+        R->generation = generation;
+        if (R->priority != priority) {
+            if (!R->reply) {
+                queue.remove(QueueKey(R->priority, R->order));
+                R->priority = priority;
+                queue.insert(QueueKey(R->priority, R->order), R);
+            } else
+                R->priority = priority;
+        }
+        return false;
+    }
+
     qDebug() << "requesting:" << QString(host).append(url);
-// 	http->setHost(host);
-// 	int getId = http->get(url);
 
-    loadingRequests.enqueue(new LoadingRequest(hash, host, url));
+    R = new Request(hash, host, url);
+    R->priority = priority;
+    R->order = nextOrder++;
+    R->generation = generation;
+    R->queuedAt = clock.elapsed();
+    requests.insert(hash, R);
+    enqueue(R);
 
-    if (loadingMap.size() < MAX_REQ)
-        launchRequest();
-    else
-        qDebug() << "queue full";
+    launchRequests();
+    return true;
 }
 
-void MapNetwork::launchRequest()
+void MapNetwork::enqueue(Request* R)
 {
-    if (loadingRequests.isEmpty())
-        return;
-    LoadingRequest* R = loadingRequests.dequeue();
+    queue.insert(QueueKey(R->priority, R->order), R);
+}
 
-    QUrl theUrl;
-    if (R->host.contains("://")) {
-        theUrl.setUrl(QString(R->host).append(R->url));
-    } else {
-        theUrl.setUrl("http://" + QString(R->host).append(R->url));
-    }
+void MapNetwork::launchRequests()
+{
+    QMap<QueueKey, Request*>::iterator it = queue.begin();
+    while (it != queue.end() && loadingMap.size() < MAX_REQ) {
+        Request* R = it.value();
+        if (hostLoad.value(R->host) >= MAX_REQ_PER_HOST) {
+            ++it;
+            continue;
+        }
+        it = queue.erase(it);
 
-    qDebug() << "getting:" << theUrl.toString();
+        QUrl theUrl;
+        if (R->host.contains("://")) {
+            theUrl.setUrl(QString(R->host).append(R->url));
+        } else {
+            theUrl.setUrl("http://" + QString(R->host).append(R->url));
+        }
+
+        qDebug() << "getting:" << theUrl.toString();
 
-    launchRequest(theUrl, R);
+        R->launchedAt = clock.elapsed();
+        addSample(st.avgWait, R->launchedAt - R->queuedAt);
+        launchRequest(theUrl, R);
+    }
 }
 
-void MapNetwork::launchRequest(QUrl url, LoadingRequest* R)
+void MapNetwork::launchRequest(QUrl url, Request* R)
 {
     QNetworkRequest req(url);
 
@@ -81,31 +122,53 @@ void MapNetwork::launchRequest(QUrl url, LoadingRequest* R)
     req.setRawHeader("User-Agent", USER_AGENT.toLatin1());
 
     QNetworkReply* reply = m_networkManager->get(req);
+    R->reply = reply;
     loadingMap[reply] = R;
+    hostLoad[R->host]++;
 
     QTimer* timeoutTimer = new QTimer();
     connect(timeoutTimer, SIGNAL(timeout()), this, SLOT(timeout()));
     timeoutTimer->setInterval(M_PREFS->getNetworkTimeout());
     timeoutTimer->setSingleShot(true);
 
-    timeoutMap[timeoutTimer] = reply;
+    R->timer = timeoutTimer;
+    timeoutMap[timeoutTimer] = R;
     timeoutTimer->start();
 }
 
+void MapNetwork::detach(Request* R)
+{
+    if (R->timer) {
+        R->timer->stop();
+        timeoutMap.remove(R->timer);
+        R->timer->deleteLater();
+        R->timer = 0;
+    }
+    if (R->reply) {
+        loadingMap.remove(R->reply);
+        if (--hostLoad[R->host] <= 0)
+            hostLoad.remove(R->host);
+        R->reply->deleteLater();
+        R->reply = 0;
+    }
+}
+
+void MapNetwork::checkQueueEmpty()
+{
+    if (loadingMap.isEmpty() && queue.isEmpty()) {
+// 		qDebug () << "all loaded";
+        parent->loadingQueueEmpty();
+    }
+}
+
 void MapNetwork::requestFinished(QNetworkReply* reply)
 {
     if (!loadingMap.contains(reply)){
         // Don't react on setProxy and setHost requestFinished...
         return;
     }
-    QTimer* t = timeoutMap.key(reply);
-    Q_ASSERT(t);
-    t->stop();
-    timeoutMap.remove(t);
-    delete t;
-
-    LoadingRequest* R = loadingMap[reply];
-    loadingMap.remove(reply);
+    Request* R = loadingMap.value(reply);
+    detach(R);
 
     int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
 
@@ -118,7 +181,7 @@ void MapNetwork::requestFinished(QNetworkReply* reply)
             case 302:
             case 307:
                 qDebug() << "redirected:" << R->host << R->url;
-                launchRequest(reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl(), new LoadingRequest(R->hash, R->host, R->url));
+                launchRequest(reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl(), R);
                 return;
             case 404:
                 qDebug() << "404 error:" << R->host << R->url;
@@ -145,38 +208,74 @@ void MapNetwork::requestFinished(QNetworkReply* reply)
                 }
                 break;
         }
+
+    ++st.finished;
+    addSample(st.avgLatency, clock.elapsed() - R->launchedAt);
+
+    requests.remove(R->hash);
     delete R;
 
-    launchRequest();
-    if (loadingMap.isEmpty() && loadingRequests.isEmpty()) {
-// 		qDebug () << "all loaded";
-        parent->loadingQueueEmpty();
-    }
+    launchRequests();
+    checkQueueEmpty();
 }
 
 void MapNetwork::abortLoading()
 {
-    foreach (QNetworkReply* rply, loadingMap.keys())
-        rply->abort();
-    loadingMap.clear();
-    while (!loadingRequests.isEmpty())
-        delete loadingRequests.dequeue();
-    //loadingRequests.clear();
+    QList<Request*> all = requests.values();
+    requests.clear();
+    queue.clear();
+    foreach (Request* R, all) {
+        QNetworkReply* rply = R->reply;
+        detach(R);
+        if (rply)
+            rply->abort();
+        delete R;
+    }
 }
 
-bool MapNetwork::isLoading(QString hash)
+void MapNetwork::beginRequests()
+{
+    ++generation;
+}
+
+void MapNetwork::endRequests()
 {
-    QListIterator<LoadingRequest*> i(loadingRequests);
-    while (i.hasNext())
-        if (i.next()->hash == hash)
-            return true;
+    // Whatever was not requested again has left the view
+    QList<Request*> stale;
+    foreach (Request* R, requests)
+        if (R->generation != generation)
+            stale << R;
+    if (stale.isEmpty())
+        return;
+
+    foreach (Request* R, stale) {
+        qDebug() << "MapNetwork: dropping" << R->host << R->url;
+        requests.remove(R->hash);
+        QNetworkReply* rply = R->reply;
+        if (rply) {
+            detach(R);
+            rply->abort();
+        } else
+            queue.remove(QueueKey(R->priority, R->order));
+        delete R;
+        ++st.canceled;
+    }
+
+    launchRequests();
+    checkQueueEmpty();
+}
 
-    QMapIterator<QNetworkReply*, LoadingRequest*> j(loadingMap);
-    while (j.hasNext())
-        if (j.next().value()->hash == hash)
-            return true;
+bool MapNetwork::isLoading(QString hash)
+{
+    return requests.contains(hash);
+}
 
-    return false;
+MapNetworkStats MapNetwork::stats() const
+{
+    MapNetworkStats s(st);
+    s.queued = queue.size();
+    s.running = loadingMap.size();
+    return s;
 }
 
 void MapNetwork::timeout()
@@ -184,19 +283,16 @@ void MapNetwork::timeout()
     QTimer* t = qobject_cast<QTimer*>(sender());
     Q_ASSERT(t);
 
-    QNetworkReply* rply = timeoutMap[t];
-    if (!loadingMap.contains(rply))
+    Request* R = timeoutMap.value(t);
+    if (!R || !R->reply)
         return;
 
-    LoadingRequest* R = loadingMap[rply];
     qDebug() << "MapNetwork::timeout:" << R->host << R->url;
-    loadingMap.remove(rply);
-    loadingRequests.enqueue(R);
-
+    QNetworkReply* rply = R->reply;
+    detach(R);
     rply->abort();
-    timeoutMap.remove(t);
-    delete t;
 
-    if (loadingMap.size() < MAX_REQ)
-        launchRequest();
+    R->queuedAt = clock.elapsed();
+    enqueue(R);
+    launchRequests();
 }
@@ -22,15 +22,39 @@
 
 #include <QObject>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QList>
-#include <QQueue>
+#include <QMap>
+#include <QPair>
 #include <QPixmap>
 #include <QMutex>
 #include <QUrl>
 
 #include "IImageManager.h"
+
+class QTimer;
+
+/// Snapshot of the tile request scheduler, for diagnostics
+struct MapNetworkStats
+{
+    MapNetworkStats()
+        : queued(0), running(0), finished(0), canceled(0), avgWait(0.), avgLatency(0.) {}
+
+    int queued;         // waiting for a free connection
+    int running;        // in flight
+    int finished;       // completed since creation
+    int canceled;       // dropped after leaving the view
+    qreal avgWait;      // ms from request to launch (moving average)
+    qreal avgLatency;   // ms from launch to reply (moving average)
+};
+
 /**
     @author Kai Winter <kaiwinter@gmx.de>
+
+    Requests are scheduled by priority (lower first; the layer passes the
+    distance from the viewport centre) with a cap per host. A request for a
+    tile that is already queued or loading only updates its priority.
 */
 class ImageManager;
 class MapNetwork : QObject
@@ -40,7 +64,11 @@ class MapNetwork : QObject
         MapNetwork(IImageManager* parent);
         ~MapNetwork();
 
-        void load(const QString& hash, const QString& host, const QString& url);
+        /*!
+         * Queues the image, or re-prioritises it if it is already pending.
+         * @return true if a new request was queued
+         */
+        bool load(const QString& hash, const QString& host, const QString& url, qreal priority = 0.);
 
         /*!
          * checks if the given url is already loading
@@ -55,17 +83,55 @@ class MapNetwork : QObject
         */
         void abortLoading();
 
+        /*!
+         * Marks the start of the requests for a new view. endRequests() then
+         * drops whatever was pending for the previous view and not requested
+         * again, leaving the tiles still in view loading.
+         */
+        void beginRequests();
+        void endRequests();
+
+        MapNetworkStats stats() const;
+
     private:
+        struct Request
+        {
+            Request(const QString& h, const QString& H, const QString& U)
+                : hash(h), host(H), url(U), priority(0.), order(0), generation(0),
+                  queuedAt(0), launchedAt(0), reply(0), timer(0) {}
+
+            QString hash;
+            QString host;
+            QString url;
+            qreal priority;
+            quint64 order;
+            int generation;
+            qint64 queuedAt;
+            qint64 launchedAt;
+            QNetworkReply* reply;
+            QTimer* timer;
+        };
+        typedef QPair<qreal, quint64> QueueKey;
+
         IImageManager* parent;
         QNetworkAccessManager* m_networkManager;
-        QMap<QNetworkReply*, LoadingRequest*> loadingMap;
-        QMap<QTimer*, QNetworkReply*> timeoutMap;
-        QQueue<LoadingRequest*> loadingRequests;
+        QHash<QString, Request*> requests;
+        QMap<QueueKey, Request*> queue;
+        QHash<QNetworkReply*, Request*> loadingMap;
+        QHash<QTimer*, Request*> timeoutMap;
+        QHash<QString, int> hostLoad;
+        int generation;
+        quint64 nextOrder;
+        QElapsedTimer clock;
+        MapNetworkStats st;
 
         MapNetwork& operator=(const MapNetwork& rhs);
         MapNetwork(const MapNetwork& old);
-        void launchRequest();
-        void launchRequest(QUrl url, LoadingRequest* R);
+        void launchRequests();
+        void launchRequest(QUrl url, Request* R);
+        void detach(Request* R);
+        void enqueue(Request* R);
+        void checkQueueEmpty();
 
 
     private slots:
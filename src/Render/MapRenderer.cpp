@@ -17,6 +17,7 @@
 #include "MasPaintStyle.h"
 #include "ImageMapLayer.h"
 #include "LineF.h"
+#include "RenderProfiler.h"
 
 #define TEST_RFLAGS(x) theOptions.options.testFlag(x)
 #define TEST_RENDERER_RFLAGS(x) r->theOptions.options.testFlag(x)
@@ -45,7 +46,7 @@ void BackgroundStyleLayer::draw(Way* R)
 
         r->thePainter->setPen(thePen);
         R->getLock();
-        r->thePainter->drawPath(r->theTransform.map(R->getPath()));
+        r->thePainter->drawPath(r->theTransform.map(R->getPath(r->theTransform)));
         R->releaseLock();
     }
 }
@@ -282,6 +283,7 @@ void MapRenderer::render(
         {
             if (bgLayerVisible)
             {
+                RenderTimer T(RenderProfiler::Background);
                 for (it = itm.value().constBegin(); it != itm.value().constEnd(); ++it) {
                     qreal alpha = (*it)->getAlpha();
                     if ((*it)->isReadonly() && !TEST_RFLAGS(RendererOptions::ForPrinting))
@@ -313,6 +315,7 @@ void MapRenderer::render(
         {
             if (fgLayerVisible)
             {
+                RenderTimer T(RenderProfiler::Foreground);
                 for (it = itm.value().constBegin(); it != itm.value().constEnd(); ++it) {
                     qreal alpha = (*it)->getAlpha();
                     if ((*it)->isReadonly() && !TEST_RFLAGS(RendererOptions::ForPrinting))
@@ -342,6 +345,7 @@ void MapRenderer::render(
     }
     if (tchpLayerVisible)
     {
+        RenderTimer T(RenderProfiler::Touchup);
         for (itm = theFeatures.constBegin() ;itm != theFeatures.constEnd(); ++itm) {
             for (it = itm.value().constBegin(); it != itm.value().constEnd(); ++it) {
                 qreal alpha = (*it)->getAlpha();
@@ -371,6 +375,7 @@ void MapRenderer::render(
 
     if (lblLayerVisible)
     {
+        RenderTimer T(RenderProfiler::Labels);
         for (itm = theFeatures.constBegin() ;itm != theFeatures.constEnd(); ++itm) {
             for (it = itm.value().constBegin(); it != itm.value().constEnd(); ++it) {
                 P->save();
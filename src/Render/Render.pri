@@ -4,12 +4,14 @@ DEPENDPATH += $$MERKAARTOR_SRC_DIR/Render
 # Header files
 HEADERS += \
     FeaturePainter.h \
-    MapRenderer.h
+    MapRenderer.h \
+    RenderProfiler.h
 
 # Source files
 SOURCES += \
     FeaturePainter.cpp \
-    MapRenderer.cpp
+    MapRenderer.cpp \
+    RenderProfiler.cpp
 
 isEmpty(MOBILE) {
   QT += svg
@@ -0,0 +1,293 @@
+#include "RenderProfiler.h"
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFontMetrics>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+#define PROFILE_MAX_TILES 20000
+#define PROFILE_MAX_FRAMES 2000
+
+struct ProfileSpan
+{
+    int stage;
+    qint64 start;
+    qint64 duration;
+};
+
+struct ProfileTile
+{
+    int frame;
+    int thread;
+    QPoint tile;
+    qint64 total[RenderProfiler::StageCount];
+    QVector<ProfileSpan> spans;
+    int features;
+    int vertices;
+};
+
+struct ProfileFrame
+{
+    int id;
+    qint64 start;
+    int tiles;
+    QVector<ProfileSpan> spans;
+};
+
+QAtomicInt RenderProfiler::Enabled(0);
+
+static QMutex ProfileLock;
+static QList<ProfileTile> Tiles;
+static QList<ProfileFrame> Frames;
+static QAtomicInt CurrentFrame(0);
+static QAtomicInt NextThread(0);
+
+static thread_local ProfileTile* CurrentTile = nullptr;
+static thread_local int ThreadIndex = 0;
+
+static const char* StageNames[RenderProfiler::StageCount] = {
+    "Tile", "Query", "BuildPath", "Painters", "Background", "Foreground", "Touchup", "Labels", "Composite"
+};
+
+static QElapsedTimer startedClock()
+{
+    QElapsedTimer C;
+    C.start();
+    return C;
+}
+
+qint64 RenderProfiler::now()
+{
+    static QElapsedTimer Clock = startedClock();
+    return Clock.nsecsElapsed();
+}
+
+const char* RenderProfiler::stageName(Stage aStage)
+{
+    return StageNames[aStage];
+}
+
+void RenderProfiler::setEnabled(bool b)
+{
+    Enabled.storeRelease(b ? 1 : 0);
+}
+
+void RenderProfiler::clear()
+{
+    QMutexLocker Lock(&ProfileLock);
+    Tiles.clear();
+    Frames.clear();
+}
+
+void RenderProfiler::beginFrame(int NumTiles)
+{
+    if (!isEnabled())
+        return;
+
+    ProfileFrame F;
+    F.id = CurrentFrame.fetchAndAddOrdered(1) + 1;
+    F.start = now();
+    F.tiles = NumTiles;
+
+    QMutexLocker Lock(&ProfileLock);
+    Frames << F;
+    while (Frames.size() > PROFILE_MAX_FRAMES)
+        Frames.removeFirst();
+}
+
+void RenderProfiler::beginTile(const QPoint& aTile)
+{
+    if (!isEnabled())
+        return;
+
+    if (!ThreadIndex)
+        ThreadIndex = NextThread.fetchAndAddRelaxed(1) + 1;
+
+    delete CurrentTile;
+    CurrentTile = new ProfileTile;
+    CurrentTile->frame = CurrentFrame.loadAcquire();
+    CurrentTile->thread = ThreadIndex;
+    CurrentTile->tile = aTile;
+    for (int i=0; i<StageCount; ++i)
+        CurrentTile->total[i] = 0;
+    CurrentTile->features = 0;
+    CurrentTile->vertices = 0;
+
+    ProfileSpan S = { Tile, now(), 0 };
+    CurrentTile->spans << S;
+}
+
+void RenderProfiler::countTile(int Features, int Vertices)
+{
+    if (!CurrentTile)
+        return;
+    CurrentTile->features += Features;
+    CurrentTile->vertices += Vertices;
+}
+
+void RenderProfiler::endTile()
+{
+    if (!CurrentTile)
+        return;
+
+    ProfileSpan& S = CurrentTile->spans[0];
+    S.duration = now() - S.start;
+    CurrentTile->total[Tile] = S.duration;
+
+    {
+        QMutexLocker Lock(&ProfileLock);
+        Tiles << *CurrentTile;
+        while (Tiles.size() > PROFILE_MAX_TILES)
+            Tiles.removeFirst();
+    }
+    delete CurrentTile;
+    CurrentTile = nullptr;
+}
+
+void RenderProfiler::add(Stage aStage, qint64 Start, qint64 Duration)
+{
+    ProfileSpan S = { aStage, Start, Duration };
+
+    if (aStage == Composite) {
+        QMutexLocker Lock(&ProfileLock);
+        if (!Frames.isEmpty())
+            Frames.last().spans << S;
+        return;
+    }
+
+    // Painters and paths are also resolved outside of tile rendering
+    if (!CurrentTile)
+        return;
+    CurrentTile->total[aStage] += Duration;
+    if (aStage != BuildPath && aStage != Painters)
+        CurrentTile->spans << S;
+}
+
+static inline qreal toMs(qint64 ns)
+{
+    return ns / 1000000.;
+}
+
+void RenderProfiler::drawOverlay(QPainter& P, const QRect& Rect)
+{
+    qint64 Totals[StageCount];
+    for (int i=0; i<StageCount; ++i)
+        Totals[i] = 0;
+    qint64 First = -1, Last = -1, Slowest = 0;
+    int NumTiles = 0, Requested = 0, Features = 0, Vertices = 0;
+    int FrameId = 0;
+
+    {
+        QMutexLocker Lock(&ProfileLock);
+        if (Frames.isEmpty())
+            return;
+
+        const ProfileFrame& F = Frames.last();
+        FrameId = F.id;
+        Requested = F.tiles;
+        foreach (const ProfileSpan& S, F.spans)
+            Totals[Composite] += S.duration;
+
+        // Tiles of cancelled frames may still come in, so do not stop early
+        foreach (const ProfileTile& T, Tiles) {
+            if (T.frame != FrameId)
+                continue;
+            ++NumTiles;
+            for (int s=0; s<StageCount; ++s)
+                if (s != Composite)
+                    Totals[s] += T.total[s];
+            Features += T.features;
+            Vertices += T.vertices;
+            Slowest = qMax(Slowest, T.total[Tile]);
+            if (First < 0 || T.spans[0].start < First)
+                First = T.spans[0].start;
+            Last = qMax(Last, T.spans[0].start + T.spans[0].duration);
+        }
+    }
+
+    QStringList Lines;
+    Lines << QString("Frame %1: %2/%3 tiles, %4 ms wall")
+             .arg(FrameId).arg(NumTiles).arg(Requested).arg(NumTiles ? toMs(Last - First) : 0., 0, 'f', 1);
+    Lines << QString("%1: %2 ms (slowest %3 ms)")
+             .arg(StageNames[Tile]).arg(toMs(Totals[Tile]), 0, 'f', 1).arg(toMs(Slowest), 0, 'f', 1);
+    for (int s=Query; s<StageCount; ++s)
+        Lines << QString("%1: %2 ms").arg(StageNames[s]).arg(toMs(Totals[s]), 0, 'f', 1);
+    Lines << QString("Features: %1, vertices: %2").arg(Features).arg(Vertices);
+
+    P.save();
+    QFontMetrics fm(P.font());
+    int w = 0;
+    foreach (const QString& L, Lines)
+        w = qMax(w, fm.width(L));
+    int h = fm.lineSpacing() * Lines.size();
+    QRect Box(Rect.right() - w - 20, Rect.top() + 10, w + 10, h + 10);
+    P.fillRect(Box, QColor(255, 255, 255, 192));
+    P.setPen(QColor(0, 0, 0));
+    for (int i=0; i<Lines.size(); ++i)
+        P.drawText(Box.left() + 5, Box.top() + 5 + fm.ascent() + i*fm.lineSpacing(), Lines[i]);
+    P.restore();
+}
+
+static void writeSpan(QTextStream& out, bool& First, const ProfileSpan& S, int tid, const QString& Args)
+{
+    if (!First)
+        out << ",\n";
+    First = false;
+    out << "{\"name\":\"" << StageNames[S.stage] << "\",\"cat\":\"render\",\"ph\":\"X\""
+        << ",\"ts\":" << QString::number(S.start / 1000., 'f', 3)
+        << ",\"dur\":" << QString::number(S.duration / 1000., 'f', 3)
+        << ",\"pid\":1,\"tid\":" << tid;
+    if (!Args.isEmpty())
+        out << ",\"args\":{" << Args << "}";
+    out << "}";
+}
+
+bool RenderProfiler::exportTrace(const QString& FileName)
+{
+    QList<ProfileTile> theTiles;
+    QList<ProfileFrame> theFrames;
+    {
+        QMutexLocker Lock(&ProfileLock);
+        theTiles = Tiles;
+        theFrames = Frames;
+    }
+
+    QFile File(FileName);
+    if (!File.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QTextStream out(&File);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GUI\"}}";
+    bool First = false;
+    int Threads = NextThread.loadAcquire();
+    for (int i=1; i<=Threads; ++i)
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i
+            << ",\"args\":{\"name\":\"Render " << i << "\"}}";
+
+    foreach (const ProfileFrame& F, theFrames) {
+        out << ",\n{\"name\":\"Frame " << F.id << "\",\"cat\":\"render\",\"ph\":\"i\",\"s\":\"g\""
+            << ",\"ts\":" << QString::number(F.start / 1000., 'f', 3)
+            << ",\"pid\":1,\"tid\":0,\"args\":{\"tiles\":" << F.tiles << "}}";
+        foreach (const ProfileSpan& S, F.spans)
+            writeSpan(out, First, S, 0, QString("\"frame\":%1").arg(F.id));
+    }
+
+    foreach (const ProfileTile& T, theTiles) {
+        QString TileArgs = QString("\"frame\":%1,\"x\":%2,\"y\":%3,\"features\":%4,\"vertices\":%5,\"buildPath_ms\":%6,\"painters_ms\":%7")
+                .arg(T.frame).arg(T.tile.x()).arg(T.tile.y()).arg(T.features).arg(T.vertices)
+                .arg(toMs(T.total[BuildPath]), 0, 'f', 3).arg(toMs(T.total[Painters]), 0, 'f', 3);
+        for (int i=0; i<T.spans.size(); ++i)
+            writeSpan(out, First, T.spans[i], T.thread, i ? QString() : TileArgs);
+    }
+
+    out << "\n]}\n";
+    return out.status() == QTextStream::Ok;
+}
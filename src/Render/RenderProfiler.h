@@ -0,0 +1,83 @@
+#ifndef RENDERPROFILER_H
+#define RENDERPROFILER_H
+
+#include <QAtomicInt>
+#include <QPoint>
+#include <QRect>
+#include <QString>
+
+class QPainter;
+
+/**
+  Per-stage timings of the OSM rendering.
+
+  While enabled, each tile rendered by OsmRenderLayer gets a record of the
+  time spent in its stages and of the number of features and vertices it
+  drew; the compositing of the tiles on the GUI thread is recorded per
+  frame (a frame being everything rendered after one forceRedraw or pan).
+
+  Stages are timed with RenderTimer scopes. BuildPath and Painters run
+  nested inside Query and the style layers respectively; they are only
+  summed, whereas the other stages are also kept as spans for the trace.
+
+  When disabled (the default), a RenderTimer costs a single flag test.
+*/
+class RenderProfiler
+{
+public:
+    enum Stage
+    {
+        Tile,
+        Query,
+        BuildPath,
+        Painters,
+        Background,
+        Foreground,
+        Touchup,
+        Labels,
+        Composite,
+        StageCount
+    };
+
+    static bool isEnabled() { return Enabled.loadAcquire(); }
+    static void setEnabled(bool b);
+    static void clear();
+
+    static qint64 now();
+    static const char* stageName(Stage aStage);
+
+    /// Start a new frame; called from the GUI thread
+    static void beginFrame(int Tiles);
+    /// Attach the calling thread to \a aTile until endTile()
+    static void beginTile(const QPoint& aTile);
+    static void countTile(int Features, int Vertices);
+    static void endTile();
+    static void add(Stage aStage, qint64 Start, qint64 Duration);
+
+    /// Draw the summary of the last frame in the corner of \a Rect
+    static void drawOverlay(QPainter& P, const QRect& Rect);
+    /// Write everything recorded as Chrome trace JSON (chrome://tracing)
+    static bool exportTrace(const QString& FileName);
+
+private:
+    static QAtomicInt Enabled;
+};
+
+/// Times its scope as \a aStage of the current tile (or frame, for Composite)
+class RenderTimer
+{
+public:
+    RenderTimer(RenderProfiler::Stage aStage)
+        : theStage(aStage), Start(RenderProfiler::isEnabled() ? RenderProfiler::now() : -1) {}
+    ~RenderTimer()
+    {
+        if (Start >= 0)
+            RenderProfiler::add(theStage, Start, RenderProfiler::now() - Start);
+    }
+
+private:
+    RenderProfiler::Stage theStage;
+    qint64 Start;
+};
+
+#endif // RENDERPROFILER_H
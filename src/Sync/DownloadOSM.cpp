@@ -20,6 +20,7 @@
 
 #include <QBuffer>
 #include <QTimer>
+#include <QNetworkReply>
 #include <QComboBox>
 #include <QMessageBox>
 #include <QProgressBar>
@@ -28,6 +29,14 @@
 #include <QStatusBar>
 #include <QInputDialog>
 
+// The API refuses /map requests above this area (square degrees)
+#define DOWNLOAD_TILE_AREA 0.25
+// Requests in flight at once for a tiled download
+#define DOWNLOAD_CONCURRENT_TILES 4
+// Ask before downloading more tiles than this
+#define DOWNLOAD_TILES_WARNING 16
+#define DOWNLOAD_MAX_REDIRECTS 5
+
 /* DOWNLOADER */
 
 Downloader::Downloader(const QString& aUser, const QString& aPwd)
@@ -274,6 +283,209 @@ QString Downloader::getURLToTrackPoints()
     return URL;
 }
 
+/* TILEDDOWNLOADER */
+
+TiledDownloader::TiledDownloader(const QString& aUser, const QString& aPwd, int aMaxConcurrent)
+: User(aUser), Password(aPwd), MaxConcurrent(qMax(1, aMaxConcurrent)),
+  NextToStart(0), Taken(0), BytesDone(0), Canceled(false)
+{
+    connect(&netManager,SIGNAL(finished(QNetworkReply*)),this,SLOT(on_requestFinished(QNetworkReply*)));
+    connect(&netManager,SIGNAL(authenticationRequired(QNetworkReply*,QAuthenticator*)), this,SLOT(on_authenticationRequired(QNetworkReply*,QAuthenticator*)));
+}
+
+TiledDownloader::~TiledDownloader()
+{
+    cancel();
+}
+
+QList<CoordBox> TiledDownloader::planTiles(const CoordBox& aBox, qreal aMaxArea)
+{
+    QList<CoordBox> Tiles;
+    qreal W = aBox.lonDiff();
+    qreal H = aBox.latDiff();
+    if (W*H <= aMaxArea || aMaxArea <= 0.) {
+        Tiles << aBox;
+        return Tiles;
+    }
+
+    // Square-ish tiles of equal size covering the box
+    qreal Side = sqrt(aMaxArea);
+    int nx = qMax(1, int(ceil(W / Side)));
+    int ny = qMax(1, int(ceil(H / Side)));
+    while ((W/nx) * (H/ny) > aMaxArea) {
+        if (W/nx > H/ny) ++nx; else ++ny;
+    }
+
+    qreal Left = aBox.bottomLeft().x();
+    qreal Bottom = aBox.bottomLeft().y();
+    for (int j=0; j<ny; ++j) {
+        qreal b = Bottom + H*j/ny;
+        qreal t = (j == ny-1) ? aBox.topRight().y() : Bottom + H*(j+1)/ny;
+        for (int i=0; i<nx; ++i) {
+            qreal l = Left + W*i/nx;
+            qreal r = (i == nx-1) ? aBox.topRight().x() : Left + W*(i+1)/nx;
+            Tiles << CoordBox(Coord(l, b), Coord(r, t));
+        }
+    }
+    return Tiles;
+}
+
+void TiledDownloader::add(const QUrl& url)
+{
+    Urls << url;
+    startPending();
+}
+
+int TiledDownloader::size() const
+{
+    return Urls.size();
+}
+
+int TiledDownloader::taken() const
+{
+    return Taken;
+}
+
+qint64 TiledDownloader::bytesReceived() const
+{
+    qint64 Bytes = BytesDone;
+    QHashIterator<QNetworkReply*, qint64> it(Received);
+    while (it.hasNext())
+        Bytes += it.next().value();
+    return Bytes;
+}
+
+bool TiledDownloader::isCanceled() const
+{
+    return Canceled;
+}
+
+void TiledDownloader::cancel()
+{
+    Canceled = true;
+    // abort() emits finished() synchronously, which edits Running
+    QList<QNetworkReply*> Replies = Running.keys();
+    foreach (QNetworkReply* reply, Replies)
+        reply->abort();
+    if (Loop.isRunning())
+        Loop.exit(QDialog::Rejected);
+}
+
+bool TiledDownloader::next(int& Index, QByteArray& Content, int& Result, QString& ResultText, QString& ErrorText)
+{
+    while (!Canceled && Done.isEmpty() && Taken < Urls.size())
+        Loop.exec();
+    if (Canceled || Done.isEmpty())
+        return false;
+
+    Response R = Done.dequeue();
+    ++Taken;
+    Index = R.Index;
+    Content = R.Content;
+    Result = R.Result;
+    ResultText = R.ResultText;
+    ErrorText = R.ErrorText;
+
+    startPending();
+    return true;
+}
+
+void TiledDownloader::startPending()
+{
+    // Completed responses count against the limit too, so that a slow parser
+    // does not let unparsed tiles pile up in memory
+    while (!Canceled && NextToStart < Urls.size()
+           && Running.size() < MaxConcurrent
+           && Running.size() + Done.size() < 2*MaxConcurrent)
+    {
+        start(NextToStart, Urls[NextToStart]);
+        ++NextToStart;
+    }
+}
+
+void TiledDownloader::start(int Index, const QUrl& url)
+{
+    qDebug() << "TiledDownloader::start:" << url;
+
+    netManager.setProxy(M_PREFS->getProxy(url));
+    QNetworkRequest req(url);
+    req.setRawHeader(QByteArray("Content-Type"), QByteArray("text/xml"));
+    req.setRawHeader(QByteArray("User-Agent"), USER_AGENT.toLatin1());
+
+    QNetworkReply* reply = netManager.get(req);
+    Running.insert(reply, Index);
+    Received.insert(reply, 0);
+    connect(reply,SIGNAL(downloadProgress(qint64, qint64)), this,SLOT(on_downloadProgress(qint64, qint64)));
+}
+
+void TiledDownloader::on_requestFinished(QNetworkReply* reply)
+{
+    if (!Running.contains(reply))
+        return;
+    int Index = Running.take(reply);
+    BytesDone += Received.take(reply);
+    reply->deleteLater();
+
+    if (Canceled)
+        return;
+
+    QVariant redir = reply->attribute(QNetworkRequest::RedirectionTargetAttribute);
+    if (redir.isValid() && !redir.toUrl().isEmpty() && Redirects[Index]++ < DOWNLOAD_MAX_REDIRECTS) {
+        start(Index, reply->url().resolved(redir.toUrl()));
+        return;
+    }
+
+    if (reply->error()) {
+        qDebug() << "TiledDownloader: received response with code"
+            << reply->error() << ", message" << reply->errorString();
+    }
+
+    Response R;
+    R.Index = Index;
+    R.Content = reply->readAll();
+    R.Result = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    R.ResultText = reply->errorString();
+    R.ErrorText = reply->rawHeader("Error");
+    Done.enqueue(R);
+
+    startPending();
+    emit progress();
+    if (Loop.isRunning())
+        Loop.exit(QDialog::Accepted);
+}
+
+void TiledDownloader::on_authenticationRequired(QNetworkReply* reply, QAuthenticator* auth)
+{
+    /* Only provide authentication the first time we see this reply, to avoid
+     * infinite loop providing the same credentials. */
+    if (!reply->property("authProvided").toBool()) {
+        reply->setProperty("authProvided", true);
+        auth->setUser(User);
+        auth->setPassword(Password);
+    }
+}
+
+void TiledDownloader::on_downloadProgress(qint64 done, qint64 /*total*/)
+{
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+    if (reply && Received.contains(reply)) {
+        Received[reply] = done;
+        emit progress();
+    }
+}
+
+static void reportDownloadError(QWidget* aParent, int x, const QString& ResultText, const QString& ErrorText)
+{
+    if (x == 401) {
+        QMessageBox::warning(aParent,QApplication::translate("Downloader","Download failed"),QApplication::translate("Downloader","Username/password invalid"));
+        return;
+    }
+    QString msg = QApplication::translate("Downloader","Unexpected http status code (%1)\nServer message is '%2'").arg(x).arg(ResultText);
+    if (!ErrorText.isEmpty())
+        msg += QApplication::translate("Downloader", "\nAPI message is '%1'").arg(ErrorText);
+    QMessageBox::warning(aParent,QApplication::translate("Downloader","Download failed"), msg);
+}
+
 bool downloadOSM(QWidget* aParent, const QUrl& theUrl, const QString& aUser, const QString& aPassword, Document* theDocument, Layer* theLayer)
 {
     Downloader Rcv(aUser, aPassword);
@@ -324,22 +536,13 @@ bool downloadOSM(QWidget* aParent, const QUrl& theUrl, const QString& aUser, con
             QUrl aURL(aWeb);
             return downloadOSM(aParent, aURL, aUser, aPassword, theDocument, theLayer);
         } else {
-            QString msg = QApplication::translate("Downloader","Unexpected http status code (%1)\nServer message is '%2'").arg(x).arg(Rcv.resultText());
-            if (!Rcv.errorText().isEmpty())
-                msg += QApplication::translate("Downloader", "\nAPI message is '%1'").arg(Rcv.errorText());
-            QMessageBox::warning(aParent,QApplication::translate("Downloader","Download failed"), msg);
+            reportDownloadError(aParent, x, Rcv.resultText(), Rcv.errorText());
             return false;
         }
         break;
     }
-    case 401:
-        QMessageBox::warning(aParent,QApplication::translate("Downloader","Download failed"),QApplication::translate("Downloader","Username/password invalid"));
-        return false;
     default:
-        QString msg = QApplication::translate("Downloader","Unexpected http status code (%1)\nServer message is '%2'").arg(x).arg(Rcv.resultText());
-        if (!Rcv.errorText().isEmpty())
-            msg += QApplication::translate("Downloader", "\nAPI message is '%1'").arg(Rcv.errorText());
-        QMessageBox::warning(aParent,QApplication::translate("Downloader","Download failed"), msg);
+        reportDownloadError(aParent, x, Rcv.resultText(), Rcv.errorText());
         return false;
     }
     Downloader Down(aUser, aPassword);
@@ -347,6 +550,75 @@ bool downloadOSM(QWidget* aParent, const QUrl& theUrl, const QString& aUser, con
     return OK;
 }
 
+static bool downloadOSMTiles(QWidget* aParent, const QString& aWeb, const QString& aUser, const QString& aPassword, const QList<CoordBox>& Tiles, Document* theDocument, Layer* theLayer)
+{
+    TiledDownloader Rcv(aUser, aPassword, DOWNLOAD_CONCURRENT_TILES);
+    Downloader Down(aUser, aPassword);
+
+    QProgressDialog* dlg = NULL;
+    QProgressBar* Bar = NULL;
+    QLabel* Lbl = NULL;
+    IProgressWindow* aProgressWindow = dynamic_cast<IProgressWindow*>(aParent);
+    if (aProgressWindow) {
+        dlg = aProgressWindow->getProgressDialog();
+        if (dlg) {
+            dlg->setWindowTitle(QApplication::translate("Downloader","Downloading..."));
+            dlg->setWindowFlags(dlg->windowFlags() & ~Qt::WindowContextHelpButtonHint);
+            dlg->setWindowFlags(dlg->windowFlags() | Qt::MSWindowsFixedSizeDialogHint);
+            QObject::connect(dlg, SIGNAL(canceled()), &Rcv, SLOT(cancel()));
+        }
+
+        Bar = aProgressWindow->getProgressBar();
+        Bar->setTextVisible(false);
+        Bar->setMaximum(Tiles.size());
+        Bar->setValue(0);
+
+        Lbl = aProgressWindow->getProgressLabel();
+        Lbl->setText(QApplication::translate("Downloader","Downloading from OSM (connecting)"));
+
+        if (dlg)
+            dlg->show();
+
+        QObject::connect(&Rcv, &TiledDownloader::progress, [&Rcv, Lbl]() {
+            Lbl->setText(QApplication::translate("Downloader","Downloading area %1 of %2 (%n kBytes)", "", int(Rcv.bytesReceived()/1024))
+                         .arg(qMin(Rcv.taken()+1, Rcv.size())).arg(Rcv.size()));
+        });
+    }
+
+    QString URL = Down.getURLToMap();
+    foreach (const CoordBox& Tile, Tiles) {
+        QString TileURL = URL.arg(Tile.bottomLeft().x(), 0, 'f').arg(Tile.bottomLeft().y(), 0, 'f').arg(Tile.topRight().x(), 0, 'f').arg(Tile.topRight().y(), 0, 'f');
+        Rcv.add(QUrl(aWeb+TileURL));
+    }
+
+    // Parse each tile as soon as it arrives, while the others are still in flight.
+    // Features on tile borders come back more than once; OSMHandler merges them
+    // with the copy already in the document.
+    OSMImport theImport(aParent, theDocument, theLayer, &Down);
+    bool OK = true;
+    int Index, Result;
+    QByteArray Content;
+    QString ResultText, ErrorText;
+    while (OK && Rcv.next(Index, Content, Result, ResultText, ErrorText))
+    {
+        qDebug() << "DownloadOSM: Received OSM API response code:" << Result << "for area" << Index+1;
+        if (Result != 200) {
+            Rcv.cancel();
+            reportDownloadError(aParent, Result, ResultText, ErrorText);
+            OK = false;
+            break;
+        }
+        OK = theImport.add(Content.constData(), Content.size());
+        Content.clear();
+        if (Bar)
+            Bar->setValue(Rcv.taken());
+    }
+    if (Rcv.isCanceled())
+        OK = false;
+
+    return theImport.finish(!OK) && OK;
+}
+
 bool downloadOSM(QWidget* aParent, const QString& aWeb, const QString& aUser, const QString& aPassword, const CoordBox& aBox , Document* theDocument, Layer* theLayer)
 {
     if (checkForConflicts(theDocument))
@@ -354,9 +626,8 @@ bool downloadOSM(QWidget* aParent, const QString& aWeb, const QString& aUser, co
         QMessageBox::warning(aParent,QApplication::translate("Downloader","Unresolved conflicts"), QApplication::translate("Downloader","Please resolve existing conflicts first"));
         return false;
     }
-    Downloader Rcv(aUser, aPassword);
-    QString URL = Rcv.getURLToMap();
 
+    QList<CoordBox> Areas;
     if ((fabs(aBox.bottomLeft().x()) < 180.0 && fabs(aBox.topRight().x()) > 180.0) 
      || (fabs(aBox.bottomLeft().x()) > 180.0 && fabs(aBox.topRight().x()) < 180.0)) {
         /* Check for +-180 meridian, and split query in two if necessary */
@@ -371,15 +642,31 @@ bool downloadOSM(QWidget* aParent, const QString& aWeb, const QString& aUser, co
             q2.setRight(-180*sign);
             q2.setLeft(q2.left()+360);
         }
-        return downloadOSM(aParent, aWeb, aUser, aPassword, q1, theDocument, theLayer)
-            && downloadOSM(aParent, aWeb, aUser, aPassword, q2, theDocument, theLayer);
+        Areas << q1 << q2;
+    } else
+        Areas << aBox;
+
+    /* Split areas the API would refuse into tiles */
+    QList<CoordBox> Tiles;
+    foreach (const CoordBox& Area, Areas)
+        Tiles << TiledDownloader::planTiles(Area, DOWNLOAD_TILE_AREA);
 
-    } else {
+    if (Tiles.size() == 1) {
         /* Normal code path */
+        Downloader Rcv(aUser, aPassword);
+        QString URL = Rcv.getURLToMap();
         URL = URL.arg(aBox.bottomLeft().x(), 0, 'f').arg(aBox.bottomLeft().y(), 0, 'f').arg(aBox.topRight().x(), 0, 'f').arg(aBox.topRight().y(), 0, 'f');
         QUrl theUrl(aWeb+URL);
         return downloadOSM(aParent, theUrl, aUser, aPassword, theDocument, theLayer);
     }
+
+    if (Tiles.size() > DOWNLOAD_TILES_WARNING) {
+        if (QMessageBox::question(aParent, QApplication::translate("Downloader","Large download"),
+                QApplication::translate("Downloader","The selected area is too large for a single request and will be downloaded in %1 parts.\nDo you want to continue?").arg(Tiles.size()),
+                QMessageBox::Yes | QMessageBox::No, QMessageBox::No) != QMessageBox::Yes)
+            return false;
+    }
+    return downloadOSMTiles(aParent, aWeb, aUser, aPassword, Tiles, theDocument, theLayer);
 }
 
 bool downloadTracksFromOSM(QWidget* Main, const QString& aWeb, const QString& aUser, const QString& aPassword, const CoordBox& aBox , Document* theDocument)
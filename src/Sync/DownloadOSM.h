@@ -18,6 +18,8 @@ class SpecialLayer;
 #include <QtCore/QByteArray>
 #include <QtCore/QEventLoop>
 #include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QQueue>
 #include <QNetworkAccessManager>
 #include <QUrl>
 
@@ -75,6 +77,72 @@ class Downloader : public QObject
         QTimer *AnimationTimer;
 };
 
+/**
+  Fetches a list of URLs with at most a few requests in flight over one
+  QNetworkAccessManager, handing the responses back as they complete.
+  Used to download a large area as several API-sized tiles, and for the
+  multi-fetch requests that resolve incomplete relations.
+*/
+class TiledDownloader : public QObject
+{
+    Q_OBJECT
+
+    public:
+        TiledDownloader(const QString& aUser, const QString& aPwd, int aMaxConcurrent);
+        ~TiledDownloader();
+
+        /// Split \a aBox into a grid of boxes of at most \a aMaxArea square degrees
+        static QList<CoordBox> planTiles(const CoordBox& aBox, qreal aMaxArea);
+
+        void add(const QUrl& url);
+        /// Wait for the next response, in completion order. Returns false when
+        /// all responses have been taken or the download was canceled.
+        bool next(int& Index, QByteArray& Content, int& Result, QString& ResultText, QString& ErrorText);
+
+        int size() const;
+        int taken() const;
+        qint64 bytesReceived() const;
+        bool isCanceled() const;
+
+    signals:
+        void progress();
+
+    public slots:
+        void cancel();
+
+    private slots:
+        void on_requestFinished( QNetworkReply *reply);
+        void on_authenticationRequired( QNetworkReply *reply, QAuthenticator *auth);
+        void on_downloadProgress( qint64 done, qint64 total );
+
+    private:
+        struct Response
+        {
+            int Index;
+            QByteArray Content;
+            int Result;
+            QString ResultText;
+            QString ErrorText;
+        };
+
+        void startPending();
+        void start(int Index, const QUrl& url);
+
+        QNetworkAccessManager netManager;
+        QString User, Password;
+        int MaxConcurrent;
+        QList<QUrl> Urls;
+        int NextToStart;
+        int Taken;
+        QHash<QNetworkReply*, int> Running;
+        QHash<QNetworkReply*, qint64> Received;
+        QHash<int, int> Redirects;
+        QQueue<Response> Done;
+        qint64 BytesDone;
+        bool Canceled;
+        QEventLoop Loop;
+};
+
 bool downloadOSM(MainWindow* Main, const CoordBox& aBox , Document* theDocument);
 bool downloadMoreOSM(MainWindow* Main, const CoordBox& aBox , Document* theDocument);
 bool downloadFeatures(MainWindow* Main, const QList<Feature*>& aDownloadList , Document* theDocument);
@@ -0,0 +1,326 @@
+#include "GdalRasterReader.h"
+
+#include <QColor>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QVector>
+
+#include <QDebug>
+
+#include "gdal_priv.h"
+
+#define BLOCK_SIZE 256
+#define BLOCK_CACHE_KB (128*1024)
+
+static inline quint64 blockKey(int Level, int bx, int by)
+{
+    return (quint64(Level) << 56) | (quint64(by) << 28) | quint64(bx);
+}
+
+static inline int keyLevel(quint64 Key) { return int(Key >> 56); }
+static inline int keyY(quint64 Key) { return int((Key >> 28) & 0xfffffff); }
+static inline int keyX(quint64 Key) { return int(Key & 0xfffffff); }
+
+GdalRasterReader::GdalRasterReader(GDALDataset* aDataset, QObject* parent)
+    : QThread(parent), poDataset(aDataset), MaxLevel(0)
+    , theType(Unknown), ixA(-1)
+    , ixR(0), ixG(0), ixB(0), ixH(0), ixS(0), ixL(0)
+    , ixC(0), ixM(0), ixY(0), ixK(0), ixYuvY(0), ixYuvU(0), ixYuvV(0)
+    , UnknownUnit(1.), colTable(NULL)
+    , Blocks(BLOCK_CACHE_KB), Stopping(false)
+{
+    theSize = QSize(poDataset->GetRasterXSize(), poDataset->GetRasterYSize());
+    int Largest = qMax(theSize.width(), theSize.height());
+    while ((Largest >> MaxLevel) > BLOCK_SIZE)
+        ++MaxLevel;
+
+    adfMinMax[0] = 0.;
+    adfMinMax[1] = 255.;
+    bandCount = poDataset->GetRasterCount();
+    for (int i=0; i<bandCount; ++i) {
+        GDALRasterBand  *poBand = poDataset->GetRasterBand( i+1 );
+        GDALColorInterp bandtype = poBand->GetColorInterpretation();
+        qDebug() << "Band " << i+1 << " Color: " <<  GDALGetColorInterpretationName(poBand->GetColorInterpretation());
+
+        switch (bandtype)
+        {
+        case GCI_Undefined:
+            theType = Unknown;
+            int             bGotMin, bGotMax;
+            adfMinMax[0] = poBand->GetMinimum( &bGotMin );
+            adfMinMax[1] = poBand->GetMaximum( &bGotMax );
+            if( ! (bGotMin && bGotMax) )
+                GDALComputeRasterMinMax((GDALRasterBandH)poBand, TRUE, adfMinMax);
+            UnknownUnit = (adfMinMax[1] - adfMinMax[0]) / 256;
+            if (UnknownUnit == 0.)
+                UnknownUnit = 1.;
+            break;
+        case GCI_GrayIndex:
+            theType = GrayScale;
+            break;
+        case GCI_RedBand:
+            theType = Rgb;
+            ixR = i;
+            break;
+        case GCI_GreenBand:
+            theType = Rgb;
+            ixG = i;
+            break;
+        case GCI_BlueBand :
+            theType = Rgb;
+            ixB = i;
+            break;
+        case GCI_HueBand:
+            theType = Hsl;
+            ixH = i;
+            break;
+        case GCI_SaturationBand:
+            theType = Hsl;
+            ixS = i;
+            break;
+        case GCI_LightnessBand:
+            theType = Hsl;
+            ixL = i;
+            break;
+        case GCI_CyanBand:
+            theType = Cmyk;
+            ixC = i;
+            break;
+        case GCI_MagentaBand:
+            theType = Cmyk;
+            ixM = i;
+            break;
+        case GCI_YellowBand:
+            theType = Cmyk;
+            ixY = i;
+            break;
+        case GCI_BlackBand:
+            theType = Cmyk;
+            ixK = i;
+            break;
+        case GCI_YCbCr_YBand:
+            theType = YUV;
+            ixYuvY = i;
+            break;
+        case GCI_YCbCr_CbBand:
+            theType = YUV;
+            ixYuvU = i;
+            break;
+        case GCI_YCbCr_CrBand:
+            theType = YUV;
+            ixYuvV = i;
+            break;
+        case GCI_AlphaBand:
+            ixA = i;
+            break;
+        case GCI_PaletteIndex:
+            colTable = poBand->GetColorTable();
+            switch (colTable->GetPaletteInterpretation())
+            {
+            case GPI_Gray :
+                theType = Palette_Gray;
+                break;
+            case GPI_RGB :
+                theType = Palette_RGBA;
+                break;
+            case GPI_CMYK :
+                theType = Palette_CMYK;
+                break;
+            case GPI_HLS :
+                theType = Palette_HLS;
+                break;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    start(QThread::LowPriority);
+}
+
+GdalRasterReader::~GdalRasterReader()
+{
+    Mutex.lock();
+    Stopping = true;
+    Queue.clear();
+    Wanted.wakeAll();
+    Mutex.unlock();
+    wait();
+
+    GDALClose((GDALDatasetH)poDataset);
+}
+
+/// The part of the full resolution raster covered by a block of \a Level
+QRect GdalRasterReader::blockRect(int Level, int bx, int by) const
+{
+    int Span = BLOCK_SIZE << Level;
+    QRect R(bx*Span, by*Span, Span, Span);
+    return R.intersected(QRect(QPoint(0, 0), theSize));
+}
+
+void GdalRasterReader::draw(QPainter& P, const QRect& aSource, const QRectF& aTarget)
+{
+    QRect Source = aSource.intersected(QRect(QPoint(0, 0), theSize));
+    if (Source.isEmpty() || aTarget.isEmpty())
+        return;
+
+    // Each level halves the resolution; use the coarsest one that still has
+    // at least one raster pixel per screen pixel.
+    qreal sx = aTarget.width() / aSource.width();
+    qreal sy = aTarget.height() / aSource.height();
+    qreal Decimation = 1. / qMax(sx, sy);
+    int Level = 0;
+    while (Level < MaxLevel && (2 << Level) <= Decimation)
+        ++Level;
+    int Span = BLOCK_SIZE << Level;
+
+    QList<quint64> Missing;
+    QMutexLocker Lock(&Mutex);
+    for (int by = Source.top() / Span; by <= Source.bottom() / Span; ++by) {
+        for (int bx = Source.left() / Span; bx <= Source.right() / Span; ++bx) {
+            QRect R = blockRect(Level, bx, by);
+            QRectF Target(aTarget.left() + (R.left() - aSource.left()) * sx,
+                          aTarget.top() + (R.top() - aSource.top()) * sy,
+                          R.width() * sx, R.height() * sy);
+
+            quint64 Key = blockKey(Level, bx, by);
+            if (QImage* Img = Blocks.object(Key)) {
+                P.drawImage(Target, *Img);
+                continue;
+            }
+            Missing << Key;
+
+            for (int L = Level+1; L <= MaxLevel; ++L) {
+                int Shift = L - Level;
+                QImage* Img = Blocks.object(blockKey(L, bx >> Shift, by >> Shift));
+                if (!Img)
+                    continue;
+                QRect C = blockRect(L, bx >> Shift, by >> Shift);
+                qreal f = 1. / (1 << L);
+                QRectF From((R.left() - C.left()) * f, (R.top() - C.top()) * f, R.width() * f, R.height() * f);
+                P.drawImage(Target, *Img, From);
+                break;
+            }
+        }
+    }
+
+    // Requests for a previous view are of no use anymore
+    Queue = Missing;
+    if (!Queue.isEmpty())
+        Wanted.wakeOne();
+}
+
+void GdalRasterReader::run()
+{
+    forever {
+        quint64 Key;
+        {
+            QMutexLocker Lock(&Mutex);
+            while (Queue.isEmpty() && !Stopping)
+                Wanted.wait(&Mutex);
+            if (Stopping)
+                return;
+            Key = Queue.takeFirst();
+        }
+
+        QImage* Img = new QImage(readBlock(Key));
+
+        bool Done;
+        {
+            QMutexLocker Lock(&Mutex);
+            Blocks.insert(Key, Img, Img->byteCount() / 1024 + 1);
+            Done = Queue.isEmpty();
+        }
+        if (Done)
+            emit blocksRead();
+    }
+}
+
+QImage GdalRasterReader::readBlock(quint64 Key)
+{
+    int Level = keyLevel(Key);
+    QRect R = blockRect(Level, keyX(Key), keyY(Key));
+    int w = qMax(1, (R.width() + (1 << Level) - 1) >> Level);
+    int h = qMax(1, (R.height() + (1 << Level) - 1) >> Level);
+
+    QImage Img(w, h, QImage::Format_ARGB32);
+    QVector<float> Buf(w * h * bandCount);
+    CPLErr err = poDataset->RasterIO( GF_Read, R.x(), R.y(), R.width(), R.height(),
+            Buf.data(), w, h, GDT_Float32, bandCount,
+            NULL, sizeof(float) * bandCount, sizeof(float) * bandCount * w, sizeof(float) );
+    if (err != CE_None) {
+        // Cache it anyway, or the block would be requested over and over
+        qDebug() << "RasterIO failed to read block " << R;
+        Img.fill(Qt::transparent);
+        return Img;
+    }
+
+    const float* v = Buf.constData();
+    for (int y = 0; y < h; ++y) {
+        QRgb* Line = reinterpret_cast<QRgb*>(Img.scanLine(y));
+        for (int x = 0; x < w; ++x, v += bandCount)
+            Line[x] = pixel(v);
+    }
+    return Img;
+}
+
+QRgb GdalRasterReader::pixel(const float* v) const
+{
+    int a = 255;
+    if (ixA != -1)
+        a = v[ixA];
+
+    switch (theType)
+    {
+    case Unknown:
+    {
+        float val = (*v - adfMinMax[0]) / UnknownUnit;
+        return qRgb(val, val, val);
+    }
+    case GrayScale:
+        return qRgb(*v, *v, *v);
+    case Rgb:
+        return qRgba(v[ixR], v[ixG], v[ixB], a);
+#if QT_VERSION >= 0x040600
+    case Hsl:
+        return QColor::fromHsl(v[ixH], v[ixS], v[ixL], a).rgba();
+#endif
+    case Cmyk:
+        return QColor::fromCmyk(v[ixC], v[ixM], v[ixY], v[ixK], a).rgba();
+    case YUV:
+    {
+        // From http://www.fourcc.org/fccyvrgb.php
+        float y = v[ixYuvY];
+        float u = v[ixYuvU];
+        float w = v[ixYuvV];
+        float R = 1.164*(y - 16) + 1.596*(w - 128);
+        float G = 1.164*(y - 16) - 0.813*(w - 128) - 0.391*(u - 128);
+        float B = 1.164*(y - 16) + 2.018*(u - 128);
+        return qRgba(qBound(0.f, R, 255.f), qBound(0.f, G, 255.f), qBound(0.f, B, 255.f), a);
+    }
+    default:
+        break;
+    }
+
+    if (!colTable)
+        return qRgba(0, 0, 0, 0);
+    const GDALColorEntry* color = colTable->GetColorEntry(int(*v));
+    if (!color)
+        return qRgba(0, 0, 0, 0);
+    switch (theType)
+    {
+    case Palette_Gray:
+        return qRgb(color->c1, color->c1, color->c1);
+    case Palette_RGBA:
+        return qRgba(color->c1, color->c2, color->c3, color->c4);
+#if QT_VERSION >= 0x040600
+    case Palette_HLS:
+        return QColor::fromHsl(color->c1, color->c2, color->c3, color->c4).rgba();
+#endif
+    case Palette_CMYK:
+        return QColor::fromCmyk(color->c1, color->c2, color->c3, color->c4).rgba();
+    default:
+        return qRgba(0, 0, 0, 0);
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef GDALRASTERREADER_H
+#define GDALRASTERREADER_H
+
+#include <QCache>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QSize>
+#include <QThread>
+#include <QWaitCondition>
+
+class GDALDataset;
+class GDALColorTable;
+class QPainter;
+
+/**
+  Windowed reader for GDAL rasters.
+
+  Instead of decoding the whole file up front, the raster is read in blocks
+  of BLOCK_SIZE pixels, and only for the window being drawn. Each block is
+  read at the resolution it is shown at (RasterIO downsamples into the block
+  buffer, using the raster's overviews when there are any), so a zoomed out
+  view of a large image reads about as many pixels as the screen has.
+
+  Blocks are read on the reader's own thread and kept in an LRU cache;
+  blocksRead() is emitted once the blocks requested by the last draw() are
+  in. Until then, cached blocks of a coarser level stand in for them.
+*/
+class GdalRasterReader : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum ImgType
+    {
+        Unknown,
+        GrayScale,
+        Rgb,
+        Hsl,
+        Cmyk,
+        YUV,
+        Palette_Gray,
+        Palette_RGBA,
+        Palette_CMYK,
+        Palette_HLS
+    };
+
+    /// Takes ownership of \a aDataset, which must not be used afterwards
+    GdalRasterReader(GDALDataset* aDataset, QObject* parent = 0);
+    ~GdalRasterReader();
+
+    QSize size() const { return theSize; }
+
+    /// Draw the raster pixels \a aSource into \a aTarget on \a P.
+    /// Must be called from the GUI thread.
+    void draw(QPainter& P, const QRect& aSource, const QRectF& aTarget);
+
+signals:
+    void blocksRead();
+
+protected:
+    virtual void run();
+
+private:
+    QRect blockRect(int Level, int bx, int by) const;
+    QImage readBlock(quint64 Key);
+    QRgb pixel(const float* v) const;
+
+    GDALDataset* poDataset;
+    QSize theSize;
+    int MaxLevel;
+
+    ImgType theType;
+    int bandCount;
+    int ixA;
+    int ixR, ixG, ixB;
+    int ixH, ixS, ixL;
+    int ixC, ixM, ixY, ixK;
+    int ixYuvY, ixYuvU, ixYuvV;
+    double adfMinMax[2];
+    double UnknownUnit;
+    GDALColorTable* colTable;
+
+    QMutex Mutex;
+    QWaitCondition Wanted;
+    QCache<quint64, QImage> Blocks;
+    QList<quint64> Queue;
+    bool Stopping;
+};
+
+#endif // GDALRASTERREADER_H
@@ -1,6 +1,7 @@
 #include "TagSelector.h"
 
 #include "IFeature.h"
+#include "Global.h"
 
 void skipWhite(const QString& Expression, int& idx)
 {
@@ -343,6 +344,28 @@ TagSelector::~TagSelector()
 {
 }
 
+bool TagSelector::candidates(QSet<Feature*>& /* Result */) const
+{
+    return false;
+}
+
+/* Features with the key whose value passes the test; features without the key are left out */
+template<class Test>
+static bool taggedWith(const QString& Key, QSet<Feature*>& Result, Test valueMatches)
+{
+    Result.clear();
+    quint32 k = g_getTagKeyIndex(Key);
+    if (k == quint32(-1))
+        return true;
+
+    QHash<quint32, QSet<Feature*> > Values = g_backend.taggedFeatures(k);
+    QHash<quint32, QSet<Feature*> >::const_iterator it = Values.constBegin();
+    for (; it != Values.constEnd(); ++it)
+        if (valueMatches(g_getTagValue(it.key())))
+            Result.unite(it.value());
+    return true;
+}
+
 
 /* TAGSELECTOROPERATOR */
 
@@ -776,6 +799,14 @@ QString TagSelectorOperator::asExpression(bool) const
     return "[" + Key + "]" + Oper + Value;
 }
 
+bool TagSelectorOperator::candidates(QSet<Feature*>& Result) const
+{
+    // A missing key reads as emptyString, which only a _NULL_ test matches
+    if (specialKey != TagSelectKey_None || specialValue == TagSelectValue_Empty || Key == "*")
+        return false;
+    return taggedWith(Key, Result, [this](const QString& V) { return evaluateVal(V) == TagSelect_Match; });
+}
+
 /* TAGSELECTORISONEOF */
 
 TagSelectorIsOneOf::TagSelectorIsOneOf(const QString& key, const QStringList& values)
@@ -872,6 +903,24 @@ QString TagSelectorIsOneOf::asExpression(bool) const
     return "[" + Key + "] isoneof (" + Values.join(" , ") + ")";
 }
 
+bool TagSelectorIsOneOf::candidates(QSet<Feature*>& Result) const
+{
+    if (specialKey != TagSelectKey_None || specialValue == TagSelectValue_Empty)
+        return false;
+    auto valueMatches = [this](const QString& V) {
+        if (exactMatchv.contains(V))
+            return true;
+        foreach (QRegExp pattern, rxv)
+            if (pattern.exactMatch(V))
+                return true;
+        return false;
+    };
+    // A missing key reads as emptyString, which a wildcard may match
+    if (valueMatches(emptyString))
+        return false;
+    return taggedWith(Key, Result, valueMatches);
+}
+
 /* TAGSELECTORTYPEIS */
 
 TagSelectorTypeIs::TagSelectorTypeIs(const QString& type)
@@ -977,6 +1026,18 @@ QString TagSelectorOr::asExpression(bool Precedence) const
     return R;
 }
 
+bool TagSelectorOr::candidates(QSet<Feature*>& Result) const
+{
+    Result.clear();
+    QSet<Feature*> Term;
+    for (int i=0; i<Terms.size(); ++i) {
+        if (!Terms[i]->candidates(Term))
+            return false;
+        Result.unite(Term);
+    }
+    return true;
+}
+
 
 /* TAGSELECTORAND */
 
@@ -1018,6 +1079,21 @@ QString TagSelectorAnd::asExpression(bool /* Precedence */) const
     return R;
 }
 
+bool TagSelectorAnd::candidates(QSet<Feature*>& Result) const
+{
+    // Any term narrows it down; go with the smallest list
+    bool Found = false;
+    QSet<Feature*> Term;
+    for (int i=0; i<Terms.size(); ++i) {
+        if (!Terms[i]->candidates(Term))
+            continue;
+        if (!Found || Term.size() < Result.size())
+            Result.swap(Term);
+        Found = true;
+    }
+    return Found;
+}
+
 /* TAGSELECTORNOT */
 
 TagSelectorNot::TagSelectorNot(TagSelector* term)
@@ -1113,6 +1189,12 @@ QString TagSelectorFalse::asExpression(bool /* Precedence */) const
     return " false ";
 }
 
+bool TagSelectorFalse::candidates(QSet<Feature*>& Result) const
+{
+    Result.clear();
+    return true;
+}
+
 /* TAGSELECTORTRUE */
 
 TagSelectorTrue::TagSelectorTrue()
@@ -2,10 +2,12 @@
 #define MERKAARTOR_STYLE_TAGSELECTOR_H_
 
 class IFeature;
+class Feature;
 
 #include <QtCore/QString>
 #include <QRegExp>
 #include <QList>
+#include <QSet>
 #include <QStringList>
 
 #include <QDateTime>
@@ -41,6 +43,10 @@ class TagSelector
         virtual TagSelector* copy() const = 0;
         virtual TagSelectorMatchResult matches(const IFeature* F, qreal PixelPerM) const = 0;
         virtual QString asExpression(bool Precedence) const = 0;
+        /// If the tag index can narrow down the features this matches, put a
+        /// superset of them in \a Result and return true. Returns false if
+        /// every feature has to be tried.
+        virtual bool candidates(QSet<Feature*>& Result) const;
 
         static TagSelector* parse(const QString& Expression);
         static TagSelector* parse(const QString& Expression, int& idx);
@@ -62,6 +68,7 @@ class TagSelectorOperator : public TagSelector
         virtual TagSelector* copy() const;
         virtual TagSelectorMatchResult matches(const IFeature* F, qreal PixelPerM) const;
         virtual QString asExpression(bool Precedence) const;
+        virtual bool candidates(QSet<Feature*>& Result) const;
 
     private:
         TagSelectorMatchResult evaluateVal(const QString& val) const;
@@ -88,6 +95,7 @@ class TagSelectorIsOneOf : public TagSelector
         virtual TagSelector* copy() const;
         virtual TagSelectorMatchResult matches(const IFeature* F, qreal PixelPerM) const;
         virtual QString asExpression(bool Precedence) const;
+        virtual bool candidates(QSet<Feature*>& Result) const;
 
     private:
         QList<QRegExp> rxv;
@@ -133,6 +141,7 @@ class TagSelectorOr : public TagSelector
         virtual TagSelector* copy() const;
         virtual TagSelectorMatchResult matches(const IFeature* F, qreal PixelPerM) const;
         virtual QString asExpression(bool Precedence) const;
+        virtual bool candidates(QSet<Feature*>& Result) const;
 
     private:
         QList<TagSelector*> Terms;
@@ -147,6 +156,7 @@ class TagSelectorAnd : public TagSelector
         virtual TagSelector* copy() const;
         virtual TagSelectorMatchResult matches(const IFeature* F, qreal PixelPerM) const;
         virtual QString asExpression(bool Precedence) const;
+        virtual bool candidates(QSet<Feature*>& Result) const;
 
     private:
         QList<TagSelector*> Terms;
@@ -188,6 +198,7 @@ class TagSelectorFalse : public TagSelector
         virtual TagSelector* copy() const;
         virtual TagSelectorMatchResult matches(const IFeature* F, qreal PixelPerM) const;
         virtual QString asExpression(bool Precedence) const;
+        virtual bool candidates(QSet<Feature*>& Result) const;
 };
 
 class TagSelectorTrue : public TagSelector
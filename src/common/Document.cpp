@@ -34,10 +34,13 @@
 #include <QClipboard>
 #include <QMap>
 #include <QList>
+#include <QVector>
 #include <QMenu>
 #include <QSet>
 #include <QReadWriteLock>
 
+#include <algorithm>
+
 /* MAPDOCUMENT */
 
 class MapDocumentPrivate
@@ -73,6 +76,7 @@ public:
     Layer*	lastDownloadLayer;
     QDateTime lastDownloadTimestamp;
     QHash<Layer*, CoordBox>	downloadBoxes;
+    QMultiHash<qint64, Feature*> IdMap;
 
     TagSelector* tagFilter;
     int FilterRevision;
@@ -357,6 +361,11 @@ void Document::add(Layer* aLayer)
 {
     p->Layers.push_back(aLayer);
     aLayer->setDocument(this);
+    for (int i=0; i<aLayer->size(); ++i) {
+        Feature* F = aLayer->get(i);
+        if (!F->isVirtual() && F->id().type != IFeature::Uninitialized)
+            p->IdMap.insert(F->id().numId, F);
+    }
     if (p->theDock)
         p->theDock->addLayer(aLayer);
 }
@@ -398,11 +407,7 @@ FilterLayer* Document::addFilterLayer(FilterLayer *aLayer)
     if (!theLayer)
         theLayer = new FilterLayer(QUuid::createUuid().toString(), tr("Filter layer #%1").arg(++p->layerNum), "false");
     add(theLayer);
-
-    FeatureIterator it(this);
-    for(;!it.isEnd(); ++it) {
-        it.get()->updateFilters();
-    }
+    theLayer->evaluate();
 
     return theLayer;
 }
@@ -412,6 +417,10 @@ void Document::remove(Layer* aLayer)
     QList<Layer*>::iterator i = qFind(p->Layers.begin(),p->Layers.end(), aLayer);
     if (i != p->Layers.end()) {
         p->Layers.erase(i);
+        for (int j=0; j<aLayer->size(); ++j) {
+            Feature* F = aLayer->get(j);
+            p->IdMap.remove(F->id().numId, F);
+        }
     }
     if (aLayer == p->lastDownloadLayer)
         p->lastDownloadLayer = NULL;
@@ -479,15 +488,112 @@ QList<Feature*> Document::getFeatures(Layer::LayerType layerType)
     return theFeatures;
 }
 
+/* Same filter as VisibleFeatureIterator; the box test includes all bounds,
+ * so that a point box finds the nodes exactly at that point. */
+static inline bool isVisibleNodeIn(Node* N, const CoordBox& aBox)
+{
+    if (N->lastUpdated() == Feature::NotYetDownloaded
+            || N->isDeleted() || N->isVirtual() || N->isHidden())
+        return false;
+    const Coord& C = N->position();
+    return aBox.bottomLeft().x() <= C.x() && C.x() <= aBox.topRight().x()
+            && aBox.bottomLeft().y() <= C.y() && C.y() <= aBox.topRight().y();
+}
+
+/// Visible nodes inside \a aBox (bounds included), from the spatial index
+/// instead of a walk over the document. Untagged way nodes are not in the
+/// index themselves; they are found through their ways.
+QList<Node*> Document::getNodes(const CoordBox& aBox)
+{
+    QList<Node*> theNodes;
+    QSet<Node*> Seen;
+    for (int i=0; i<p->Layers.size(); ++i) {
+        // Copied, as the backend reuses the list for the next lookup
+        QList<Feature*> Found = g_backend.indexFind(p->Layers[i], aBox);
+        foreach (Feature* F, Found) {
+            if (Node* N = CAST_NODE(F)) {
+                if (isVisibleNodeIn(N, aBox) && !Seen.contains(N)) {
+                    Seen.insert(N);
+                    theNodes.append(N);
+                }
+            } else if (Way* W = CAST_WAY(F)) {
+                for (int j=0; j<W->size(); ++j) {
+                    Node* N = W->getNode(j);
+                    if (isVisibleNodeIn(N, aBox) && !Seen.contains(N)) {
+                        Seen.insert(N);
+                        theNodes.append(N);
+                    }
+                }
+            }
+        }
+    }
+    return theNodes;
+}
+
+/// Visible features matching \a aSelector, no more than \a MaxResult if not 0.
+/// Selectors on tag values start from the tag index instead of every feature.
+QList<Feature*> Document::findFeatures(const TagSelector* aSelector, qreal PixelPerM, int MaxResult)
+{
+    QList<Feature*> theFeatures;
+    QSet<Feature*> Candidates;
+    if (!aSelector->candidates(Candidates)) {
+        for (VisibleFeatureIterator i(this); !i.isEnd() && (!MaxResult || theFeatures.size() < MaxResult); ++i)
+            if (aSelector->matches(i.get(), PixelPerM))
+                theFeatures.append(i.get());
+        return theFeatures;
+    }
+
+    // The index covers every document; keep what VisibleFeatureIterator would
+    // give, in the same layer and feature order so results don't change from
+    // run to run with the set order
+    QVector< QPair<QPair<int, int>, Feature*> > Ordered;
+    Ordered.reserve(Candidates.size());
+    foreach (Feature* F, Candidates) {
+        int L = p->Layers.indexOf(F->layer());
+        if (L < 0)
+            continue;
+        if (F->lastUpdated() == Feature::NotYetDownloaded
+                || F->isDeleted() || F->isVirtual() || F->isHidden())
+            continue;
+        Ordered.append(qMakePair(qMakePair(L, F->layer()->get(F)), F));
+    }
+    std::sort(Ordered.begin(), Ordered.end());
+
+    for (int i=0; i<Ordered.size() && (!MaxResult || theFeatures.size() < MaxResult); ++i)
+        if (aSelector->matches(Ordered[i].second, PixelPerM))
+            theFeatures.append(Ordered[i].second);
+    return theFeatures;
+}
+
 Feature* Document::getFeature(const IFeature::FId& id)
 {
-    for (int i=0; i<p->Layers.size(); ++i)
-    {
-        Feature* F = p->Layers[i]->get(id);
-        if (F)
-            return F;
+    // Conflict and dirty copies share the id; as the layer walk this
+    // replaces did, the one in the first layer wins.
+    Feature* Found = NULL;
+    int FoundIdx = p->Layers.size();
+    QMultiHash<qint64, Feature*>::const_iterator i = p->IdMap.constFind(id.numId);
+    for (; i != p->IdMap.constEnd() && i.key() == id.numId; ++i) {
+        if ((i.value()->id().type & id.type) == 0)
+            continue;
+        int Idx = p->Layers.indexOf(i.value()->layer());
+        if (Idx >= 0 && Idx < FoundIdx) {
+            Found = i.value();
+            FoundIdx = Idx;
+        }
     }
-    return NULL;
+    return Found;
+}
+
+/* Document-wide id index, kept up to date by the layers (see Layer::notifyIdUpdate) */
+void Document::indexFeatureId(Layer* aLayer, qint64 numId, Feature* aFeature)
+{
+    if (p->Layers.contains(aLayer))
+        p->IdMap.insert(numId, aFeature);
+}
+
+void Document::unindexFeatureId(qint64 numId, Feature* aFeature)
+{
+    p->IdMap.remove(numId, aFeature);
 }
 
 void Document::setDirtyLayer(DirtyLayer* aLayer)
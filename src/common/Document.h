@@ -26,6 +26,7 @@ class DirtyLayer;
 class UploadedLayer;
 class DeletedLayer;
 class FeaturePainter;
+class TagSelector;
 
 class Document : public QObject, public IDocument
 {
@@ -64,7 +65,11 @@ public:
     int size() const;
 
     Feature* getFeature(const IFeature::FId& id);
+    void indexFeatureId(Layer* aLayer, qint64 numId, Feature* aFeature);
+    void unindexFeatureId(qint64 numId, Feature* aFeature);
     QList<Feature*> getFeatures(Layer::LayerType layerType = Layer::UndefinedType);
+    QList<Node*> getNodes(const CoordBox& aBox);
+    QList<Feature*> findFeatures(const TagSelector* aSelector, qreal PixelPerM, int MaxResult = 0);
     void setHistory(CommandHistory* h);
     CommandHistory& history();
     const CommandHistory& history() const;
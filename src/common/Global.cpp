@@ -107,7 +107,7 @@ const QString& g_getTagKey(int idx)
 
 quint32 g_getTagKeyIndex(const QString& s)
 {
-    return tagKeys.indexOf(s);
+    return tagKeysHash.value(s, -1);
 }
 
 QStringList g_getTagKeyList()
@@ -122,7 +122,7 @@ QString g_getTagValue(int idx)
 
 quint32 g_getTagValueIndex(const QString& s)
 {
-    return tagValues.indexOf(s);
+    return tagValuesHash.value(s, -1);
 }
 
 quint32 g_setUser(const QString& u)
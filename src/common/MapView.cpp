@@ -19,6 +19,7 @@
 #include "qgpsdevice.h"
 
 #include "OsmRenderLayer.h"
+#include "RenderProfiler.h"
 
 #ifdef USE_WEBKIT
     #include "browserimagemanager.h"
@@ -34,7 +35,9 @@
 #include <QToolTip>
 #include <QMap>
 #include <QSet>
+#include <QFutureWatcher>
 #include <QtConcurrentMap>
+#include <QtConcurrentRun>
 
 // from wikipedia
 #define EQUATORIALRADIUS 6378137.0
@@ -67,14 +70,38 @@ public:
 
     OsmRenderLayer* osmLayer;
 
+    /* Wireframe and touchup overlays are rendered on a worker into the back
+     * buffers, which are swapped with the front ones once done. */
+    QImage* BackWireframe;
+    QImage* BackTouchup;
+    QFuture<void> WireframeJob;
+    QFutureWatcher<void> WireframeWatcher;
+    QAtomicInt WireframeCancelled;
+    bool WireframePending;
+    QList<CoordBox> WireframeRects;
+    QPoint WireframeDelta;
+    bool WireframeDrawSimple;
+    QTransform WireframeTransform;  // the back buffers are being drawn with
+    QTransform FrontTransform;      // the front buffers were drawn with
+
     MapViewPrivate()
       : PixelPerM(0.0), Viewport(WORLD_COORDBOX), theVectorRotation(0.0)
       , BackgroundOnlyPanZoom(false)
       , theDocument(0)
       , theInteraction(0)
+      , BackWireframe(0), BackTouchup(0)
+      , WireframePending(false), WireframeDrawSimple(false)
     {}
 };
 
+/* The front buffers can only be composited (shifted by the pan) while the
+ * transform has the scale and rotation they were drawn with */
+static bool sameScale(const QTransform& a, const QTransform& b)
+{
+    return a.m11() == b.m11() && a.m12() == b.m12()
+        && a.m21() == b.m21() && a.m22() == b.m22();
+}
+
 /*********************/
 
 MapView::MapView(QWidget* parent) :
@@ -137,13 +164,18 @@ MapView::MapView(QWidget* parent) :
 
     p->osmLayer = new OsmRenderLayer(this);
     connect(p->osmLayer, SIGNAL(renderingDone()), SLOT(renderingDone()));
+    connect(&p->WireframeWatcher, SIGNAL(finished()), SLOT(wireframeRendered()));
 }
 
 MapView::~MapView()
 {
+    cancelWireframe();
+
     delete StaticBackground;
     delete StaticWireframe;
     delete StaticTouchup;
+    delete p->BackWireframe;
+    delete p->BackTouchup;
     delete p;
 }
 
@@ -154,6 +186,8 @@ MainWindow *MapView::main()
 
 void MapView::setDocument(Document* aDoc)
 {
+    cancelWireframe();
+
     p->theDocument = aDoc;
     p->osmLayer->setDocument(aDoc);
 
@@ -176,6 +210,7 @@ void MapView::invalidate(bool updateWireframe, bool updateOsmMap, bool updateBgM
         }
     }
     if (updateWireframe) {
+        cancelWireframe();
         p->invalidRects.clear();
         p->invalidRects.push_back(p->Viewport);
 
@@ -221,6 +256,7 @@ void MapView::panScreen(QPoint delta)
     if (p->BackgroundOnlyPanZoom) {
         p->BackgroundOnlyVpTransform.translate(-cDelta.x(), -cDelta.y());
     } else {
+        cancelWireframe();
         p->theVectorPanDelta += delta;
 
         CoordBox r1, r2;
@@ -254,6 +290,7 @@ void MapView::panScreen(QPoint delta)
 
 void MapView::rotateScreen(QPoint /* center */, qreal angle)
 {
+    cancelWireframe();
     p->theVectorRotation += angle;
 
     transformCalc(p->theTransform, p->theProjection, p->theVectorRotation, p->Viewport, rect());
@@ -281,7 +318,7 @@ void MapView::paintEvent(QPaintEvent * anEvent)
 
     updateStaticBackground();
 
-    P.drawPixmap(p->theVectorPanDelta, *StaticBackground);
+    P.drawPixmap(QPoint(0, 0), *StaticBackground);
     P.save();
     QTransform AlignTransform;
     for (LayerIterator<ImageMapLayer*> ImgIt(p->theDocument); !ImgIt.isEnd(); ++ImgIt) {
@@ -295,12 +332,14 @@ void MapView::paintEvent(QPaintEvent * anEvent)
     if (!p->invalidRects.isEmpty()) {
         updateWireframe();
     }
-    if (M_PREFS->getWireframeView() || !p->osmLayer->isRenderingDone() || M_PREFS->getEditRendering() == 1)
-        P.drawPixmap(p->theVectorPanDelta, *StaticWireframe);
+    bool FrontValid = sameScale(p->FrontTransform, p->theTransform);
+    if (FrontValid && (M_PREFS->getWireframeView() || !p->osmLayer->isRenderingDone() || M_PREFS->getEditRendering() == 1))
+        P.drawImage(p->theVectorPanDelta, *StaticWireframe);
     if (!M_PREFS->getWireframeView())
         if (!(TEST_RFLAGS(RendererOptions::Interacting) && M_PREFS->getEditRendering() == 1))
             drawFeatures(P);
-    P.drawPixmap(p->theVectorPanDelta, *StaticTouchup);
+    if (FrontValid)
+        P.drawImage(p->theVectorPanDelta, *StaticTouchup);
 
 
     drawLatLonGrid(P);
@@ -315,6 +354,9 @@ void MapView::paintEvent(QPaintEvent * anEvent)
     if (Main)
         drawGPS(P);
 
+    if (RenderProfiler::isEnabled())
+        RenderProfiler::drawOverlay(P, rect());
+
     P.end();
 
 #ifndef _MOBILE
@@ -391,8 +433,10 @@ void MapView::drawScale(QPainter & P)
 void MapView::drawGPS(QPainter & P)
 {
     if (Main->gps() && Main->gps()->getGpsDevice()) {
-        if (Main->gps()->getGpsDevice()->fixStatus() == QGPSDevice::StatusActive) {
-            Coord vp(Main->gps()->getGpsDevice()->longitude(), Main->gps()->getGpsDevice()->latitude());
+        // Drawn at the fix the last repaint was scheduled for, not at the
+        // device's live position which may be ahead of the queue
+        Coord vp;
+        if (Main->gps()->getGpsDevice()->fixStatus() == QGPSDevice::StatusActive && Main->gpsPosition(vp)) {
             QPoint g = toView(vp);
             QImage* pm = getSVGImageFromFile(":/Gps/Gps_Marker.svg", 32);
             P.drawImage(g - QPoint(16, 16), *pm);
@@ -601,40 +645,115 @@ void MapView::updateStaticBackground()
     }
 }
 
+/**
+ * Start rendering the wireframe and touchup overlays for the invalid rects.
+ * The overlays are drawn on a worker into the back buffers; the paint handler
+ * keeps compositing the front ones (shifted by the pan since they were drawn)
+ * until wireframeRendered() swaps them.
+ */
 void MapView::updateWireframe()
+{
+    if (p->WireframePending || !p->theDocument)
+        return;
+
+    if (!p->BackWireframe || p->BackWireframe->size() != StaticWireframe->size()) {
+        delete p->BackWireframe;
+        p->BackWireframe = new QImage(StaticWireframe->size(), QImage::Format_ARGB32_Premultiplied);
+    }
+    if (!p->BackTouchup || p->BackTouchup->size() != StaticTouchup->size()) {
+        delete p->BackTouchup;
+        p->BackTouchup = new QImage(StaticTouchup->size(), QImage::Format_ARGB32_Premultiplied);
+    }
+
+    // Front buffers drawn at another scale can't be reused; redraw everything
+    if (!sameScale(p->FrontTransform, p->theTransform)) {
+        p->invalidRects.clear();
+        p->invalidRects.push_back(p->Viewport);
+        p->theVectorPanDelta = QPoint(0, 0);
+    }
+
+    p->WireframeRects = p->invalidRects;
+    p->invalidRects.clear();
+    p->WireframeDelta = p->theVectorPanDelta;
+    p->WireframeTransform = p->theTransform;
+    p->WireframeDrawSimple = M_PREFS->getWireframeView() || !p->osmLayer->isRenderingDone() || M_PREFS->getEditRendering() == 1;
+    p->WireframeCancelled.store(0);
+    p->WireframePending = true;
+
+    p->WireframeJob = QtConcurrent::run(this, &MapView::renderWireframe);
+    p->WireframeWatcher.setFuture(p->WireframeJob);
+}
+
+/**
+ * Drop the overlay being rendered, if any; its rects are queued again. Must
+ * be called before anything the render depends on (transform, viewport,
+ * options, buffers) is changed. The worker polls the cancel flag in the
+ * index query and the draw loops, so the wait is short.
+ */
+void MapView::cancelWireframe()
+{
+    if (!p->WireframePending)
+        return;
+
+    p->WireframeCancelled.store(1);
+    p->WireframeJob.waitForFinished();
+    p->WireframePending = false;
+    p->invalidRects = p->WireframeRects + p->invalidRects;
+}
+
+void MapView::wireframeRendered()
+{
+    if (!p->WireframePending || !p->WireframeJob.isFinished())
+        return;
+    p->WireframePending = false;
+
+    qSwap(StaticWireframe, p->BackWireframe);
+    qSwap(StaticTouchup, p->BackTouchup);
+    p->FrontTransform = p->WireframeTransform;
+    p->theVectorPanDelta -= p->WireframeDelta;
+    update();
+}
+
+static void beginOverlay(QPainter& P, QImage* Back, const QImage* Front, const QPoint& Delta, const QRegion& Exposed)
+{
+    Back->fill(Qt::transparent);
+    P.begin(Back);
+    if (!Delta.isNull())
+        P.drawImage(Delta, *Front);
+    P.setClipping(true);
+    P.setClipRegion(Exposed);
+}
+
+/* Runs on a worker thread */
+void MapView::renderWireframe()
 {
     QMap<RenderPriority, QSet <Feature*> > theFeatures;
     QMap<RenderPriority, QSet<Feature*> >::const_iterator itm;
     QSet<Feature*>::const_iterator it;
 
-    QPainter P;
+    p->theDocument->lockPainters();
+    g_backend.delayDeletes();
 
-    for (int i=0; i<p->theDocument->layerSize(); ++i)
-        g_backend.getFeatureSet(p->theDocument->getLayer(i), theFeatures, p->invalidRects, p->theProjection);
-
-    if (!p->theVectorPanDelta.isNull()) {
-        QRegion exposed;
-        StaticWireframe->scroll(p->theVectorPanDelta.x(), p->theVectorPanDelta.y(), StaticWireframe->rect(), &exposed);
-        P.begin(StaticWireframe);
-        P.setClipping(true);
-        P.setClipRegion(exposed);
-        P.setCompositionMode(QPainter::CompositionMode_Source);
-        P.fillRect(StaticWireframe->rect(), Qt::transparent);
-    } else {
-        StaticWireframe->fill(Qt::transparent);
-        P.begin(StaticWireframe);
-        P.setClipping(true);
-        P.setClipRegion(rect());
-    }
+    for (int i=0; i<p->theDocument->layerSize() && !p->WireframeCancelled.load(); ++i)
+        g_backend.getFeatureSet(p->theDocument->getLayer(i), theFeatures, p->WireframeRects, p->theProjection, &p->WireframeCancelled);
+
+    // When panning, only the newly exposed strips are drawn over the shifted front buffer
+    QRect Target(QPoint(0, 0), p->BackWireframe->size());
+    QRegion Exposed(Target);
+    if (!p->WireframeDelta.isNull())
+        Exposed -= QRegion(Target.translated(p->WireframeDelta));
 
-    if (M_PREFS->getWireframeView() || !p->osmLayer->isRenderingDone() || M_PREFS->getEditRendering() == 1) {
+    QPainter P;
+
+    beginOverlay(P, p->BackWireframe, StaticWireframe, p->WireframeDelta, Exposed);
+    if (p->WireframeDrawSimple) {
         if (M_PREFS->getWireframeView() && M_PREFS->getUseAntiAlias())
             P.setRenderHint(QPainter::Antialiasing);
         else if (M_PREFS->getEditRendering() == 1)
             P.setRenderHint(QPainter::Antialiasing);
-        for (itm = theFeatures.constBegin() ;itm != theFeatures.constEnd(); ++itm)
+        for (itm = theFeatures.constBegin() ;itm != theFeatures.constEnd() && !p->WireframeCancelled.load(); ++itm)
         {
-            for (it = itm.value().constBegin() ;it != itm.value().constEnd(); ++it)
+            for (it = itm.value().constBegin() ;it != itm.value().constEnd() && !p->WireframeCancelled.load(); ++it)
             {
                 qreal alpha = (*it)->getAlpha();
                 P.setOpacity(alpha);
@@ -645,26 +764,11 @@ void MapView::updateWireframe()
     }
     P.end();
 
-    if (!p->theVectorPanDelta.isNull()) {
-        QRegion exposed;
-        StaticTouchup->scroll(p->theVectorPanDelta.x(), p->theVectorPanDelta.y(), StaticTouchup->rect(), &exposed);
-        P.begin(StaticTouchup);
-        P.setClipping(true);
-        P.setClipRegion(exposed);
-        P.setCompositionMode(QPainter::CompositionMode_Source);
-        P.fillRect(StaticTouchup->rect(), Qt::transparent);
-    } else {
-        StaticTouchup->fill(Qt::transparent);
-        P.begin(StaticTouchup);
-        P.setClipping(true);
-        P.setClipRegion(rect());
-    }
-
+    beginOverlay(P, p->BackTouchup, StaticTouchup, p->WireframeDelta, Exposed);
     P.setRenderHint(QPainter::Antialiasing);
-
-    for (itm = theFeatures.constBegin() ;itm != theFeatures.constEnd(); ++itm)
+    for (itm = theFeatures.constBegin() ;itm != theFeatures.constEnd() && !p->WireframeCancelled.load(); ++itm)
     {
-        for (it = itm.value().constBegin() ;it != itm.value().constEnd(); ++it)
+        for (it = itm.value().constBegin() ;it != itm.value().constEnd() && !p->WireframeCancelled.load(); ++it)
         {
             qreal alpha = (*it)->getAlpha();
             P.setOpacity(alpha);
@@ -674,21 +778,8 @@ void MapView::updateWireframe()
     }
     P.end();
 
-    p->invalidRects.clear();
-    p->theVectorPanDelta = QPoint(0, 0);
-
-
-//    QPainter P;
-
-//    StaticBuffer->fill(Qt::transparent);
-//    P.begin(StaticBuffer);
-//    P.setCompositionMode(QPainter::CompositionMode_Source);
-//    P.setClipping(true);
-//    P.setClipRegion(rect());
-////    if (M_PREFS->getUseAntiAlias())
-////        P.setRenderHint(QPainter::Antialiasing);
-//    drawFeatures(P);
-//    P.end();
+    g_backend.resumeDeletes();
+    p->theDocument->unlockPainters();
 }
 
 void MapView::mousePressEvent(QMouseEvent* anEvent)
@@ -773,6 +864,7 @@ void MapView::on_imageReceived(ImageMapLayer* aLayer)
 
 void MapView::resizeEvent(QResizeEvent * ev)
 {
+    cancelWireframe();
     viewportRecalc(QRect(QPoint(0,0), ev->size()));
 
     QWidget::resizeEvent(ev);
@@ -780,13 +872,14 @@ void MapView::resizeEvent(QResizeEvent * ev)
     if (!StaticWireframe || (StaticWireframe->size() != size()))
     {
         delete StaticWireframe;
-        StaticWireframe = new QPixmap(size());
+        StaticWireframe = new QImage(size(), QImage::Format_ARGB32_Premultiplied);
         StaticWireframe->fill(Qt::transparent);
     }
     if (!StaticTouchup || (StaticTouchup->size() != size()))
     {
         delete StaticTouchup;
-        StaticTouchup = new QPixmap(size());
+        StaticTouchup = new QImage(size(), QImage::Format_ARGB32_Premultiplied);
+        StaticTouchup->fill(Qt::transparent);
     }
 
     invalidate(true, true, true);
@@ -836,6 +929,7 @@ void MapView::fromXML(QXmlStreamReader& stream)
         if (stream.name() == "Viewport") {
             cb = CoordBox::fromXML(stream);
         } else if (stream.name() == "Projection") {
+            cancelWireframe();
             p->theProjection.fromXML(stream);
         }
         stream.readNext();
@@ -995,6 +1089,7 @@ void MapView::setViewport(const CoordBox & TargetMap,
         targetVp = CoordBox (TargetMap.center()-COORD_ENLARGE*10, TargetMap.center()+COORD_ENLARGE*10);
     else
         targetVp = TargetMap;
+    cancelWireframe();
     transformCalc(p->theTransform, p->theProjection, p->theVectorRotation, targetVp, Screen);
     p->theInvertedTransform = p->theTransform.inverted();
     viewportRecalc(Screen);
@@ -1053,6 +1148,7 @@ void MapView::zoom(qreal d, const QPoint & Around)
 void MapView::zoom(qreal d, const QPoint & Around,
                              const QRect & Screen)
 {
+    cancelWireframe();
     QPointF pBefore = p->theInvertedTransform.map(QPointF(Around));
 
     qreal ScaleLon = p->theTransform.m11() * d;
@@ -1113,6 +1209,7 @@ void MapView::setCenter(Coord & Center, const QRect & /*Screen*/)
 
 void MapView::setInteracting(bool val)
 {
+    cancelWireframe();
     if (val)
         p->ROptions.options |= RendererOptions::Interacting;
     else
@@ -1137,10 +1234,12 @@ RendererOptions MapView::renderOptions()
 
 void MapView::setRenderOptions(const RendererOptions &opt)
 {
+    cancelWireframe();
     p->ROptions = opt;
 }
 
 void MapView::stopRendering() {
+    cancelWireframe();
     p->osmLayer->stopRendering();
 }
 
@@ -4,6 +4,7 @@
 #include "Projection.h"
 #include "IRenderer.h"
 
+#include <QImage>
 #include <QPixmap>
 #include <QWidget>
 #include <QShortcut>
@@ -100,11 +101,13 @@ private:
     void drawGPS(QPainter & painter);
     void updateStaticBackground();
     void updateWireframe();
+    void cancelWireframe();
+    void renderWireframe();
 
     MainWindow* Main;
     QPixmap* StaticBackground;
-    QPixmap* StaticWireframe;
-    QPixmap* StaticTouchup;
+    QImage* StaticWireframe;
+    QImage* StaticTouchup;
     bool StaticMapUpToDate;
     bool SelectionLocked;
     QLabel* lockIcon;
@@ -128,6 +131,9 @@ public slots:
 
     virtual void renderingDone();
 
+private slots:
+    void wireframeRendered();
+
 signals:
     void viewportChanged();
 
@@ -6,7 +6,10 @@
 #include <QtGui/QPainter>
 #include <QtGui/QPainterPath>
 #include <QLineF>
+#include <QTransform>
+#include <QVector>
 
+#include <cmath>
 #include <utility>
 
 #if 0
@@ -222,5 +225,103 @@ void draw(QPainter& thePainter, QPen& thePen, Feature::TrafficDirectionType TT,
     thePainter.strokePath(Path,thePen);
 } */
 
+// Paths with fewer elements than this are cheaper to draw than to simplify
+#define GENERALIZE_MIN_ELEMENTS 64
+// Keep the full path unless simplifying drops at least a quarter of it
+#define GENERALIZE_MIN_GAIN 0.75
+// Tolerance in pixels at the most zoomed-in scale of a bucket
+#define GENERALIZE_TOLERANCE 0.5
 
+static qreal segmentDistance(const QPointF& P, const QPointF& A, const QPointF& B)
+{
+    QPointF AB(B-A);
+    qreal Len = AB.x()*AB.x() + AB.y()*AB.y();
+    QPointF Q(A);
+    if (Len > 0) {
+        qreal t = ((P.x()-A.x())*AB.x() + (P.y()-A.y())*AB.y()) / Len;
+        if (t >= 1)
+            Q = B;
+        else if (t > 0)
+            Q = A + AB*t;
+    }
+    QPointF D(P-Q);
+    return sqrt(D.x()*D.x() + D.y()*D.y());
+}
+
+static void generalizeSubpath(QPainterPath& Out, const QVector<QPointF>& Pts, qreal Tolerance)
+{
+    if (Pts.isEmpty())
+        return;
+
+    QVector<bool> Keep(Pts.size(), false);
+    Keep[0] = true;
+    Keep[Pts.size()-1] = true;
+
+    QVector< QPair<int,int> > Todo;
+    Todo << qMakePair(0, Pts.size()-1);
+    while (!Todo.isEmpty()) {
+        QPair<int,int> Range = Todo.last();
+        Todo.pop_back();
+
+        int Best = -1;
+        qreal BestDist = Tolerance;
+        for (int i=Range.first+1; i<Range.second; ++i) {
+            qreal d = segmentDistance(Pts[i], Pts[Range.first], Pts[Range.second]);
+            if (d > BestDist) {
+                Best = i;
+                BestDist = d;
+            }
+        }
+        if (Best != -1) {
+            Keep[Best] = true;
+            Todo << qMakePair(Range.first, Best) << qMakePair(Best, Range.second);
+        }
+    }
+
+    Out.moveTo(Pts[0]);
+    for (int i=1; i<Pts.size(); ++i)
+        if (Keep[i])
+            Out.lineTo(Pts[i]);
+}
+
+QPainterPath generalizePath(const QPainterPath& Path, qreal Tolerance)
+{
+    QPainterPath Out;
+    Out.setFillRule(Path.fillRule());
 
+    QVector<QPointF> Pts;
+    for (int i=0; i<Path.elementCount(); ++i) {
+        const QPainterPath::Element& E = Path.elementAt(i);
+        if (E.isMoveTo()) {
+            generalizeSubpath(Out, Pts, Tolerance);
+            Pts.clear();
+        } else if (!E.isLineTo()) {
+            // Curves are not generalized
+            return Path;
+        }
+        Pts << QPointF(E.x, E.y);
+    }
+    generalizeSubpath(Out, Pts, Tolerance);
+
+    return Out;
+}
+
+const QPainterPath& GeneralizedPaths::get(const QPainterPath& Full, const QTransform& theTransform)
+{
+    if (Full.elementCount() < GENERALIZE_MIN_ELEMENTS)
+        return Full;
+
+    qreal Scale = sqrt(fabs(theTransform.determinant()));
+    if (Scale <= 0 || !std::isfinite(Scale))
+        return Full;
+
+    int Level = int(ceil(log(Scale)/log(2.)));
+    QHash<int, QPainterPath>::const_iterator it = Levels.constFind(Level);
+    if (it != Levels.constEnd())
+        return it.value();
+
+    QPainterPath Simple = generalizePath(Full, GENERALIZE_TOLERANCE / pow(2., Level));
+    if (Simple.elementCount() > Full.elementCount()*GENERALIZE_MIN_GAIN)
+        Simple = Full;
+    return Levels[Level] = Simple;
+}
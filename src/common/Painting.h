@@ -3,19 +3,44 @@
 
 #include "Feature.h"
 
+#include <QHash>
+#include <QtGui/QPainterPath>
+
 class Coord;
 class Projection;
 class Way;
 class Way;
 
 class QPainter;
-class QPainterPath;
 class QPolygonF;
 class QPen;
+class QTransform;
 
 //void buildPathFromRoad(Road *R, Projection const &theProjection, QPainterPath &Path, const QRect& clipRect);
 void buildPolygonFromRoad(Way *R, Projection const &theProjection, QPolygonF &Polygon);
 
+/// Douglas-Peucker simplification of every subpath of a polyline path
+QPainterPath generalizePath(const QPainterPath& Path, qreal Tolerance);
+
+/**
+  Simplified levels of a projected path, computed lazily.
+
+  Levels are bucketed by powers of two of the view scale (pixels per
+  projected unit) and simplified to half a pixel of the most zoomed-in scale
+  of their bucket, so that a level is indistinguishable from the full path
+  wherever it is used. The owner must clear() it whenever the full path is
+  rebuilt, e.g. on a projection change.
+*/
+class GeneralizedPaths
+{
+public:
+    const QPainterPath& get(const QPainterPath& Full, const QTransform& theTransform);
+    void clear() { Levels.clear(); }
+
+private:
+    QHash<int, QPainterPath> Levels;
+};
+
 /// draws way with oneway markers
 void draw(QPainter& thePainter, QPen& thePen, Feature::TrafficDirectionType Dir, const QPointF& FromF, const QPointF& ToF, qreal theWidth, const Projection& theProjection);
 void draw(QPainter& thePainter, QPen& thePen, Feature::TrafficDirectionType Dir, const Coord& From, const Coord& To, qreal theWidth, const Projection& theProjection);
@@ -6,7 +6,9 @@
 #include "Document.h"
 #include "Feature.h"
 #include "Layer.h"
+#include "Global.h"
 #include <QMessageBox>
+#include <QHash>
 
 TagModel::TagModel(MainWindow* aMain)
 : Main(aMain)
@@ -28,14 +30,27 @@ void TagModel::setFeature(const QList<Feature*> Features)
     theFeatures = Features;
     if (theFeatures.size())
     {
+        // Narrow the first feature's tags down to the ones every other
+        // feature has with the same value, comparing interned ids only
         Feature* F = theFeatures[0];
+        QHash<quint32, quint32> Common;
         for (int i=0; i<F->tagSize(); ++i)
+            Common.insert(F->tagKeyId(i), F->tagValueId(i));
+        for (int j=1; j<theFeatures.size() && !Common.isEmpty(); ++j)
         {
-            int j=0;
-            for (j=1; j<theFeatures.size(); ++j)
-                if (F->tagValue(i) != theFeatures[j]->tagValue(F->tagKey(i),""))
-                    break;
-            if (j == theFeatures.size())
+            QHash<quint32, quint32> Next;
+            Feature* G = theFeatures[j];
+            for (int i=0; i<G->tagSize(); ++i) {
+                QHash<quint32, quint32>::const_iterator it = Common.constFind(G->tagKeyId(i));
+                if (it != Common.constEnd() && it.value() == G->tagValueId(i))
+                    Next.insert(it.key(), it.value());
+            }
+            Common = Next;
+        }
+
+        for (int i=0; i<F->tagSize(); ++i)
+        {
+            if (Common.contains(F->tagKeyId(i)))
                 if (!F->tagKey(i).startsWith("%kml:"))
                     Tags.push_back(qMakePair(F->tagKey(i),F->tagValue(i)));
         }